@@ -0,0 +1,109 @@
+// -------------------------------------------------------------------
+//
+// bucket_filter.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <vector>
+
+#include "leveldb_ee/bucket_filter.h"
+#include "leveldb_ee/riak_object.h"
+
+namespace leveldb {
+
+
+BucketFilterPolicy::BucketFilterPolicy(
+    const FilterPolicy * Inner)
+    : m_Inner(Inner)
+{
+    m_Name="leveldb_ee.BucketFilter.";
+    m_Name.append(m_Inner->Name());
+
+}   // BucketFilterPolicy::BucketFilterPolicy
+
+
+/**
+ * Keys arrive in sort order, so one bucket's keys are adjacent.
+ *  Each bucket is added once per filter.
+ */
+void
+BucketFilterPolicy::CreateFilter(
+    const Slice * Keys,
+    int Count,
+    std::string * Dst) const
+{
+    std::vector<Slice> entries;
+    Slice bucket, last_bucket;
+    int loop;
+
+    entries.reserve(Count + Count/8 + 1);
+
+    for (loop=0; loop<Count; ++loop)
+    {
+        entries.push_back(Keys[loop]);
+
+        if (KeyGetBucket(Keys[loop], bucket) && bucket!=last_bucket)
+        {
+            entries.push_back(bucket);
+            last_bucket=bucket;
+        }   // if
+    }   // for
+
+    m_Inner->CreateFilter(entries.empty() ? NULL : &entries[0],
+                          (int)entries.size(), Dst);
+
+}   // BucketFilterPolicy::CreateFilter
+
+
+bool
+BucketFilterPolicy::KeyMayMatch(
+    const Slice & Key,
+    const Slice & Filter) const
+{
+    return(m_Inner->KeyMayMatch(Key, Filter));
+
+}   // BucketFilterPolicy::KeyMayMatch
+
+
+bool
+BucketFilterPolicy::BucketMayMatch(
+    const Slice & Key,
+    const Slice & Filter) const
+{
+    bool ret_flag(true);
+    Slice bucket;
+
+    if (KeyGetBucket(Key, bucket))
+        ret_flag=m_Inner->KeyMayMatch(bucket, Filter);
+
+    return(ret_flag);
+
+}   // BucketFilterPolicy::BucketMayMatch
+
+
+const FilterPolicy *
+NewBucketFilterPolicy(
+    const FilterPolicy * Inner)
+{
+    return(new BucketFilterPolicy(Inner));
+
+}   // NewBucketFilterPolicy
+
+}  // namespace leveldb
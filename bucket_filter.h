@@ -0,0 +1,86 @@
+// -------------------------------------------------------------------
+//
+// bucket_filter.h
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#ifndef BUCKET_FILTER_H
+#define BUCKET_FILTER_H
+
+#include <string>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+
+namespace leveldb
+{
+    /**
+     * FilterPolicy wrapper that adds each Riak key's composite
+     *  bucket (KeyGetBucket()) to the filter beside the key itself.
+     *  Point lookups behave as with the inner policy.  Bucket folds
+     *  and list keys can call BucketMayMatch() with their seek key
+     *  and pass over any filter that holds no key of that bucket.
+     *
+     *  Name() differs from the inner policy's name so existing
+     *  tables keep using their original filters until compacted.
+     *
+     *  Parent hookup, not in leveldb_ee:  Options::filter_policy set
+     *  to NewBucketFilterPolicy(), and the table iterator's seek path
+     *  calling BucketMayMatch() before it reads a data block.  Until
+     *  then BucketMayMatch() has no caller.
+     */
+    class BucketFilterPolicy : public FilterPolicy
+    {
+    public:
+        // Inner is not owned, must outlive this object
+        explicit BucketFilterPolicy(const FilterPolicy * Inner);
+
+        virtual ~BucketFilterPolicy() {};
+
+        virtual const char * Name() const {return(m_Name.c_str());};
+
+        virtual void CreateFilter(const Slice * Keys, int Count, std::string * Dst) const;
+
+        virtual bool KeyMayMatch(const Slice & Key, const Slice & Filter) const;
+
+        // false only if no key sharing Key's bucket was added to Filter.
+        //  Always true for keys that are not Riak keys.
+        bool BucketMayMatch(const Slice & Key, const Slice & Filter) const;
+
+    protected:
+        const FilterPolicy * m_Inner;
+        std::string m_Name;
+
+    private:
+        BucketFilterPolicy();
+        BucketFilterPolicy(const BucketFilterPolicy &);
+        BucketFilterPolicy & operator=(const BucketFilterPolicy &);
+
+    };  // class BucketFilterPolicy
+
+
+    // caller deletes result, Inner stays owned by caller
+    const FilterPolicy * NewBucketFilterPolicy(const FilterPolicy * Inner);
+
+}  // namespace leveldb
+
+
+#endif  // ifndef BUCKET_FILTER_H
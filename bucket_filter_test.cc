@@ -0,0 +1,164 @@
+// -------------------------------------------------------------------
+//
+// bucket_filter_test.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+#include "leveldb/filter_policy.h"
+#include "leveldb_ee/bucket_filter.h"
+#include "leveldb_ee/riak_object.h"
+
+/**
+ * Execution routine
+ */
+int main(int argc, char** argv)
+{
+    return leveldb::test::RunAllTests();
+}
+
+
+namespace leveldb {
+
+
+/**
+ * Wrapper class for tests.  Holds working variables
+ * and helper functions.
+ */
+class BucketFilterTester
+{
+public:
+    const FilterPolicy * m_Bloom;
+    const FilterPolicy * m_Policy;
+
+    BucketFilterTester()
+    {
+        m_Bloom=NewBloomFilterPolicy(10);
+        m_Policy=NewBucketFilterPolicy(m_Bloom);
+    };
+
+    ~BucketFilterTester()
+    {
+        delete m_Policy;
+        delete m_Bloom;
+    };
+
+    // "bucketN" holding keys "key0" .. "key<Count-1>"
+    void AddBucket(const char * Type, int Bucket, int Count, std::vector<std::string> & Keys)
+    {
+        char bucket_name[32], key_name[32];
+        std::string key;
+        int loop;
+
+        snprintf(bucket_name, sizeof(bucket_name), "bucket%d", Bucket);
+        for (loop=0; loop<Count; ++loop)
+        {
+            snprintf(key_name, sizeof(key_name), "key%d", loop);
+            ASSERT_TRUE(BuildRiakKey(Type, bucket_name, key_name, key));
+            Keys.push_back(key);
+        }   // for
+    };
+
+    void BuildFilter(const std::vector<std::string> & Keys, std::string & Filter)
+    {
+        std::vector<Slice> slices(Keys.begin(), Keys.end());
+
+        Filter.clear();
+        m_Policy->CreateFilter(&slices[0], (int)slices.size(), &Filter);
+    };
+
+};  // class BucketFilterTester
+
+
+/**
+ * Keys still match, present buckets match, absent buckets
+ *  are mostly rejected
+ */
+TEST(BucketFilterTester, BucketMatchTest)
+{
+    const BucketFilterPolicy * policy;
+    std::vector<std::string> keys;
+    std::string filter, seek;
+    size_t loop;
+    int bucket, false_positives;
+
+    policy=(const BucketFilterPolicy *)m_Policy;
+    ASSERT_TRUE(std::string("leveldb_ee.BucketFilter.")+m_Bloom->Name()==m_Policy->Name());
+
+    AddBucket(NULL, 3, 200, keys);
+    AddBucket("type1", 3, 200, keys);
+    AddBucket(NULL, 7, 100, keys);
+    keys.push_back("not a riak key");
+    BuildFilter(keys, filter);
+
+    for (loop=0; loop<keys.size(); ++loop)
+    {
+        ASSERT_TRUE(m_Policy->KeyMayMatch(keys[loop], filter));
+        ASSERT_TRUE(policy->BucketMayMatch(keys[loop], filter));
+    }   // for
+
+    // seek to a key not in the table, bucket present
+    ASSERT_TRUE(BuildRiakKey(NULL, "bucket7", "absent", seek));
+    ASSERT_TRUE(policy->BucketMayMatch(seek, filter));
+
+    // non-Riak seeks never excluded
+    ASSERT_TRUE(policy->BucketMayMatch("something else", filter));
+
+    // absent buckets, 10 bits per entry
+    false_positives=0;
+    for (bucket=100; bucket<1100; ++bucket)
+    {
+        keys.clear();
+        AddBucket(NULL, bucket, 1, keys);
+        if (policy->BucketMayMatch(keys[0], filter))
+            ++false_positives;
+    }   // for
+    ASSERT_TRUE(false_positives < 50);
+
+}   // BucketMatchTest
+
+
+/**
+ * 2i entries share their objects' bucket
+ */
+TEST(BucketFilterTester, IndexKeyTest)
+{
+    const BucketFilterPolicy * policy;
+    std::vector<std::string> keys;
+    std::string filter, key;
+
+    policy=(const BucketFilterPolicy *)m_Policy;
+
+    ASSERT_TRUE(BuildRiakIndexKey(NULL, "bucket9", "field_bin", "term", "key0", key));
+    keys.push_back(key);
+    BuildFilter(keys, filter);
+
+    ASSERT_TRUE(BuildRiakKey(NULL, "bucket9", "key0", key));
+    ASSERT_TRUE(policy->BucketMayMatch(key, filter));
+
+}   // IndexKeyTest
+
+}  // namespace leveldb
@@ -0,0 +1,279 @@
+// -------------------------------------------------------------------
+//
+// bucket_intern.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "leveldb/atomics.h"
+#include "util/hash.h"
+#include "leveldb_ee/bucket_intern.h"
+#include "leveldb_ee/riak_object.h"
+
+namespace leveldb {
+
+// process wide table size, far above any real cluster's bucket count
+static const size_t cGlobalBuckets=16384;
+
+const BucketId_t BucketInternTable::cPendingId;
+const BucketId_t BucketInternTable::cFullId;
+
+
+BucketInternTable::BucketInternTable(
+    size_t MaxBuckets)
+    : m_SlotMask(0), m_MaxBuckets(MaxBuckets), m_LastId(0)
+{
+    size_t slots;
+
+    // at most half full keeps probe runs short
+    for (slots=16; slots<2*m_MaxBuckets; slots<<=1)
+    {}
+
+    m_SlotMask=slots-1;
+    m_Slots=new Entry * volatile[slots];
+    m_Entries=new Entry * volatile[m_MaxBuckets + 1];
+    memset((void *)m_Slots, 0, slots*sizeof(Entry *));
+    memset((void *)m_Entries, 0, (m_MaxBuckets + 1)*sizeof(Entry *));
+
+}   // BucketInternTable::BucketInternTable
+
+
+BucketInternTable::~BucketInternTable()
+{
+    size_t loop;
+
+    for (loop=0; loop<=m_SlotMask; ++loop)
+        free(m_Slots[loop]);
+
+    delete [] m_Slots;
+    delete [] m_Entries;
+
+}   // BucketInternTable::~BucketInternTable
+
+
+uint32_t
+BucketInternTable::HashComposite(
+    const Slice & Composite)
+{
+    return(Hash(Composite.data(), Composite.size(), 0));
+
+}   // BucketInternTable::HashComposite
+
+
+/**
+ * Linear probe from Hash's slot.  Slot set to the matching entry's
+ *  slot, or to the first empty slot if none matches.
+ */
+const BucketInternTable::Entry *
+BucketInternTable::FindEntry(
+    const Slice & Composite,
+    uint32_t Hash,
+    size_t & Slot) const
+{
+    const Entry * entry;
+
+    for (Slot=Hash & m_SlotMask; ; Slot=(Slot+1) & m_SlotMask)
+    {
+        entry=m_Slots[Slot];
+
+        if (NULL==entry
+            || (entry->m_Hash==Hash && entry->m_Length==Composite.size()
+                && 0==memcmp(entry->m_Bytes, Composite.data(), Composite.size())))
+            break;
+    }   // for
+
+    return(entry);
+
+}   // BucketInternTable::FindEntry
+
+
+BucketId_t
+BucketInternTable::Find(
+    const Slice & Composite) const
+{
+    const Entry * entry;
+    size_t slot;
+    BucketId_t id;
+
+    id=0;
+    if (!Composite.empty())
+    {
+        entry=FindEntry(Composite, HashComposite(Composite), slot);
+        if (NULL!=entry && cFullId!=entry->m_Id)
+            id=entry->m_Id;
+    }   // if
+
+    return(id);
+
+}   // BucketInternTable::Find
+
+
+/**
+ * The new entry is complete, except its ID, before the compare and
+ *  swap publishes it.  Only the thread that wins the slot reserves
+ *  an ID, so a lost race costs a malloc / free and never an ID.  A
+ *  lost race restarts the probe at the slot just taken; the winner
+ *  may be this same bucket.  m_Entries[] is set before the ID
+ *  becomes visible, so GetComposite() of any ID a caller holds
+ *  finds its entry.
+ */
+BucketId_t
+BucketInternTable::Intern(
+    const Slice & Composite)
+{
+    const Entry * found;
+    Entry * entry;
+    size_t slot;
+    uint32_t hash, last;
+    BucketId_t ret_id, id;
+
+    ret_id=0;
+    found=NULL;
+    entry=NULL;
+
+    if (!Composite.empty())
+    {
+        hash=HashComposite(Composite);
+        found=FindEntry(Composite, hash, slot);
+
+        // new bucket, unless every ID already handed out
+        while (NULL==found && m_LastId<m_MaxBuckets)
+        {
+            if (NULL==entry)
+            {
+                entry=(Entry *)malloc(sizeof(Entry) + Composite.size());
+                entry->m_Hash=hash;
+                entry->m_Id=cPendingId;
+                entry->m_Length=Composite.size();
+                memcpy(entry->m_Bytes, Composite.data(), Composite.size());
+            }   // if
+
+            if (compare_and_swap(&m_Slots[slot], (Entry *)NULL, entry))
+            {
+                // reserve next ID without passing m_MaxBuckets
+                do
+                {
+                    last=m_LastId;
+                } while (last<m_MaxBuckets
+                         && !compare_and_swap(&m_LastId, last, last+1));
+
+                id=(last<m_MaxBuckets) ? last+1 : cFullId;
+                if (cFullId!=id)
+                    m_Entries[id]=entry;
+
+                // full barrier, publishes m_Entries[id] with the ID
+                compare_and_swap(&entry->m_Id, cPendingId, id);
+
+                found=entry;
+                entry=NULL;
+            }   // if
+            else
+            {
+                found=FindEntry(Composite, hash, slot);
+            }   // else
+        }   // while
+
+        // never published (lost race, or table filled)
+        free(entry);
+
+        if (NULL!=found)
+        {
+            // another thread won this bucket and is reserving its ID
+            while (cPendingId==found->m_Id)
+                sched_yield();
+
+            if (cFullId!=found->m_Id)
+                ret_id=found->m_Id;
+        }   // if
+    }   // if
+
+    return(ret_id);
+
+}   // BucketInternTable::Intern
+
+
+Slice
+BucketInternTable::GetComposite(
+    BucketId_t Id) const
+{
+    const Entry * entry;
+
+    entry=(0<Id && Id<=m_MaxBuckets) ? m_Entries[Id] : NULL;
+
+    return(NULL!=entry ? Slice(entry->m_Bytes, entry->m_Length) : Slice());
+
+}   // BucketInternTable::GetComposite
+
+
+uint32_t
+BucketInternTable::GetHash(
+    BucketId_t Id) const
+{
+    const Entry * entry;
+
+    entry=(0<Id && Id<=m_MaxBuckets) ? m_Entries[Id] : NULL;
+
+    return(NULL!=entry ? entry->m_Hash : 0);
+
+}   // BucketInternTable::GetHash
+
+
+/**
+ * Created on first use.  Construction is a few allocations with no
+ *  locks taken, so a racing loser simply discards its copy.
+ */
+BucketInternTable &
+BucketInternTable::Global()
+{
+    static BucketInternTable * volatile global=NULL;
+    BucketInternTable * table;
+
+    if (NULL==global)
+    {
+        table=new BucketInternTable(cGlobalBuckets);
+        if (!compare_and_swap(&global, (BucketInternTable *)NULL, table))
+            delete table;
+    }   // if
+
+    return(*global);
+
+}   // BucketInternTable::Global
+
+
+bool
+KeyGetBucketId(
+    const Slice & Key,
+    BucketId_t & Id,
+    Slice & CompositeBucket)
+{
+    bool ret_flag;
+
+    Id=0;
+    ret_flag=KeyGetBucket(Key, CompositeBucket);
+    if (ret_flag)
+        Id=BucketInternTable::Global().Intern(CompositeBucket);
+
+    return(ret_flag);
+
+}   // KeyGetBucketId
+
+}  // namespace leveldb
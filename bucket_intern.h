@@ -0,0 +1,118 @@
+// -------------------------------------------------------------------
+//
+// bucket_intern.h
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#ifndef BUCKET_INTERN_H
+#define BUCKET_INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "leveldb/slice.h"
+
+
+namespace leveldb
+{
+    // small integer naming one composite bucket, 0 is "no ID"
+    typedef uint32_t BucketId_t;
+
+
+    /**
+     * Maps composite buckets (KeyGetBucket() output) to small
+     *  integer IDs, so per bucket state can be kept in arrays
+     *  sorted or compared by a fixed size ID instead of by variable
+     *  length sext bytes.  Not a hashing saving:  Intern() itself
+     *  hashes and compares the composite, costing about as much as
+     *  KeyGetBucket() again.  It pays where the ID replaces a
+     *  property cache lookup (hash, shard mutex, refcount pair).
+     *
+     *  Lock free:  an open addressed table of entry pointers that
+     *  are only ever set once, by compare and swap.  Entries are
+     *  never removed, so a reader never sees one go away.  Riak
+     *  clusters have hundreds of buckets, not millions; once
+     *  MaxBuckets IDs are handed out Intern() returns 0 and callers
+     *  fall back to the composite bytes.  An ID is reserved only
+     *  by the thread whose entry won the slot, so racing threads
+     *  never waste IDs; they wait the few instructions until the
+     *  winner's ID is set.
+     */
+    class BucketInternTable
+    {
+    public:
+        explicit BucketInternTable(size_t MaxBuckets);
+
+        ~BucketInternTable();
+
+        // existing or new ID, 0 if Composite empty or table full
+        BucketId_t Intern(const Slice & Composite);
+
+        // existing ID, 0 if not interned (or Intern() not yet done)
+        BucketId_t Find(const Slice & Composite) const;
+
+        // empty / 0 for an unknown ID
+        Slice GetComposite(BucketId_t Id) const;
+        uint32_t GetHash(BucketId_t Id) const;
+
+        size_t GetMaxBuckets() const {return(m_MaxBuckets);};
+
+        // same hash leveldb's Cache uses for its keys
+        static uint32_t HashComposite(const Slice & Composite);
+
+        // process wide table, never deleted
+        static BucketInternTable & Global();
+
+    protected:
+        struct Entry
+        {
+            uint32_t m_Hash;
+            volatile BucketId_t m_Id;  // cPendingId until slot winner reserves
+            size_t m_Length;
+            char m_Bytes[1];      // m_Length bytes, allocated with entry
+        };
+
+        Entry * volatile * m_Slots;    // power of two, at least 2x MaxBuckets
+        Entry * volatile * m_Entries;  // by ID, [0] unused
+        size_t m_SlotMask;
+        size_t m_MaxBuckets;
+        volatile uint32_t m_LastId;    // IDs reserved so far
+
+        // Entry::m_Id while the winning thread reserves an ID, and
+        //  when the table filled before it could
+        static const BucketId_t cPendingId=0;
+        static const BucketId_t cFullId=~(BucketId_t)0;
+
+        const Entry * FindEntry(const Slice & Composite, uint32_t Hash, size_t & Slot) const;
+
+    private:
+        BucketInternTable();
+        BucketInternTable(const BucketInternTable &);
+        BucketInternTable & operator=(const BucketInternTable &);
+
+    };  // class BucketInternTable
+
+
+    // KeyGetBucket() then BucketInternTable::Global().Intern()
+    bool KeyGetBucketId(const Slice & Key, BucketId_t & Id, Slice & CompositeBucket);
+
+}  // namespace leveldb
+
+
+#endif  // ifndef BUCKET_INTERN_H
@@ -0,0 +1,239 @@
+// -------------------------------------------------------------------
+//
+// bucket_intern_test.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+#include "leveldb/atomics.h"
+#include "port/port.h"
+#include "leveldb_ee/bucket_intern.h"
+#include "leveldb_ee/riak_object.h"
+
+/**
+ * Execution routine
+ */
+int main(int argc, char** argv)
+{
+    return leveldb::test::RunAllTests();
+}
+
+
+namespace leveldb {
+
+
+/**
+ * Wrapper class for tests.  Holds working variables
+ * and helper functions.
+ */
+class BucketInternTester
+{
+public:
+    BucketInternTester()
+        : m_Table(NULL), m_Ready(NULL)
+    {
+    };
+
+    ~BucketInternTester()
+    {
+    };
+
+    // composite bucket of bucket number Bucket, typed when Bucket is odd
+    void BuildComposite(int Bucket, std::string & Composite)
+    {
+        std::string key;
+        Slice composite;
+        char name[32];
+
+        snprintf(name, sizeof(name), "bucket%d", Bucket);
+        ASSERT_TRUE(BuildRiakKey(0!=(Bucket & 1) ? "type1" : NULL, name, "key", key));
+        ASSERT_TRUE(KeyGetBucket(key, composite));
+        Composite=composite.ToString();
+    };
+
+    // pthread_create entry:  interns every bucket, records IDs
+    static void * InternThread(void * Arg)
+    {
+        BucketInternTester * tester;
+        std::string composite;
+        int loop;
+
+        tester=(BucketInternTester *)Arg;
+
+        // all threads start together to race on each bucket
+        add_and_fetch(tester->m_Ready, 1);
+        while (0!=*tester->m_Ready % kThreadCount)
+        {}
+
+        for (loop=0; loop<kThreadBuckets; ++loop)
+        {
+            tester->BuildComposite(loop, composite);
+            tester->m_Ids[loop]=tester->m_Table->Intern(composite);
+        }   // for
+
+        return(NULL);
+    };
+
+    static const int kThreadBuckets=500;
+    static const int kThreadCount=8;
+
+    BucketInternTable * m_Table;
+    volatile int * m_Ready;
+    BucketId_t m_Ids[kThreadBuckets];
+
+};  // class BucketInternTester
+
+
+/**
+ * IDs are stable, distinct, and map back to bucket and hash
+ */
+TEST(BucketInternTester, InternTest)
+{
+    BucketInternTable table(4);
+    std::string composite[6];
+    BucketId_t id[6];
+    int loop;
+
+    for (loop=0; loop<6; ++loop)
+        BuildComposite(loop, composite[loop]);
+
+    ASSERT_EQ(0, table.Find(composite[0]));
+    ASSERT_EQ(0, table.Intern(Slice()));
+
+    for (loop=0; loop<4; ++loop)
+    {
+        id[loop]=table.Intern(composite[loop]);
+        ASSERT_TRUE(0!=id[loop]);
+        ASSERT_EQ(id[loop], table.Intern(composite[loop]));
+        ASSERT_EQ(id[loop], table.Find(composite[loop]));
+        ASSERT_TRUE(table.GetComposite(id[loop])==composite[loop]);
+        ASSERT_EQ(BucketInternTable::HashComposite(composite[loop]), table.GetHash(id[loop]));
+        if (0!=loop)
+            ASSERT_TRUE(id[loop-1]!=id[loop]);
+    }   // for
+
+    // full:  new buckets get no ID, old ones keep theirs
+    ASSERT_EQ(0, table.Intern(composite[4]));
+    ASSERT_EQ(0, table.Intern(composite[5]));
+    ASSERT_EQ(0, table.Find(composite[4]));
+    ASSERT_EQ(id[2], table.Intern(composite[2]));
+
+    ASSERT_EQ(0, table.GetComposite(0).size());
+    ASSERT_EQ(0, table.GetComposite(99).size());
+    ASSERT_EQ(0, table.GetHash(99));
+
+}   // InternTest
+
+
+/**
+ * Threads adding the same buckets at once all agree on every ID.
+ *  The table holds exactly the buckets added, so an ID wasted by a
+ *  lost race would leave some bucket without one.
+ */
+TEST(BucketInternTester, ThreadTest)
+{
+    const int thread_count=kThreadCount, rounds=20;
+    BucketInternTester testers[thread_count];
+    pthread_t threads[thread_count];
+    volatile int ready(0);
+    std::string composite;
+    std::vector<bool> seen;
+    int loop, bucket, round;
+
+    for (round=0; round<rounds; ++round)
+    {
+        BucketInternTable table(kThreadBuckets);
+
+        for (loop=0; loop<thread_count; ++loop)
+        {
+            testers[loop].m_Table=&table;
+            testers[loop].m_Ready=&ready;
+            ASSERT_EQ(0, pthread_create(&threads[loop], NULL, &InternThread, &testers[loop]));
+        }   // for
+
+        for (loop=0; loop<thread_count; ++loop)
+            pthread_join(threads[loop], NULL);
+
+        seen.assign(kThreadBuckets + 1, false);
+        for (bucket=0; bucket<kThreadBuckets; ++bucket)
+        {
+            BuildComposite(bucket, composite);
+            ASSERT_TRUE(0!=testers[0].m_Ids[bucket]);
+            ASSERT_TRUE(testers[0].m_Ids[bucket]<=(BucketId_t)kThreadBuckets);
+            ASSERT_FALSE(seen[testers[0].m_Ids[bucket]]);
+            seen[testers[0].m_Ids[bucket]]=true;
+            ASSERT_EQ(testers[0].m_Ids[bucket], table.Find(composite));
+            ASSERT_TRUE(table.GetComposite(testers[0].m_Ids[bucket])==composite);
+
+            for (loop=1; loop<thread_count; ++loop)
+                ASSERT_EQ(testers[0].m_Ids[bucket], testers[loop].m_Ids[bucket]);
+        }   // for
+    }   // for
+
+}   // ThreadTest
+
+
+/**
+ * Not a pass/fail test.  Reports cost of finding an existing
+ *  bucket's ID from a key, against decode alone.
+ */
+TEST(BucketInternTester, InternSpeed)
+{
+    const int iterations=1000000;
+    std::string keys[2];
+    Slice composite;
+    BucketId_t id;
+    int loop, pass;
+    uint64_t start, decode_micros, intern_micros;
+
+    ASSERT_TRUE(BuildRiakKey(NULL, "customer_sessions", "key_000123", keys[0]));
+    ASSERT_TRUE(BuildRiakKey("time_series_table", "customer_sessions_2016",
+                             "key_000123", keys[1]));
+
+    for (pass=0; pass<2; ++pass)
+    {
+        ASSERT_TRUE(KeyGetBucketId(keys[pass], id, composite));
+        ASSERT_TRUE(0!=id);
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            KeyGetBucket(keys[pass], composite);
+        decode_micros=port::TimeMicros() - start;
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            KeyGetBucketId(keys[pass], id, composite);
+        intern_micros=port::TimeMicros() - start;
+
+        fprintf(stderr, "key %2d bytes: KeyGetBucket %5.1f ns, KeyGetBucketId %5.1f ns\n",
+                (int)keys[pass].size(),
+                (double)decode_micros * 1000.0 / iterations,
+                (double)intern_micros * 1000.0 / iterations);
+    }   // for
+
+}   // InternSpeed
+
+}  // namespace leveldb
@@ -0,0 +1,831 @@
+// -------------------------------------------------------------------
+//
+// bucket_stats.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#include <math.h>
+#include <stdio.h>
+
+#include "db/dbformat.h"
+#include "leveldb_ee/bucket_stats.h"
+#include "leveldb_ee/sext.h"
+#include "util/coding.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+// first byte of encoded block, bump if layout changes
+//  version 2 adds HyperLogLog sketch per bucket
+//  version 3 adds sibling histogram and explosions per bucket
+//  version 4 adds value size histogram per bucket
+static const uint32_t cBucketStatsVersion=4;
+
+// sketch encodings
+static const uint8_t cSketchSparse=0;
+static const uint8_t cSketchDense=1;
+
+
+/**
+ * 64 bit FNV-1a followed by the murmur3 finalizer.  FNV alone
+ *  mixes the high bits poorly, and those bits pick the register.
+ */
+static uint64_t
+HashKey64(
+    const Slice & Key)
+{
+    uint64_t hash;
+    const uint8_t * cursor, * limit;
+
+    hash=0xcbf29ce484222325ULL;
+    cursor=(const uint8_t *)Key.data();
+    limit=cursor + Key.size();
+
+    for (; cursor<limit; ++cursor)
+    {
+        hash^=*cursor;
+        hash*=0x100000001b3ULL;
+    }   // for
+
+    hash^=hash >> 33;
+    hash*=0xff51afd7ed558ccdULL;
+    hash^=hash >> 33;
+    hash*=0xc4ceb9fe1a85ec53ULL;
+    hash^=hash >> 33;
+
+    return(hash);
+
+}   // HashKey64
+
+
+void
+HyperLogLog::AddKey(
+    const Slice & Key)
+{
+    uint64_t hash, remain;
+    uint8_t rank;
+    size_t index;
+
+    hash=HashKey64(Key);
+    index=(size_t)(hash >> (64 - kIndexBits));
+
+    // guard bit caps rank at 64-kIndexBits+1
+    remain=(hash << kIndexBits) | (1ULL << (kIndexBits-1));
+    for (rank=1; 0==(remain & 0x8000000000000000ULL); ++rank)
+        remain<<=1;
+
+    if (m_Registers[index]<rank)
+        m_Registers[index]=rank;
+
+}   // HyperLogLog::AddKey
+
+
+void
+HyperLogLog::Merge(
+    const HyperLogLog & Other)
+{
+    size_t loop;
+
+    for (loop=0; loop<kRegisters; ++loop)
+    {
+        if (m_Registers[loop]<Other.m_Registers[loop])
+            m_Registers[loop]=Other.m_Registers[loop];
+    }   // for
+
+}   // HyperLogLog::Merge
+
+
+/**
+ * Standard HyperLogLog estimate with linear counting for
+ *  small cardinalities.  64 bit hash makes large range
+ *  correction unnecessary.
+ */
+uint64_t
+HyperLogLog::Estimate() const
+{
+    double sum, estimate;
+    size_t loop, zeros;
+
+    sum=0.0;
+    zeros=0;
+    for (loop=0; loop<kRegisters; ++loop)
+    {
+        sum+=ldexp(1.0, -(int)m_Registers[loop]);
+        if (0==m_Registers[loop])
+            ++zeros;
+    }   // for
+
+    estimate=(0.7213 / (1.0 + 1.079 / kRegisters)) * kRegisters * kRegisters / sum;
+
+    if (estimate<=2.5*kRegisters && 0!=zeros)
+        estimate=kRegisters * log((double)kRegisters / (double)zeros);
+
+    return((uint64_t)(estimate + 0.5));
+
+}   // HyperLogLog::Estimate
+
+
+bool
+HyperLogLog::IsEmpty() const
+{
+    size_t loop;
+    bool ret_flag;
+
+    ret_flag=true;
+    for (loop=0; loop<kRegisters && ret_flag; ++loop)
+        ret_flag=(0==m_Registers[loop]);
+
+    return(ret_flag);
+
+}   // HyperLogLog::IsEmpty
+
+
+/**
+ * Sparse: count, then index delta and rank per non-zero register.
+ *  Dense: every register.  Most buckets within one table hold
+ *  few keys, so sparse keeps the block small.
+ */
+void
+HyperLogLog::EncodeTo(
+    std::string & Output) const
+{
+    size_t loop, used, prev;
+
+    used=0;
+    for (loop=0; loop<kRegisters; ++loop)
+    {
+        if (0!=m_Registers[loop])
+            ++used;
+    }   // for
+
+    // sparse entry is two bytes or more
+    if (used*2 < kRegisters)
+    {
+        Output.push_back((char)cSketchSparse);
+        PutVarint32(&Output, used);
+
+        prev=0;
+        for (loop=0; loop<kRegisters; ++loop)
+        {
+            if (0!=m_Registers[loop])
+            {
+                PutVarint32(&Output, loop-prev);
+                Output.push_back((char)m_Registers[loop]);
+                prev=loop;
+            }   // if
+        }   // for
+    }   // if
+    else
+    {
+        Output.push_back((char)cSketchDense);
+        Output.append((const char *)m_Registers, kRegisters);
+    }   // else
+
+}   // HyperLogLog::EncodeTo
+
+
+/**
+ * Replaces current registers.  Input advanced past sketch.
+ */
+bool
+HyperLogLog::DecodeFrom(
+    Slice & Input)
+{
+    bool good;
+    uint8_t format;
+    uint32_t used, delta, loop;
+    size_t index;
+
+    Clear();
+    good=(0<Input.size());
+
+    if (good)
+    {
+        format=(uint8_t)Input[0];
+        Input.remove_prefix(1);
+
+        if (cSketchSparse==format)
+        {
+            good=GetVarint32(&Input, &used) && used<=kRegisters;
+
+            for (index=0, loop=0; good && loop<used; ++loop)
+            {
+                good=GetVarint32(&Input, &delta) && 0<Input.size();
+                index+=delta;
+                good=good && index<kRegisters;
+                if (good)
+                {
+                    m_Registers[index]=(uint8_t)Input[0];
+                    Input.remove_prefix(1);
+                }   // if
+            }   // for
+        }   // if
+        else if (cSketchDense==format && kRegisters<=Input.size())
+        {
+            memcpy(m_Registers, Input.data(), kRegisters);
+            Input.remove_prefix(kRegisters);
+        }   // else if
+        else
+        {
+            good=false;
+        }   // else
+    }   // if
+
+    return(good);
+
+}   // HyperLogLog::DecodeFrom
+
+
+void
+BucketStats::Add(
+    const BucketStats & Other)
+{
+    std::vector<BucketExplosion>::const_iterator it;
+    int loop;
+
+    m_Keys+=Other.m_Keys;
+    m_KeyBytes+=Other.m_KeyBytes;
+    m_ValueBytes+=Other.m_ValueBytes;
+    m_Siblings+=Other.m_Siblings;
+    m_Tombstones+=Other.m_Tombstones;
+    m_DistinctKeys.Merge(Other.m_DistinctKeys);
+
+    for (loop=0; loop<kSiblingHistogram; ++loop)
+        m_SiblingHistogram[loop]+=Other.m_SiblingHistogram[loop];
+
+    for (it=Other.m_Explosions.begin(); Other.m_Explosions.end()!=it; ++it)
+        AddExplosion(*it);
+
+    for (loop=0; loop<kValueSizeHistogram; ++loop)
+    {
+        m_ValueSizeCounts[loop]+=Other.m_ValueSizeCounts[loop];
+        m_ValueSizeBytes[loop]+=Other.m_ValueSizeBytes[loop];
+    }   // for
+
+}   // BucketStats::Add
+
+
+int
+BucketStats::ValueSizeIndex(
+    uint64_t ValueBytes)
+{
+    int index;
+
+    for (index=0; ValueSizeLow(index+1)<=ValueBytes && index<kValueSizeHistogram-1; ++index)
+    {}
+
+    return(index);
+
+}   // BucketStats::ValueSizeIndex
+
+
+void
+BucketStats::AddObject(
+    const Slice & Key,
+    uint64_t Siblings,
+    uint64_t ValueBytes)
+{
+    int index;
+    uint64_t remain;
+
+    for (index=0, remain=Siblings; 1<remain && index<kSiblingHistogram-1; remain>>=1)
+        ++index;
+
+    if (0!=Siblings)
+        ++m_SiblingHistogram[index];
+
+    if (kExplosionSiblings<=Siblings)
+    {
+        BucketExplosion explosion;
+
+        explosion.m_Key.assign(Key.data(), Key.size());
+        explosion.m_Siblings=Siblings;
+        explosion.m_ValueBytes=ValueBytes;
+        AddExplosion(explosion);
+    }   // if
+
+}   // BucketStats::AddObject
+
+
+/**
+ * Keep the worst kMaxExplosions objects, worst first.  A key seen
+ *  again (older versions in other levels) keeps its worst version.
+ */
+void
+BucketStats::AddExplosion(
+    const BucketExplosion & Explosion)
+{
+    std::vector<BucketExplosion>::iterator it;
+
+    for (it=m_Explosions.begin(); m_Explosions.end()!=it && it->m_Key!=Explosion.m_Key; ++it)
+    {}
+
+    if (m_Explosions.end()!=it)
+    {
+        if (!Explosion.IsWorseThan(*it))
+            return;
+        m_Explosions.erase(it);
+    }   // if
+
+    for (it=m_Explosions.begin();
+         m_Explosions.end()!=it && !Explosion.IsWorseThan(*it); ++it)
+    {}
+
+    if (m_Explosions.size()<kMaxExplosions || m_Explosions.end()!=it)
+    {
+        m_Explosions.insert(it, Explosion);
+        if (kMaxExplosions<m_Explosions.size())
+            m_Explosions.pop_back();
+    }   // if
+
+}   // BucketStats::AddExplosion
+
+
+BucketStatsCollector::BucketStatsCollector()
+{
+    m_Last=m_Buckets.end();
+
+}   // BucketStatsCollector::BucketStatsCollector
+
+
+/**
+ * Locate or create the stats for one composite bucket.  Checks
+ *  the prior bucket first since table building sees sorted keys.
+ */
+BucketStats &
+BucketStatsCollector::FindBucket(
+    const Slice & Composite)
+{
+    if (m_Buckets.end()==m_Last
+        || Composite!=Slice(m_Last->first))
+    {
+        std::string composite(Composite.data(), Composite.size());
+
+        m_Last=m_Buckets.insert(BucketMap_t::value_type(composite, BucketStats())).first;
+    }   // if
+
+    return(m_Last->second);
+
+}   // BucketStatsCollector::FindBucket
+
+
+/**
+ * Account for one internal key and its value.  Riak objects add their
+ *  sibling count, and count as a tombstone when all siblings are deleted.
+ *  leveldb deletion markers also count as tombstones.  2i entries count
+ *  toward their bucket's keys and bytes only.
+ */
+void
+BucketStatsCollector::Add(
+    const Slice & Key,
+    const Slice & Value)
+{
+    Slice composite;
+    ValueType type;
+
+    // non-Riak keys land in "" bucket
+    KeyGetBucket(Key, composite);
+    BucketStats & stats(FindBucket(composite));
+
+    ++stats.m_Keys;
+    stats.m_KeyBytes+=Key.size();
+    stats.m_ValueBytes+=Value.size();
+
+    type=(8<=Key.size() ? ExtractValueType(Key) : kTypeValue);
+
+    // deletes have no value
+    if (kTypeDeletion!=type)
+        stats.AddValueSize(Value.size());
+
+    if (kTypeDeletion==type)
+    {
+        ++stats.m_Tombstones;
+    }   // if
+
+    // 2i entries use space but are not objects
+    else if (!KeyIsRiakIndex(Key))
+    {
+        stats.m_DistinctKeys.AddKey(8<=Key.size() ? ExtractUserKey(Key) : Key);
+
+        if (m_View.Parse(Value))
+        {
+            stats.m_Siblings+=m_View.GetSiblingCount();
+            if (m_View.IsAllDeleted())
+                ++stats.m_Tombstones;
+            stats.AddObject(8<=Key.size() ? ExtractUserKey(Key) : Key,
+                            m_View.GetSiblingCount(), Value.size());
+        }   // if
+    }   // else if
+
+}   // BucketStatsCollector::Add
+
+
+/**
+ * Block layout, all integers varint:
+ *  version, bucket count, then per bucket:
+ *  composite length, composite bytes, keys, key bytes,
+ *  value bytes, siblings, tombstones, sketch (version 2),
+ *  kSiblingHistogram counts, explosion count, then per
+ *  explosion:  key length, key bytes, siblings, value bytes
+ *  (version 3), count of non-empty value size ranges, then per
+ *  range:  index, values, bytes (version 4)
+ */
+void
+BucketStatsCollector::EncodeTo(
+    std::string & Output) const
+{
+    BucketMap_t::const_iterator it;
+    std::vector<BucketExplosion>::const_iterator explosion;
+    int loop;
+    uint32_t used;
+
+    PutVarint32(&Output, cBucketStatsVersion);
+    PutVarint64(&Output, m_Buckets.size());
+
+    for (it=m_Buckets.begin(); m_Buckets.end()!=it; ++it)
+    {
+        PutLengthPrefixedSlice(&Output, it->first);
+        PutVarint64(&Output, it->second.m_Keys);
+        PutVarint64(&Output, it->second.m_KeyBytes);
+        PutVarint64(&Output, it->second.m_ValueBytes);
+        PutVarint64(&Output, it->second.m_Siblings);
+        PutVarint64(&Output, it->second.m_Tombstones);
+        it->second.m_DistinctKeys.EncodeTo(Output);
+
+        for (loop=0; loop<BucketStats::kSiblingHistogram; ++loop)
+            PutVarint64(&Output, it->second.m_SiblingHistogram[loop]);
+
+        PutVarint64(&Output, it->second.m_Explosions.size());
+        for (explosion=it->second.m_Explosions.begin();
+             it->second.m_Explosions.end()!=explosion; ++explosion)
+        {
+            PutLengthPrefixedSlice(&Output, explosion->m_Key);
+            PutVarint64(&Output, explosion->m_Siblings);
+            PutVarint64(&Output, explosion->m_ValueBytes);
+        }   // for
+
+        // most buckets use few ranges
+        for (used=0, loop=0; loop<BucketStats::kValueSizeHistogram; ++loop)
+            used+=(0!=it->second.m_ValueSizeCounts[loop] ? 1 : 0);
+
+        PutVarint32(&Output, used);
+        for (loop=0; loop<BucketStats::kValueSizeHistogram; ++loop)
+        {
+            if (0!=it->second.m_ValueSizeCounts[loop])
+            {
+                PutVarint32(&Output, loop);
+                PutVarint64(&Output, it->second.m_ValueSizeCounts[loop]);
+                PutVarint64(&Output, it->second.m_ValueSizeBytes[loop]);
+            }   // if
+        }   // for
+    }   // for
+
+}   // BucketStatsCollector::EncodeTo
+
+
+/**
+ * Decode one table's block into this collector.  Entire block is
+ *  validated before any counts are added, so a corrupt block leaves
+ *  the aggregate untouched.
+ */
+bool
+BucketStatsCollector::MergeFrom(
+    const Slice & Block)
+{
+    bool good;
+    Slice input(Block), composite, key;
+    uint32_t version, used, range;
+    uint64_t count, loop, explosions, index;
+    int bin;
+    BucketStatsCollector temp;
+
+    // version 1 blocks lack sketch, versions 1 and 2 lack
+    //  histogram and explosions, 1 to 3 lack value sizes
+    good=GetVarint32(&input, &version)
+        && 1<=version && version<=cBucketStatsVersion
+        && GetVarint64(&input, &count);
+
+    for (loop=0; good && loop<count; ++loop)
+    {
+        BucketStats stats;
+
+        good=GetLengthPrefixedSlice(&input, &composite)
+            && GetVarint64(&input, &stats.m_Keys)
+            && GetVarint64(&input, &stats.m_KeyBytes)
+            && GetVarint64(&input, &stats.m_ValueBytes)
+            && GetVarint64(&input, &stats.m_Siblings)
+            && GetVarint64(&input, &stats.m_Tombstones)
+            && (1==version || stats.m_DistinctKeys.DecodeFrom(input));
+
+        for (bin=0; good && 3<=version && bin<BucketStats::kSiblingHistogram; ++bin)
+            good=GetVarint64(&input, &stats.m_SiblingHistogram[bin]);
+
+        explosions=0;
+        good=good && (version<3 || GetVarint64(&input, &explosions));
+        for (index=0; good && index<explosions; ++index)
+        {
+            BucketExplosion explosion;
+
+            good=GetLengthPrefixedSlice(&input, &key)
+                && GetVarint64(&input, &explosion.m_Siblings)
+                && GetVarint64(&input, &explosion.m_ValueBytes);
+
+            if (good)
+            {
+                explosion.m_Key=key.ToString();
+                stats.m_Explosions.push_back(explosion);
+            }   // if
+        }   // for
+
+        used=0;
+        good=good && (version<4 || GetVarint32(&input, &used));
+        for (index=0; good && index<used; ++index)
+        {
+            good=GetVarint32(&input, &range)
+                && range<(uint32_t)BucketStats::kValueSizeHistogram
+                && GetVarint64(&input, &stats.m_ValueSizeCounts[range])
+                && GetVarint64(&input, &stats.m_ValueSizeBytes[range]);
+        }   // for
+
+        if (good)
+            temp.FindBucket(composite).Add(stats);
+    }   // for
+
+    good=good && 0==input.size();
+
+    if (good)
+        Merge(temp);
+
+    return(good);
+
+}   // BucketStatsCollector::MergeFrom
+
+
+void
+BucketStatsCollector::Merge(
+    const BucketStatsCollector & Other)
+{
+    BucketMap_t::const_iterator it;
+
+    for (it=Other.m_Buckets.begin(); Other.m_Buckets.end()!=it; ++it)
+        FindBucket(it->first).Add(it->second);
+
+}   // BucketStatsCollector::Merge
+
+
+void
+BucketStatsCollector::Clear()
+{
+    m_Buckets.clear();
+    m_Last=m_Buckets.end();
+    m_View.Clear();
+
+}   // BucketStatsCollector::Clear
+
+
+bool
+BucketStatsCollector::GetBucket(
+    const Slice & Composite,
+    BucketStats & Stats) const
+{
+    BucketMap_t::const_iterator it;
+    bool ret_flag;
+
+    it=m_Buckets.find(Composite.ToString());
+    ret_flag=(m_Buckets.end()!=it);
+
+    if (ret_flag)
+        Stats=it->second;
+
+    return(ret_flag);
+
+}   // BucketStatsCollector::GetBucket
+
+
+void
+BucketStatsCollector::GetTotal(
+    BucketStats & Stats) const
+{
+    BucketMap_t::const_iterator it;
+
+    Stats=BucketStats();
+    for (it=m_Buckets.begin(); m_Buckets.end()!=it; ++it)
+        Stats.Add(it->second);
+
+}   // BucketStatsCollector::GetTotal
+
+
+/**
+ * Riak key name of a user key, escaped for text output.  Whole
+ *  key escaped if not a Riak object key.
+ */
+static std::string
+RiakKeyName(
+    const Slice & UserKey)
+{
+    SextReader reader(UserKey);
+    std::string name;
+    uint32_t arity;
+    size_t length;
+    bool good;
+
+    good=reader.GetTuple(arity) && 3==arity
+        && reader.Skip() && reader.Skip()
+        && reader.GetBinaryLength(length);
+
+    if (good)
+    {
+        name.resize(length);
+        good=reader.GetBinary((char *)name.data(), name.size(), length);
+    }   // if
+
+    return(EscapeString(good ? Slice(name) : UserKey));
+
+}   // RiakKeyName
+
+
+/**
+ * " value_size_histogram=low:count/bytes,..." for each non-empty range
+ */
+static void
+AppendValueSizes(
+    const BucketStats & Stats,
+    std::string & Output)
+{
+    char buffer[80];
+    const char * separator;
+    int loop;
+
+    separator=" value_size_histogram=";
+    for (loop=0; loop<BucketStats::kValueSizeHistogram; ++loop)
+    {
+        if (0!=Stats.m_ValueSizeCounts[loop])
+        {
+            snprintf(buffer, sizeof(buffer), "%s%llu:%llu/%llu", separator,
+                     (unsigned long long)BucketStats::ValueSizeLow(loop),
+                     (unsigned long long)Stats.m_ValueSizeCounts[loop],
+                     (unsigned long long)Stats.m_ValueSizeBytes[loop]);
+            Output.append(buffer);
+            separator=",";
+        }   // if
+    }   // for
+
+}   // AppendValueSizes
+
+
+/**
+ * Text for a DB property, one line per bucket:
+ *  "type/bucket keys key_bytes value_bytes siblings tombstones distinct
+ *   sibling_histogram value_size_histogram"
+ *  where sibling_histogram lists "low:objects" for each non-empty
+ *  log2 range of sibling counts, and value_size_histogram lists
+ *  "low:values/bytes".  Then one indented line per sibling
+ *  explosion, worst first.
+ */
+void
+BucketStatsCollector::AppendToString(
+    std::string & Output) const
+{
+    BucketMap_t::const_iterator it;
+    std::vector<BucketExplosion>::const_iterator explosion;
+    std::string type, bucket;
+    char buffer[160];
+    const char * separator;
+    int loop;
+
+    for (it=m_Buckets.begin(); m_Buckets.end()!=it; ++it)
+    {
+        if (!it->first.empty())
+        {
+            KeyParseBucket(it->first, type, bucket);
+            Output.append(type);
+            Output.append("/");
+            Output.append(bucket);
+        }   // if
+        else
+        {
+            Output.append("(none)");
+        }   // else
+
+        snprintf(buffer, sizeof(buffer), " keys=%llu key_bytes=%llu value_bytes=%llu"
+                 " siblings=%llu tombstones=%llu distinct=%llu",
+                 (unsigned long long)it->second.m_Keys,
+                 (unsigned long long)it->second.m_KeyBytes,
+                 (unsigned long long)it->second.m_ValueBytes,
+                 (unsigned long long)it->second.m_Siblings,
+                 (unsigned long long)it->second.m_Tombstones,
+                 (unsigned long long)it->second.m_DistinctKeys.Estimate());
+        Output.append(buffer);
+
+        separator=" sibling_histogram=";
+        for (loop=0; loop<BucketStats::kSiblingHistogram; ++loop)
+        {
+            if (0!=it->second.m_SiblingHistogram[loop])
+            {
+                snprintf(buffer, sizeof(buffer), "%s%llu:%llu", separator,
+                         1ULL << loop,
+                         (unsigned long long)it->second.m_SiblingHistogram[loop]);
+                Output.append(buffer);
+                separator=",";
+            }   // if
+        }   // for
+        AppendValueSizes(it->second, Output);
+        Output.append("\n");
+
+        for (explosion=it->second.m_Explosions.begin();
+             it->second.m_Explosions.end()!=explosion; ++explosion)
+        {
+            Output.append("  explosion key=");
+            Output.append(RiakKeyName(explosion->m_Key));
+            snprintf(buffer, sizeof(buffer), " siblings=%llu value_bytes=%llu\n",
+                     (unsigned long long)explosion->m_Siblings,
+                     (unsigned long long)explosion->m_ValueBytes);
+            Output.append(buffer);
+        }   // for
+    }   // for
+
+}   // BucketStatsCollector::AppendToString
+
+
+bool
+BucketStatsByLevel::MergeFrom(
+    int Level,
+    const Slice & Block)
+{
+    bool ret_flag;
+
+    // level's copy validates the block, total then cannot fail
+    ret_flag=(0<=Level && Level<config::kNumLevels)
+        && m_Levels[Level].MergeFrom(Block);
+
+    if (ret_flag)
+        m_Total.MergeFrom(Block);
+
+    return(ret_flag);
+
+}   // BucketStatsByLevel::MergeFrom
+
+
+void
+BucketStatsByLevel::Clear()
+{
+    int level;
+
+    for (level=0; level<config::kNumLevels; ++level)
+        m_Levels[level].Clear();
+    m_Total.Clear();
+
+}   // BucketStatsByLevel::Clear
+
+
+/**
+ * "level N values=count value_bytes=bytes value_size_histogram=..."
+ *  for each level holding any keys, then every bucket across all levels
+ */
+void
+BucketStatsByLevel::AppendToString(
+    std::string & Output) const
+{
+    BucketStats total;
+    uint64_t values;
+    char buffer[80];
+    int level, loop;
+
+    for (level=0; level<config::kNumLevels; ++level)
+    {
+        if (0!=m_Levels[level].GetBucketCount())
+        {
+            m_Levels[level].GetTotal(total);
+            for (values=0, loop=0; loop<BucketStats::kValueSizeHistogram; ++loop)
+                values+=total.m_ValueSizeCounts[loop];
+
+            snprintf(buffer, sizeof(buffer), "level %d values=%llu value_bytes=%llu",
+                     level, (unsigned long long)values,
+                     (unsigned long long)total.m_ValueBytes);
+            Output.append(buffer);
+            AppendValueSizes(total, Output);
+            Output.append("\n");
+        }   // if
+    }   // for
+
+    m_Total.AppendToString(Output);
+
+}   // BucketStatsByLevel::AppendToString
+
+}  // namespace leveldb
@@ -0,0 +1,256 @@
+// -------------------------------------------------------------------
+//
+// bucket_stats.h
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#ifndef BUCKET_STATS_H
+#define BUCKET_STATS_H
+
+#include <map>
+#include <string.h>
+#include <string>
+#include <stdint.h>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/slice.h"
+#include "leveldb_ee/riak_object.h"
+
+
+namespace leveldb
+{
+    /**
+     * HyperLogLog distinct count sketch.  1024 one byte registers
+     *  give roughly 3% standard error.  Sketches from different
+     *  tables merge by register maximum, so a key overwritten in
+     *  several levels is counted once.
+     */
+    class HyperLogLog
+    {
+    public:
+        static const int kIndexBits=10;
+        static const size_t kRegisters=1 << kIndexBits;
+
+        HyperLogLog() {Clear();};
+
+        void Clear() {memset(m_Registers, 0, sizeof(m_Registers));};
+
+        void AddKey(const Slice & Key);
+
+        void Merge(const HyperLogLog & Other);
+
+        uint64_t Estimate() const;
+
+        bool IsEmpty() const;
+
+        // sparse list of non-zero registers when small, else dense
+        void EncodeTo(std::string & Output) const;
+        bool DecodeFrom(Slice & Input);
+
+    protected:
+        uint8_t m_Registers[kRegisters];
+
+    };  // class HyperLogLog
+
+
+    /**
+     * One Riak object with a sibling explosion
+     */
+    struct BucketExplosion
+    {
+        std::string m_Key;         // user key (sext)
+        uint64_t m_Siblings;
+        uint64_t m_ValueBytes;
+
+        BucketExplosion() : m_Siblings(0), m_ValueBytes(0) {};
+
+        // more siblings first, then larger
+        bool IsWorseThan(const BucketExplosion & Other) const
+        {
+            return(Other.m_Siblings<m_Siblings
+                   || (Other.m_Siblings==m_Siblings && Other.m_ValueBytes<m_ValueBytes));
+        };
+    };  // struct BucketExplosion
+
+
+    /**
+     * Space and object counts for one composite bucket
+     */
+    struct BucketStats
+    {
+        // log2 sibling count:  1, 2-3, 4-7, ... 512-1023, 1024+
+        static const int kSiblingHistogram=11;
+
+        // objects with this many siblings are explosions (Riak's
+        //  default warn_siblings), worst kMaxExplosions kept
+        static const uint64_t kExplosionSiblings=25;
+        static const size_t kMaxExplosions=10;
+
+        // value sizes:  0-127 bytes, then one range per power of 2,
+        //  128-255 through 1M-2M, then 2M+
+        static const int kValueSizeHistogram=16;
+
+        uint64_t m_Keys;
+        uint64_t m_KeyBytes;
+        uint64_t m_ValueBytes;
+        uint64_t m_Siblings;       // summed across all Riak objects
+        uint64_t m_Tombstones;     // Riak objects with all siblings deleted
+        HyperLogLog m_DistinctKeys;  // user keys, excluding leveldb deletes
+        uint64_t m_SiblingHistogram[kSiblingHistogram];  // Riak objects
+        std::vector<BucketExplosion> m_Explosions;  // worst first
+        uint64_t m_ValueSizeCounts[kValueSizeHistogram];  // values, not deletes
+        uint64_t m_ValueSizeBytes[kValueSizeHistogram];
+
+        BucketStats() : m_Keys(0), m_KeyBytes(0), m_ValueBytes(0),
+                        m_Siblings(0), m_Tombstones(0)
+        {
+            memset(m_SiblingHistogram, 0, sizeof(m_SiblingHistogram));
+            memset(m_ValueSizeCounts, 0, sizeof(m_ValueSizeCounts));
+            memset(m_ValueSizeBytes, 0, sizeof(m_ValueSizeBytes));
+        };
+
+        void Add(const BucketStats & Other);
+
+        // one Riak object's sibling count, Key is its user key
+        void AddObject(const Slice & Key, uint64_t Siblings, uint64_t ValueBytes);
+
+        void AddValueSize(uint64_t ValueBytes)
+        {
+            int index(ValueSizeIndex(ValueBytes));
+
+            ++m_ValueSizeCounts[index];
+            m_ValueSizeBytes[index]+=ValueBytes;
+        };
+
+        static int ValueSizeIndex(uint64_t ValueBytes);
+
+        // smallest size in histogram range Index
+        static uint64_t ValueSizeLow(int Index) {return(0==Index ? 0 : 64ULL << Index);};
+
+    protected:
+        void AddExplosion(const BucketExplosion & Explosion);
+
+    };  // struct BucketStats
+
+
+    /**
+     * Per bucket statistics for one .sst table, or an aggregate
+     *  of many tables.  Table building feeds every key/value
+     *  through Add(), then writes EncodeTo() output as a meta
+     *  block named by MetaBlockName().  Readers rebuild an
+     *  aggregate by calling MergeFrom() with each table's block.
+     *
+     *  Parent hookup, not in leveldb_ee:  table/table_builder.cc
+     *  TableBuilder::Add() calls Add() beside TableBuilderCallback(),
+     *  and TableBuilder::Finish() writes the meta block.  Until then
+     *  nothing collects these statistics.
+     */
+    class BucketStatsCollector
+    {
+    public:
+        BucketStatsCollector();
+
+        // account for one internal key and its value
+        void Add(const Slice & Key, const Slice & Value);
+
+        // compact block format for table metadata
+        void EncodeTo(std::string & Output) const;
+
+        // add one table's block into this collector, false if corrupt
+        bool MergeFrom(const Slice & Block);
+
+        // add another collector into this one
+        void Merge(const BucketStatsCollector & Other);
+
+        void Clear();
+
+        size_t GetBucketCount() const {return(m_Buckets.size());};
+
+        // false if composite bucket not known.  m_DistinctKeys.Estimate()
+        //  over an aggregate of all current tables approximates the
+        //  bucket's distinct key count.
+        bool GetBucket(const Slice & Composite, BucketStats & Stats) const;
+
+        // sum of every bucket
+        void GetTotal(BucketStats & Stats) const;
+
+        // one text line per bucket, for DB property output
+        void AppendToString(std::string & Output) const;
+
+        // name of meta block within the .sst file
+        static const char * MetaBlockName() {return("riak.bucket_stats");};
+
+    protected:
+        typedef std::map<std::string, BucketStats> BucketMap_t;
+
+        BucketMap_t m_Buckets;       // composite bucket (sext bytes) to stats,
+                                     //  non-Riak keys kept under ""
+        BucketMap_t::iterator m_Last;  // keys arrive sorted, often same bucket as last
+        RiakObjectView m_View;       // reused across values
+
+        BucketStats & FindBucket(const Slice & Composite);
+
+    private:
+        BucketStatsCollector(const BucketStatsCollector &);
+        BucketStatsCollector & operator=(const BucketStatsCollector &);
+
+    };  // class BucketStatsCollector
+
+
+    /**
+     * Aggregate of table blocks kept by level, and across all levels.
+     *  The DB property walks the current version's files and passes
+     *  each table's block with the file's level.
+     *
+     *  Parent hookup, not in leveldb_ee:  db/db_impl.cc
+     *  DBImpl::GetProperty() reads each current file's meta block
+     *  (through TableCache) and calls MergeFrom().
+     */
+    class BucketStatsByLevel
+    {
+    public:
+        BucketStatsByLevel() {};
+
+        // false if Level out of range or block corrupt
+        bool MergeFrom(int Level, const Slice & Block);
+
+        void Clear();
+
+        const BucketStatsCollector & GetLevel(int Level) const {return(m_Levels[Level]);};
+        const BucketStatsCollector & GetTotal() const {return(m_Total);};
+
+        // one value size line per non-empty level, then the
+        //  all level BucketStatsCollector::AppendToString()
+        void AppendToString(std::string & Output) const;
+
+    protected:
+        BucketStatsCollector m_Levels[config::kNumLevels];
+        BucketStatsCollector m_Total;
+
+    private:
+        BucketStatsByLevel(const BucketStatsByLevel &);
+        BucketStatsByLevel & operator=(const BucketStatsByLevel &);
+
+    };  // class BucketStatsByLevel
+
+}  // namespace leveldb
+
+
+#endif  // ifndef BUCKET_STATS_H
@@ -0,0 +1,406 @@
+// -------------------------------------------------------------------
+//
+// bucket_stats_test.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string>
+
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+#include "db/dbformat.h"
+#include "util/coding.h"
+#include "leveldb_ee/bucket_stats.h"
+#include "leveldb_ee/riak_object.h"
+
+/**
+ * Execution routine
+ */
+int main(int argc, char** argv)
+{
+    return leveldb::test::RunAllTests();
+}
+
+
+namespace leveldb {
+
+
+/**
+ * Wrapper class for tests.  Holds working variables
+ * and helper functions.
+ */
+class BucketStatsTester
+{
+public:
+    BucketStatsTester()
+    {
+    };
+
+    ~BucketStatsTester()
+    {
+    };
+
+    // Riak key with internal key suffix
+    void BuildInternalKey(const char * Type, const char * Bucket, const char * Key,
+                          ValueType KeyType, std::string & Output)
+    {
+        ASSERT_TRUE(BuildRiakKey(Type, Bucket, Key, Output));
+        PutFixed64(&Output, (100 << 8) | KeyType);
+    };
+
+};  // class BucketStatsTester
+
+
+/**
+ * Counts land in the proper bucket
+ */
+TEST(BucketStatsTester, AddTest)
+{
+    BucketStatsCollector collector;
+    BucketStats stats;
+    std::string key, object, tombstone;
+    Slice composite;
+    uint64_t key_bytes;
+
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 3, false, object));
+    ASSERT_TRUE(BuildRiakObject("", 1478342700123456ULL, 1, true, tombstone));
+
+    // bucket "buck0": two live objects, one Riak tombstone
+    BuildInternalKey(NULL, "buck0", "key0", kTypeValue, key);
+    collector.Add(key, object);
+    key_bytes=key.size();
+    BuildInternalKey(NULL, "buck0", "key1", kTypeValue, key);
+    collector.Add(key, object);
+    key_bytes+=key.size();
+    BuildInternalKey(NULL, "buck0", "key2", kTypeValue, key);
+    collector.Add(key, tombstone);
+    key_bytes+=key.size();
+
+    // bucket {"type1","buck1"}: one leveldb delete
+    BuildInternalKey("type1", "buck1", "key0", kTypeDeletion, key);
+    collector.Add(key, Slice());
+
+    // not a Riak key
+    key="not a riak key";
+    PutFixed64(&key, (100 << 8) | kTypeValue);
+    collector.Add(key, "junk");
+
+    ASSERT_EQ(3, collector.GetBucketCount());
+
+    BuildInternalKey(NULL, "buck0", "key0", kTypeValue, key);
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(collector.GetBucket(composite, stats));
+    ASSERT_EQ(3, stats.m_Keys);
+    ASSERT_EQ(key_bytes, stats.m_KeyBytes);
+    ASSERT_EQ(2*object.size() + tombstone.size(), stats.m_ValueBytes);
+    ASSERT_EQ(7, stats.m_Siblings);
+    ASSERT_EQ(1, stats.m_Tombstones);
+
+    BuildInternalKey("type1", "buck1", "key0", kTypeDeletion, key);
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(collector.GetBucket(composite, stats));
+    ASSERT_EQ(1, stats.m_Keys);
+    ASSERT_EQ(0, stats.m_ValueBytes);
+    ASSERT_EQ(0, stats.m_Siblings);
+    ASSERT_EQ(1, stats.m_Tombstones);
+
+    ASSERT_TRUE(collector.GetBucket(Slice(), stats));
+    ASSERT_EQ(1, stats.m_Keys);
+    ASSERT_EQ(4, stats.m_ValueBytes);
+    ASSERT_EQ(0, stats.m_Siblings);
+
+}   // AddTest
+
+
+/**
+ * Block round trip, aggregate of several tables, and corrupt blocks
+ */
+TEST(BucketStatsTester, EncodeMergeTest)
+{
+    BucketStatsCollector table, aggregate;
+    BucketStats stats;
+    std::string key, object, block, text;
+    Slice composite;
+    size_t len;
+
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 2, false, object));
+    BuildInternalKey("type1", "buck1", "key0", kTypeValue, key);
+    table.Add(key, object);
+    BuildInternalKey(NULL, "buck2", "key0", kTypeValue, key);
+    table.Add(key, object);
+
+    table.EncodeTo(block);
+
+    // two tables with same contents
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+    ASSERT_EQ(2, aggregate.GetBucketCount());
+
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(aggregate.GetBucket(composite, stats));
+    ASSERT_EQ(2, stats.m_Keys);
+    ASSERT_EQ(2*key.size(), stats.m_KeyBytes);
+    ASSERT_EQ(2*object.size(), stats.m_ValueBytes);
+    ASSERT_EQ(4, stats.m_Siblings);
+    ASSERT_EQ(0, stats.m_Tombstones);
+
+    // every truncation is rejected and leaves aggregate alone
+    for (len=0; len<block.size(); ++len)
+    {
+        ASSERT_FALSE(aggregate.MergeFrom(Slice(block.data(), len)));
+    }   // for
+    ASSERT_TRUE(aggregate.GetBucket(composite, stats));
+    ASSERT_EQ(2, stats.m_Keys);
+
+    // trailing garbage also rejected
+    ASSERT_FALSE(aggregate.MergeFrom(block + "x"));
+
+    aggregate.AppendToString(text);
+    ASSERT_TRUE(std::string::npos!=text.find("type1/buck1 keys=2 "));
+    ASSERT_TRUE(std::string::npos!=text.find("/buck2 keys=2 "));
+
+    aggregate.Clear();
+    ASSERT_EQ(0, aggregate.GetBucketCount());
+
+}   // EncodeMergeTest
+
+
+/**
+ * Distinct key estimate from two overlapping "tables"
+ */
+TEST(BucketStatsTester, DistinctKeysTest)
+{
+    BucketStatsCollector table1, table2, aggregate;
+    BucketStats stats;
+    std::string key, block;
+    Slice composite;
+    char key_name[32];
+    int loop;
+    uint64_t estimate;
+
+    // keys 0..99999 in table1, 50000..149999 in table2 (overwrites)
+    for (loop=0; loop<150000; ++loop)
+    {
+        snprintf(key_name, sizeof(key_name), "key%d", loop);
+        BuildInternalKey(NULL, "buck0", key_name, kTypeValue, key);
+
+        if (loop<100000)
+            table1.Add(key, "value");
+        if (50000<=loop)
+            table2.Add(key, "value");
+    }   // for
+
+    // deletes do not count as keys
+    BuildInternalKey(NULL, "buck0", "deleted", kTypeDeletion, key);
+    table2.Add(key, Slice());
+
+    block.clear();
+    table1.EncodeTo(block);
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+    block.clear();
+    table2.EncodeTo(block);
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(aggregate.GetBucket(composite, stats));
+    ASSERT_EQ(200001, stats.m_Keys);
+
+    // three standard errors
+    estimate=stats.m_DistinctKeys.Estimate();
+    ASSERT_TRUE(140000<estimate && estimate<160000);
+
+    // small counts use linear counting and sparse encoding
+    aggregate.Clear();
+    table1.Clear();
+    for (loop=0; loop<20; ++loop)
+    {
+        snprintf(key_name, sizeof(key_name), "key%d", loop);
+        BuildInternalKey(NULL, "buck0", key_name, kTypeValue, key);
+        table1.Add(key, "value");
+
+        // 2i entries count as keys, not as distinct objects
+        ASSERT_TRUE(BuildRiakIndexKey(NULL, "buck0", "field_bin", "term", key_name, key));
+        PutFixed64(&key, (100 << 8) | kTypeValue);
+        table1.Add(key, Slice());
+    }   // for
+
+    block.clear();
+    table1.EncodeTo(block);
+    ASSERT_TRUE(block.size() < 100);
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+    ASSERT_TRUE(aggregate.GetBucket(composite, stats));
+    ASSERT_EQ(40, stats.m_Keys);
+    estimate=stats.m_DistinctKeys.Estimate();
+    ASSERT_TRUE(19<=estimate && estimate<=21);
+
+}   // DistinctKeysTest
+
+
+/**
+ * Sibling histogram counts every Riak object, explosions keep
+ *  only the worst objects and survive encode / merge
+ */
+TEST(BucketStatsTester, ExplosionTest)
+{
+    BucketStatsCollector table1, table2, aggregate;
+    BucketStats stats;
+    std::string key, object, block, text;
+    Slice composite;
+    char key_name[32];
+    int loop;
+
+    // 100 single sibling objects, 3 with 3 siblings
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 1, false, object));
+    for (loop=0; loop<100; ++loop)
+    {
+        snprintf(key_name, sizeof(key_name), "key%d", loop);
+        BuildInternalKey(NULL, "buck0", key_name, kTypeValue, key);
+        table1.Add(key, object);
+    }   // for
+
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 3, false, object));
+    for (loop=0; loop<3; ++loop)
+    {
+        snprintf(key_name, sizeof(key_name), "three%d", loop);
+        BuildInternalKey(NULL, "buck0", key_name, kTypeValue, key);
+        table1.Add(key, object);
+    }   // for
+
+    // 15 explosions of 30 to 44 siblings, more than are kept
+    for (loop=0; loop<15; ++loop)
+    {
+        ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 30+loop, false, object));
+        snprintf(key_name, sizeof(key_name), "boom%02d", loop);
+        BuildInternalKey(NULL, "buck0", key_name, kTypeValue, key);
+        table1.Add(key, object);
+    }   // for
+
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(table1.GetBucket(composite, stats));
+    ASSERT_EQ(100, stats.m_SiblingHistogram[0]);
+    ASSERT_EQ(3, stats.m_SiblingHistogram[1]);
+    ASSERT_EQ(2, stats.m_SiblingHistogram[4]);     // 30, 31
+    ASSERT_EQ(13, stats.m_SiblingHistogram[5]);    // 32 to 44
+    ASSERT_EQ(10, stats.m_Explosions.size());
+    ASSERT_EQ(44, stats.m_Explosions[0].m_Siblings);
+    ASSERT_EQ(35, stats.m_Explosions[9].m_Siblings);
+
+    // an older version of boom00 in another table is worse yet
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 500, false, object));
+    BuildInternalKey(NULL, "buck0", "boom00", kTypeValue, key);
+    table2.Add(key, object);
+    table2.Add(key, object);
+
+    block.clear();
+    table1.EncodeTo(block);
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+    block.clear();
+    table2.EncodeTo(block);
+    ASSERT_TRUE(aggregate.MergeFrom(block));
+
+    ASSERT_TRUE(aggregate.GetBucket(composite, stats));
+    ASSERT_EQ(2, stats.m_SiblingHistogram[8]);     // 500
+    ASSERT_EQ(10, stats.m_Explosions.size());
+    ASSERT_EQ(500, stats.m_Explosions[0].m_Siblings);
+    ASSERT_TRUE(ExtractUserKey(key)==stats.m_Explosions[0].m_Key);
+    ASSERT_EQ(44, stats.m_Explosions[1].m_Siblings);
+    ASSERT_EQ(36, stats.m_Explosions[9].m_Siblings);
+
+    aggregate.AppendToString(text);
+    ASSERT_TRUE(std::string::npos!=text.find(" sibling_histogram=1:100,2:3,16:2,32:13,256:2"
+                                             " value_size_histogram="));
+    ASSERT_TRUE(std::string::npos!=text.find("\n  explosion key=boom00 siblings=500 value_bytes="));
+
+}   // ExplosionTest
+
+
+/**
+ * Value sizes land in their power of 2 range, per bucket
+ *  and per level
+ */
+TEST(BucketStatsTester, ValueSizeTest)
+{
+    BucketStatsCollector table0, table2;
+    BucketStatsByLevel levels;
+    BucketStats stats;
+    std::string key, block0, block2, text;
+    Slice composite;
+
+    ASSERT_EQ(0, BucketStats::ValueSizeIndex(0));
+    ASSERT_EQ(0, BucketStats::ValueSizeIndex(127));
+    ASSERT_EQ(1, BucketStats::ValueSizeIndex(128));
+    ASSERT_EQ(4, BucketStats::ValueSizeIndex(1024));
+    ASSERT_EQ(4, BucketStats::ValueSizeIndex(2047));
+    ASSERT_EQ(15, BucketStats::ValueSizeIndex(2*1024*1024));
+    ASSERT_EQ(15, BucketStats::ValueSizeIndex(~0ULL));
+
+    // level 0 table:  two small values, one 1K, a delete (not counted)
+    BuildInternalKey(NULL, "buck0", "key0", kTypeValue, key);
+    table0.Add(key, std::string(10, 'v'));
+    BuildInternalKey(NULL, "buck0", "key1", kTypeValue, key);
+    table0.Add(key, std::string(100, 'v'));
+    BuildInternalKey(NULL, "buck0", "key2", kTypeValue, key);
+    table0.Add(key, std::string(1024, 'v'));
+    BuildInternalKey(NULL, "buck0", "key3", kTypeDeletion, key);
+    table0.Add(key, Slice());
+
+    // level 2 table:  one 300K value in another bucket
+    BuildInternalKey("type1", "buck1", "key0", kTypeValue, key);
+    table2.Add(key, std::string(300*1024, 'v'));
+
+    ASSERT_TRUE(KeyGetBucket(key, composite));
+    ASSERT_TRUE(table2.GetBucket(composite, stats));
+    ASSERT_EQ(1, stats.m_ValueSizeCounts[12]);     // 256K to 512K
+    ASSERT_EQ(300*1024, stats.m_ValueSizeBytes[12]);
+
+    table0.EncodeTo(block0);
+    table2.EncodeTo(block2);
+    ASSERT_TRUE(levels.MergeFrom(0, block0));
+    ASSERT_TRUE(levels.MergeFrom(2, block2));
+    ASSERT_TRUE(levels.MergeFrom(2, block2));
+    ASSERT_FALSE(levels.MergeFrom(config::kNumLevels, block2));
+    ASSERT_FALSE(levels.MergeFrom(1, Slice(block2.data(), block2.size()-1)));
+
+    ASSERT_EQ(1, levels.GetLevel(0).GetBucketCount());
+    ASSERT_EQ(0, levels.GetLevel(1).GetBucketCount());
+    ASSERT_EQ(2, levels.GetTotal().GetBucketCount());
+
+    levels.GetLevel(0).GetTotal(stats);
+    ASSERT_EQ(2, stats.m_ValueSizeCounts[0]);
+    ASSERT_EQ(110, stats.m_ValueSizeBytes[0]);
+    ASSERT_EQ(1, stats.m_ValueSizeCounts[4]);
+
+    levels.GetTotal().GetTotal(stats);
+    ASSERT_EQ(2, stats.m_ValueSizeCounts[12]);
+
+    levels.AppendToString(text);
+    ASSERT_TRUE(0==text.find("level 0 values=3 value_bytes=1134"
+                             " value_size_histogram=0:2/110,1024:1/1024\n"
+                             "level 2 values=2 value_bytes=614400"
+                             " value_size_histogram=262144:2/614400\n"));
+    ASSERT_TRUE(std::string::npos!=text.find("type1/buck1 keys=2 "));
+
+    levels.Clear();
+    ASSERT_EQ(0, levels.GetTotal().GetBucketCount());
+
+}   // ValueSizeTest
+
+}  // namespace leveldb
@@ -23,16 +23,24 @@
 #define __STDC_FORMAT_MACROS
 #include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
+#include <vector>
 
 #include "port/port_posix.h"
+#include "leveldb/atomics.h"
 #include "leveldb/perf_count.h"
 #include "leveldb/env.h"
+#include "leveldb/write_batch.h"
 #include "db/dbformat.h"
 #include "db/db_impl.h"
 #include "db/version_set.h"
+#include "db/write_batch_internal.h"
+#include "leveldb_ee/bucket_intern.h"
 #include "leveldb_ee/expiry_ee.h"
 #include "util/prop_cache.h"
 #include "leveldb_ee/riak_object.h"
+#include "leveldb_ee/sext.h"
+#include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
 #include "util/throttle.h"
@@ -41,6 +49,637 @@ namespace leveldb {
 
 static RefPtr<class ExpiryModuleEE> gUserExpirySample;
 
+// bucket cursor statistics, and generation that invalidates all cursors
+static volatile uint64_t gBucketCursorHits(0);
+static volatile uint64_t gBucketCursorMisses(0);
+static volatile uint64_t gBucketCursorGeneration(0);
+
+// how long a thread may reuse one bucket's settings before
+//  going back to the property cache (picks up property changes)
+static const uint64_t kBucketCursorMicros=port::UINT64_ONE_SECOND_MICROS;
+
+// write path bucket snapshot statistics, and generation that
+//  moves each time a new snapshot is published
+static volatile uint64_t gBucketSnapshotHits(0);
+static volatile uint64_t gBucketSnapshotMisses(0);
+static volatile uint64_t gBucketSnapshotGeneration(0);
+
+// moves each time NoteBucketPropertiesChanged() is called.  A writer
+//  whose property cache lookup started before the move may hold the
+//  old settings, and must not publish them.
+static volatile uint64_t gBucketPropertiesGeneration(0);
+
+// how long a snapshot entry is trusted before it is confirmed
+//  against the property cache again
+static const uint64_t kBucketSnapshotMicros=port::UINT64_ONE_SECOND_MICROS;
+
+
+/**
+ * Immutable set of bucket expiry settings for the write path,
+ *  sorted by interned bucket ID (BucketInternTable).  Never
+ *  changed once published:  a change copies the set, edits the
+ *  copy, and swaps gBucketSnapshot under gBucketSnapshotMutex,
+ *  then moves gBucketSnapshotGeneration.  The copy shares every
+ *  unchanged Entry with its predecessor by reference count, so a
+ *  publish allocates one entry plus the pointer vector.  Each
+ *  thread's BucketCursor holds a reference to the snapshot it last
+ *  saw and only takes the mutex when the generation moves.  A Put
+ *  then costs one load of the generation plus a binary search,
+ *  no property cache hash, shard mutex, or refcount.
+ *
+ *  Besides reference counts, m_CheckedMicros is the one mutable
+ *  field.  It is the last time an entry was confirmed against the
+ *  property cache, so an unchanged bucket is not republished every
+ *  kBucketSnapshotMicros.  Any thread may restamp it, always by
+ *  compare and swap.
+ */
+class BucketSnapshot
+{
+public:
+    struct Entry
+    {
+        BucketId_t m_Id;
+        ExpiryModuleEE m_Settings;          // copy of bucket's properties
+        volatile uint64_t m_CheckedMicros;  // cached time last confirmed
+        volatile uint32_t m_Refs;           // snapshots holding this entry
+
+        Entry() : m_Id(0), m_CheckedMicros(0), m_Refs(1) {};
+
+        // unsigned subtract also rejects a clock that moved backward.
+        //  A torn read (32 bit builds) only costs an extra lookup.
+        bool IsCurrent() const
+            {return((GetCachedTimeMicros() - m_CheckedMicros)<kBucketSnapshotMicros);};
+
+        // a lost race means another thread just restamped it
+        void Restamp()
+        {
+            uint64_t checked;
+
+            checked=m_CheckedMicros;
+            compare_and_swap(&m_CheckedMicros, checked, GetCachedTimeMicros());
+        };
+
+        void AddRef() {inc_and_fetch(&m_Refs);};
+        void Release()
+        {
+            if (0==dec_and_fetch(&m_Refs))
+                delete this;
+        };
+
+    private:
+        ~Entry() {};
+        Entry(const Entry &);
+        Entry & operator=(const Entry &);
+    };
+
+    BucketSnapshot() : m_Refs(1) {};
+
+    ~BucketSnapshot()
+    {
+        std::vector<Entry *>::iterator it;
+
+        for (it=m_Entries.begin(); m_Entries.end()!=it; ++it)
+            (*it)->Release();
+    };
+
+    // entry for Id, or NULL
+    Entry * Find(BucketId_t Id) const;
+
+    // new snapshot (one reference) with Id's entry replaced by Settings,
+    //  or removed if Settings is NULL
+    BucketSnapshot * CopyWith(BucketId_t Id, const ExpiryModuleEE * Settings) const;
+
+    void AddRef() {inc_and_fetch(&m_Refs);};
+    void Release()
+    {
+        if (0==dec_and_fetch(&m_Refs))
+            delete this;
+    };
+
+protected:
+    std::vector<Entry *> m_Entries;     // sorted by m_Id
+    volatile uint32_t m_Refs;           // gBucketSnapshot plus each cursor
+
+private:
+    BucketSnapshot(const BucketSnapshot &);
+    BucketSnapshot & operator=(const BucketSnapshot &);
+
+};  // class BucketSnapshot
+
+
+// current snapshot, NULL if none.  Swapped, and cursors take their
+//  reference, only while holding gBucketSnapshotMutex.
+static port::Mutex gBucketSnapshotMutex;
+static BucketSnapshot * gBucketSnapshot(NULL);
+
+
+BucketSnapshot::Entry *
+BucketSnapshot::Find(
+    BucketId_t Id) const
+{
+    Entry * ret_ptr(NULL);
+    size_t low, high, mid;
+
+    low=0;
+    high=m_Entries.size();
+    while (low<high)
+    {
+        mid=low + (high - low)/2;
+        if (m_Entries[mid]->m_Id<Id)
+            low=mid+1;
+        else
+            high=mid;
+    }   // while
+
+    if (low<m_Entries.size() && m_Entries[low]->m_Id==Id)
+        ret_ptr=m_Entries[low];
+
+    return(ret_ptr);
+
+}   // BucketSnapshot::Find
+
+
+BucketSnapshot *
+BucketSnapshot::CopyWith(
+    BucketId_t Id,
+    const ExpiryModuleEE * Settings) const
+{
+    BucketSnapshot * ret_ptr;
+    std::vector<Entry *>::const_iterator it;
+    Entry * entry;
+    bool placed;
+
+    ret_ptr=new BucketSnapshot;
+    ret_ptr->m_Entries.reserve(m_Entries.size()+1);
+    placed=(NULL==Settings);
+
+    for (it=m_Entries.begin(); m_Entries.end()!=it; ++it)
+    {
+        if (!placed && Id<=(*it)->m_Id)
+        {
+            entry=new Entry;
+            entry->m_Id=Id;
+            entry->m_Settings=*Settings;
+            entry->m_CheckedMicros=GetCachedTimeMicros();
+            ret_ptr->m_Entries.push_back(entry);
+            placed=true;
+        }   // if
+
+        // unchanged entries are shared, not copied
+        if (Id!=(*it)->m_Id)
+        {
+            (*it)->AddRef();
+            ret_ptr->m_Entries.push_back(*it);
+        }   // if
+    }   // for
+
+    if (!placed)
+    {
+        entry=new Entry;
+        entry->m_Id=Id;
+        entry->m_Settings=*Settings;
+        entry->m_CheckedMicros=GetCachedTimeMicros();
+        ret_ptr->m_Entries.push_back(entry);
+    }   // if
+
+    return(ret_ptr);
+
+}   // BucketSnapshot::CopyWith
+
+
+/**
+ * Replace (or with NULL Settings remove) one bucket's entry, then
+ *  publish.  Readers still holding the prior snapshot keep using
+ *  it until they notice the generation change.
+ *
+ *  Settings are published only if gBucketPropertiesGeneration still
+ *  equals PropGeneration, read before the property cache lookup that
+ *  produced them.  Otherwise a property change raced the lookup, and
+ *  the next write looks up again.
+ */
+static void
+PublishBucketSettings(
+    BucketId_t Id,
+    const ExpiryModuleEE * Settings,
+    uint64_t PropGeneration)
+{
+    BucketSnapshot * old_snap, * new_snap;
+
+    MutexLock lock(&gBucketSnapshotMutex);
+
+    if (NULL!=Settings && PropGeneration!=gBucketPropertiesGeneration)
+        return;
+
+    old_snap=gBucketSnapshot;
+    if (NULL!=old_snap)
+    {
+        new_snap=old_snap->CopyWith(Id, Settings);
+    }   // if
+    else
+    {
+        BucketSnapshot empty;
+        new_snap=empty.CopyWith(Id, Settings);
+    }   // else
+
+    gBucketSnapshot=new_snap;
+    inc_and_fetch(&gBucketSnapshotGeneration);
+
+    if (NULL!=old_snap)
+        old_snap->Release();
+
+}   // PublishBucketSettings
+
+
+/**
+ * Drop every entry, used when the property cache goes away
+ */
+static void
+ClearBucketSnapshot()
+{
+    BucketSnapshot * old_snap;
+
+    MutexLock lock(&gBucketSnapshotMutex);
+
+    old_snap=gBucketSnapshot;
+    gBucketSnapshot=NULL;
+    inc_and_fetch(&gBucketSnapshotGeneration);
+
+    if (NULL!=old_snap)
+        old_snap->Release();
+
+}   // ClearBucketSnapshot
+
+
+// true if the two would classify every key the same way
+static bool
+IsSameBucketSettings(
+    const ExpiryModuleEE & Lhs,
+    const ExpiryModuleEE & Rhs)
+{
+    return(Lhs.IsExpiryEnabled()==Rhs.IsExpiryEnabled()
+           && Lhs.GetExpiryMinutes()==Rhs.GetExpiryMinutes()
+           && Lhs.IsExpiryUnlimited()==Rhs.IsExpiryUnlimited()
+           && Lhs.IsWholeFileExpiryEnabled()==Rhs.IsWholeFileExpiryEnabled()
+           && Lhs.GetTombstoneMinutes()==Rhs.GetTombstoneMinutes());
+}   // IsSameBucketSettings
+
+
+/**
+ * Compactions and table builds see keys in sorted order, so
+ *  long runs of keys share one composite bucket.  Each thread
+ *  keeps the key prefix through the end of the last composite
+ *  bucket.  A key with the same prefix has the same bucket, so
+ *  both the sext decode and the property cache lookup are skipped.
+ *
+ *  Behind the prefix, each thread also keeps copies of several
+ *  recent buckets' settings, found by interned bucket ID
+ *  (BucketInternTable).  Reads and merges of several tables that
+ *  alternate between buckets then find settings by a 32 bit
+ *  compare, without the property cache's hash and mutex.
+ *
+ *  Settings are copied, not held via cache handle, so nothing
+ *  here outlives a property cache shutdown.
+ */
+class BucketCursor
+{
+public:
+    BucketCursor()
+        : m_PrefixSlot(-1), m_NextSlot(0), m_Hits(0),
+          m_Snapshot(NULL), m_SnapshotGeneration(0), m_SnapshotHits(0),
+          m_PropertyNoWait(false)
+    {};
+
+    ~BucketCursor()
+    {
+        FlushHits();
+        if (NULL!=m_Snapshot)
+            m_Snapshot->Release();
+    };
+
+    // returns bucket's settings, or NULL if no bucket or no properties
+    const ExpiryModuleOS * Find(const Slice & Key);
+
+    // write path:  move to the newest published snapshot.  Pointers
+    //  from FindWrite() stay valid until the next RefreshSnapshot().
+    void RefreshSnapshot();
+
+    // write path:  settings for one composite bucket from the snapshot,
+    //  falling back to the property cache (Prop then holds the handle).
+    //  returns Default if bucket has no properties.  NoWaitFallback
+    //  set if Default stands in only because a no wait lookup missed.
+    const ExpiryModuleOS * FindWrite(BucketId_t Id, const Slice & CompositeBucket,
+                                     ExpiryPropPtr_t & Prop,
+                                     const ExpiryModuleEE * Default,
+                                     bool & NoWaitFallback);
+
+    // Find() that does not wait on the router for missing properties
+    const ExpiryModuleOS * FindNoWait(const Slice & Key)
+    {
+        const ExpiryModuleOS * ret_ptr;
+
+        m_PropertyNoWait=true;
+        ret_ptr=Find(Key);
+        m_PropertyNoWait=false;
+
+        return(ret_ptr);
+    };
+
+    // property cache lookup of one composite bucket that does not
+    //  wait on the router, Prop holds the handle if true
+    bool LookupNoWait(const Slice & CompositeBucket, ExpiryPropPtr_t & Prop)
+    {
+        bool ret_flag;
+
+        m_PropertyNoWait=true;
+        ret_flag=Prop.Lookup(CompositeBucket);
+        m_PropertyNoWait=false;
+
+        return(ret_flag);
+    };
+
+    // true while FindWrite() or FindNoWait() does a no wait property cache lookup
+    bool IsPropertyNoWait() const {return(m_PropertyNoWait);};
+
+    // returns calling thread's cursor, creating if necessary
+    static BucketCursor * GetThreadCursor();
+
+protected:
+    static const int cSlots=8;
+
+    struct Slot
+    {
+        BucketId_t m_Id;            // 0 if slot unused
+        ExpiryModuleEE m_Settings;  // copy of bucket's properties
+        uint64_t m_LoadMicros;      // cached time when m_Settings copied
+        uint64_t m_Generation;      // gBucketCursorGeneration at copy
+
+        Slot() : m_Id(0), m_LoadMicros(0), m_Generation(0) {};
+
+        // unsigned subtract also rejects a clock that moved backward
+        bool IsCurrent() const
+        {
+            return(0!=m_Id
+                   && (GetCachedTimeMicros() - m_LoadMicros)<kBucketCursorMicros
+                   && m_Generation==gBucketCursorGeneration);
+        };
+    };
+
+    void FlushHits()
+    {
+        if (0!=m_Hits)
+        {
+            add_and_fetch(&gBucketCursorHits, m_Hits);
+            m_Hits=0;
+        }   // if
+
+        if (0!=m_SnapshotHits)
+        {
+            add_and_fetch(&gBucketSnapshotHits, m_SnapshotHits);
+            m_SnapshotHits=0;
+        }   // if
+    };
+
+    std::string m_Prefix;       // key bytes through end of composite bucket
+    int m_PrefixSlot;           // slot holding m_Prefix's bucket, -1 if none
+    Slot m_Slots[cSlots];       // recent buckets, any order
+    int m_NextSlot;             // round robin replacement
+    uint64_t m_Hits;            // hits not yet added to gBucketCursorHits
+
+    BucketSnapshot * m_Snapshot;        // referenced snapshot, or NULL
+    uint64_t m_SnapshotGeneration;      // gBucketSnapshotGeneration at reference
+    uint64_t m_SnapshotHits;            // hits not yet added to gBucketSnapshotHits
+    bool m_PropertyNoWait;              // within a no wait lookup
+
+private:
+    BucketCursor(const BucketCursor &);
+    BucketCursor & operator=(const BucketCursor &);
+
+};  // class BucketCursor
+
+
+static pthread_once_t gBucketCursorOnce=PTHREAD_ONCE_INIT;
+static pthread_key_t gBucketCursorKey;
+
+static void
+BucketCursorDelete(
+    void * Cursor)
+{
+    delete (BucketCursor *)Cursor;
+}   // BucketCursorDelete
+
+
+static void
+BucketCursorKeyCreate()
+{
+    pthread_key_create(&gBucketCursorKey, &BucketCursorDelete);
+}   // BucketCursorKeyCreate
+
+
+BucketCursor *
+BucketCursor::GetThreadCursor()
+{
+    BucketCursor * cursor;
+
+    pthread_once(&gBucketCursorOnce, &BucketCursorKeyCreate);
+
+    cursor=(BucketCursor *)pthread_getspecific(gBucketCursorKey);
+    if (NULL==cursor)
+    {
+        cursor=new BucketCursor;
+        pthread_setspecific(gBucketCursorKey, cursor);
+    }   // if
+
+    return(cursor);
+
+}   // BucketCursor::GetThreadCursor
+
+
+const ExpiryModuleOS *
+BucketCursor::Find(
+    const Slice & Key)
+{
+    const ExpiryModuleOS * ret_ptr(NULL);
+    BucketId_t id;
+    Slice composite_bucket;
+    int loop;
+
+    // same composite bucket as prior key?
+    if (0<=m_PrefixSlot && m_Prefix.size()<Key.size()
+        && m_Slots[m_PrefixSlot].IsCurrent()
+        && 0==memcmp(Key.data(), m_Prefix.data(), m_Prefix.size()))
+    {
+        ret_ptr=&m_Slots[m_PrefixSlot].m_Settings;
+        ++m_Hits;
+        if (1024<=m_Hits)
+            FlushHits();
+    }   // if
+
+    // decode, then recent bucket by ID or full lookup
+    else
+    {
+        m_PrefixSlot=-1;
+
+        if (KeyGetBucketId(Key, id, composite_bucket))
+        {
+            // ID 0 (intern table full) matches only unused slots,
+            //  and is never current, so always takes the lookup path
+            for (loop=0; loop<cSlots && m_Slots[loop].m_Id!=id; ++loop)
+            {}
+
+            if (loop<cSlots && m_Slots[loop].IsCurrent())
+            {
+                ret_ptr=&m_Slots[loop].m_Settings;
+                ++m_Hits;
+                if (1024<=m_Hits)
+                    FlushHits();
+            }   // if
+            else
+            {
+                ExpiryPropPtr_t expiry_prop;
+
+                // stale copy of this bucket, else oldest slot
+                if (cSlots==loop)
+                {
+                    loop=m_NextSlot;
+                    m_NextSlot=(m_NextSlot + 1) % cSlots;
+                }   // if
+
+                m_Slots[loop].m_Id=0;
+                FlushHits();
+                inc_and_fetch(&gBucketCursorMisses);
+
+                if (expiry_prop.Lookup(composite_bucket))
+                {
+                    m_Slots[loop].m_Settings=*(const ExpiryModuleEE *)expiry_prop.get();
+                    m_Slots[loop].m_LoadMicros=GetCachedTimeMicros();
+                    m_Slots[loop].m_Generation=gBucketCursorGeneration;
+                    m_Slots[loop].m_Id=id;
+                    ret_ptr=&m_Slots[loop].m_Settings;
+                }   // if
+            }   // else
+
+            if (NULL!=ret_ptr && 0!=id)
+            {
+                m_Prefix.assign(Key.data(),
+                                (composite_bucket.data() + composite_bucket.size()) - Key.data());
+                m_PrefixSlot=loop;
+            }   // if
+        }   // if
+
+        // non-Riak key is a miss, as before
+        else
+        {
+            FlushHits();
+            inc_and_fetch(&gBucketCursorMisses);
+        }   // else
+    }   // else
+
+    return(ret_ptr);
+
+}   // BucketCursor::Find
+
+
+void
+BucketCursor::RefreshSnapshot()
+{
+    if (m_SnapshotGeneration!=gBucketSnapshotGeneration)
+    {
+        MutexLock lock(&gBucketSnapshotMutex);
+
+        if (NULL!=m_Snapshot)
+            m_Snapshot->Release();
+
+        m_Snapshot=gBucketSnapshot;
+        if (NULL!=m_Snapshot)
+            m_Snapshot->AddRef();
+
+        m_SnapshotGeneration=gBucketSnapshotGeneration;
+    }   // if
+
+}   // BucketCursor::RefreshSnapshot
+
+
+/**
+ * A snapshot miss, or an entry older than kBucketSnapshotMicros,
+ *  goes to the property cache.  Unchanged settings only restamp the
+ *  entry.  New or changed settings publish a new snapshot, seen by
+ *  this thread at its next RefreshSnapshot().  A failed lookup is
+ *  not remembered, so the router is asked again next write just
+ *  as before snapshots existed.
+ *
+ *  With Default->IsPropertyNoWait(), a bucket missing from the
+ *  property cache is requested from the router but not waited on
+ *  (see PropertyCache::LookupWait()).  The write then keeps using a
+ *  stale snapshot entry if there is one:  property cache objects
+ *  expire after a few minutes, and the bucket's last known settings
+ *  beat database settings while the router answers.  Without an
+ *  entry the write uses Default, and NoWaitFallback tells the
+ *  caller these are not the bucket's own settings.
+ */
+const ExpiryModuleOS *
+BucketCursor::FindWrite(
+    BucketId_t Id,
+    const Slice & CompositeBucket,
+    ExpiryPropPtr_t & Prop,
+    const ExpiryModuleEE * Default,
+    bool & NoWaitFallback)
+{
+    bool found;
+
+    const ExpiryModuleOS * ret_ptr(Default);
+    BucketSnapshot::Entry * entry;
+    uint64_t prop_generation;
+
+    NoWaitFallback=false;
+
+    // ID 0 (intern table full) is never in a snapshot
+    entry=(NULL!=m_Snapshot && 0!=Id) ? m_Snapshot->Find(Id) : NULL;
+
+    if (NULL!=entry && entry->IsCurrent())
+    {
+        ret_ptr=&entry->m_Settings;
+        ++m_SnapshotHits;
+        if (1024<=m_SnapshotHits)
+            FlushHits();
+    }   // if
+
+    else
+    {
+        FlushHits();
+        inc_and_fetch(&gBucketSnapshotMisses);
+
+        // read before lookup, see PublishBucketSettings()
+        prop_generation=gBucketPropertiesGeneration;
+        m_PropertyNoWait=Default->IsPropertyNoWait();
+        found=Prop.Lookup(CompositeBucket);
+
+        // no wait miss:  last known settings, else database's
+        if (!found && m_PropertyNoWait)
+        {
+            if (NULL!=entry)
+                ret_ptr=&entry->m_Settings;
+            else
+                NoWaitFallback=true;
+        }   // if
+        m_PropertyNoWait=false;
+
+        if (found)
+        {
+            const ExpiryModuleEE & settings(*(const ExpiryModuleEE *)Prop.get());
+
+            ret_ptr=Prop.get();
+
+            if (NULL!=entry && IsSameBucketSettings(entry->m_Settings, settings))
+                entry->Restamp();
+            else if (0!=Id)
+                PublishBucketSettings(Id, &settings, prop_generation);
+        }   // if
+    }   // else
+
+    return(ret_ptr);
+
+}   // BucketCursor::FindWrite
+
 /**
  * This is the factory function to create
  *  an enterprise edition version of object expiry
@@ -63,6 +702,9 @@ ExpiryModule::CreateExpiryModule(
         {
             gUserExpirySample.reset();
             PropertyCache::InitPropertyCache(Router);
+
+            // time sext decode kernels here, not on a writer's first key
+            SextInitKernel();
             once_done=true;
         }   // if
     }   // MutexLock
@@ -98,6 +740,10 @@ ExpiryModule::ShutdownExpiryModule()
     PropertyCache::ShutdownPropertyCache();
     gUserExpirySample.reset();
 
+    // stop threads from reusing settings of the old cache
+    inc_and_fetch(&gBucketCursorGeneration);
+    ClearBucketSnapshot();
+
     return;
 
 }   // ExpiryModule::ShutdownExpiryModule
@@ -115,6 +761,10 @@ ExpiryModuleEE::operator=(
     SetExpiryMinutes(rhs.GetExpiryMinutes());
     SetExpiryUnlimited(rhs.IsExpiryUnlimited());
     SetWholeFileExpiryEnabled(rhs.IsWholeFileExpiryEnabled());
+    m_TombstoneMinutes=rhs.m_TombstoneMinutes;
+    m_PropertyNoWait=rhs.m_PropertyNoWait;
+    m_BucketSplitBytes=rhs.m_BucketSplitBytes;
+    m_CompactionWriteTime=rhs.m_CompactionWriteTime;
 
     return(*this);
 
@@ -128,6 +778,75 @@ ExpiryModuleEE::NoteUserExpirySettings()
 }   // ExpiryModuleEE::NoteUserExpirySettings
 
 
+/**
+ * Totals of compaction bucket lookups that reused the prior
+ *  key's bucket (hits) versus full decode and lookup (misses)
+ */
+void
+ExpiryModuleEE::GetBucketCursorCounts(
+    uint64_t & Hits,
+    uint64_t & Misses)
+{
+    Hits=add_and_fetch(&gBucketCursorHits, (uint64_t)0);
+    Misses=add_and_fetch(&gBucketCursorMisses, (uint64_t)0);
+}   // ExpiryModuleEE::GetBucketCursorCounts
+
+
+/**
+ * Totals of write path bucket lookups served by the published
+ *  snapshot (hits) versus the property cache (misses)
+ */
+void
+ExpiryModuleEE::GetBucketSnapshotCounts(
+    uint64_t & Hits,
+    uint64_t & Misses)
+{
+    Hits=add_and_fetch(&gBucketSnapshotHits, (uint64_t)0);
+    Misses=add_and_fetch(&gBucketSnapshotMisses, (uint64_t)0);
+}   // ExpiryModuleEE::GetBucketSnapshotCounts
+
+
+bool
+ExpiryModuleEE::IsThreadPropertyNoWait()
+{
+    BucketCursor * cursor;
+
+    // do not create a cursor for threads that never had one
+    pthread_once(&gBucketCursorOnce, &BucketCursorKeyCreate);
+    cursor=(BucketCursor *)pthread_getspecific(gBucketCursorKey);
+
+    return(NULL!=cursor && cursor->IsPropertyNoWait());
+
+}   // ExpiryModuleEE::IsThreadPropertyNoWait
+
+
+/**
+ * Property cache calls this after it stores new properties for a
+ *  bucket.  The bucket's snapshot entry is dropped, so the next
+ *  write reloads and republishes instead of waiting out
+ *  kBucketSnapshotMicros.  The generation moves first, so a writer
+ *  that looked up the old properties cannot publish them again.
+ *
+ *  Parent hookup, not in leveldb_ee:  util/prop_cache.cc
+ *  PropertyCache::Insert() must call this.  Until it does, a
+ *  property change reaches writes only when their snapshot entry
+ *  ages out, up to kBucketSnapshotMicros later.
+ */
+void
+ExpiryModuleEE::NoteBucketPropertiesChanged(
+    const Slice & CompositeBucket)
+{
+    BucketId_t id;
+
+    inc_and_fetch(&gBucketPropertiesGeneration);
+
+    id=BucketInternTable::Global().Find(CompositeBucket);
+    if (0!=id)
+        PublishBucketSettings(id, NULL, 0);
+
+}   // ExpiryModuleEE::NoteBucketPropertiesChanged
+
+
 /**
  * settings information that gets dumped to LOG upon
  *  leveldb start
@@ -140,49 +859,265 @@ ExpiryModuleEE::Dump(
     Log(log,"  ExpiryModuleEE.expiry_minutes: %" PRIu64, GetExpiryMinutes());
     Log(log,"ExpiryModuleEE.expiry_unlimited: %s", IsExpiryUnlimited() ? "true" : "false");
     Log(log,"     ExpiryModuleEE.whole_files: %s", IsWholeFileExpiryEnabled() ? "true" : "false");
+    Log(log,"ExpiryModuleEE.tombstone_minutes: %" PRIu64, m_TombstoneMinutes);
+    Log(log,"ExpiryModuleEE.property_no_wait: %s", m_PropertyNoWait ? "true" : "false");
+    Log(log,"ExpiryModuleEE.bucket_split_bytes: %" PRIu64, m_BucketSplitBytes);
+    Log(log,"ExpiryModuleEE.compaction_write_time: %s", m_CompactionWriteTime ? "true" : "false");
 
     return;
 
-}   // ExpiryModuleEE::Dump
+}   // ExpiryModuleEE::Dump
+
+
+/**
+ * Setup expiry environment by bucket, then call
+ *  OS version (callback to db/write_batch.cc MemTableInserter())
+ *
+ * Failed lookup ok to use default since only sets
+ *  write time within key.
+ *
+ * A bucket with tombstone minutes turns a Riak tombstone (every
+ *  sibling marked deleted) into an explicit expiry key.  Compaction
+ *  then purges it after the grace period instead of waiting on
+ *  Riak's delete_mode reaper.  Grace period needs to exceed the
+ *  cluster's handoff / anti-entropy window to avoid resurrection.
+ *  The conversion cannot be undone, so it only uses a bucket's own
+ *  settings, never database settings standing in for a bucket whose
+ *  properties a no wait lookup did not have yet.
+ */
+bool                     // always true, return ignored
+ExpiryModuleEE::MemTableInserterCallback(
+    const Slice & Key,   // input: user's key about to be written
+    const Slice & Value, // input: user's value object
+    ValueType & ValType,   // input/output: key type. call might change
+    ExpiryTimeMicros & Expiry)   // input/output: 0 or specific expiry. call might change
+    const
+{
+    const ExpiryModuleOS * module_os(this);
+    ExpiryPropPtr_t expiry_prop;
+    bool fallback(false);
+
+    if (IsExpiryEnabled())
+    {
+        BucketId_t id;
+        Slice composite_bucket;
+
+        // published snapshot first, property cache on miss
+        if (KeyGetBucketId(Key, id, composite_bucket))
+        {
+            BucketCursor * cursor(BucketCursor::GetThreadCursor());
+
+            cursor->RefreshSnapshot();
+            module_os=cursor->FindWrite(id, composite_bucket, expiry_prop, this, fallback);
+        }   // if
+    }   // if
+
+    return(InserterClassify(module_os, fallback, Key, Value, ValType, Expiry));
+
+}   // ExpiryModuleEE::MemTableInserterCallback
+
+
+/**
+ * Batch version of MemTableInserterCallback().  Riak batches are
+ *  mostly one bucket:  an object plus its 2i entries, or a run of
+ *  handoff keys.  The last few composite buckets and their settings
+ *  (snapshot entry or property handle) are kept for the length of
+ *  the call, so each bucket is looked up once per batch instead of
+ *  once per record.  A failed
+ *  lookup is remembered too, it uses default settings just as
+ *  MemTableInserterCallback() would.
+ */
+bool
+ExpiryModuleEE::MemTableInserterBatchCallback(
+    ExpiryBatchVector_t & Records) const
+{
+    bool ret_flag(true);
+    ExpiryPropPtr_t group_prop[cBatchGroups];
+    Slice group_bucket[cBatchGroups], composite_bucket;
+    const ExpiryModuleOS * group_module[cBatchGroups], * module_os;
+    bool group_fallback[cBatchGroups], fallback;
+    int group_count, next_group, loop, slot;
+    ExpiryBatchVector_t::iterator it;
+    BucketCursor * cursor(NULL);
+    BucketId_t id;
+
+    group_count=0;
+    next_group=0;
+    memset(group_fallback, 0, sizeof(group_fallback));
+
+    // one snapshot for whole batch, group_module pointers stay valid
+    if (IsExpiryEnabled())
+    {
+        cursor=BucketCursor::GetThreadCursor();
+        cursor->RefreshSnapshot();
+    }   // if
+
+    for (it=Records.begin(); Records.end()!=it; ++it)
+    {
+        module_os=this;
+        fallback=false;
+
+        if (NULL!=cursor && KeyGetBucketId(it->m_Key, id, composite_bucket))
+        {
+            // most recent group first
+            slot=next_group;
+            for (loop=0; loop<group_count; ++loop)
+            {
+                slot=(0==slot ? cBatchGroups : slot) - 1;
+                if (group_bucket[slot]==composite_bucket)
+                    break;
+            }   // for
+
+            if (loop<group_count)
+            {
+                module_os=group_module[slot];
+                fallback=group_fallback[slot];
+            }   // if
+
+            // new bucket, replaces oldest group once all used
+            else
+            {
+                slot=next_group;
+                group_bucket[slot]=composite_bucket;
+                group_module[slot]=cursor->FindWrite(id, composite_bucket,
+                                                     group_prop[slot], this,
+                                                     group_fallback[slot]);
+
+                module_os=group_module[slot];
+                fallback=group_fallback[slot];
+                next_group=(next_group + 1) % cBatchGroups;
+                if (group_count<cBatchGroups)
+                    ++group_count;
+            }   // else
+        }   // if
+
+        ret_flag=InserterClassify(module_os, fallback, it->m_Key, it->m_Value,
+                                  it->m_ValType, it->m_Expiry) && ret_flag;
+    }   // for
+
+    return(ret_flag);
+
+}   // ExpiryModuleEE::MemTableInserterBatchCallback
+
+
+/**
+ * WriteBatch::Iterate() handler that copies out record slices
+ */
+class BatchRecordCollector : public WriteBatch::Handler
+{
+public:
+    BatchRecordCollector(ExpiryBatchVector_t & Records)
+        : m_Records(Records) {};
+
+    virtual void Put(const Slice & Key, const Slice & Value,
+                     const ValueType & Type, const ExpiryTimeMicros & Expiry)
+    {
+        ExpiryBatchRecord record;
+
+        record.m_Key=Key;
+        record.m_Value=Value;
+        record.m_ValType=Type;
+        record.m_Expiry=Expiry;
+        m_Records.push_back(record);
+    };
+
+    virtual void Delete(const Slice & Key)
+    {
+        Put(Key, Slice(), kTypeDeletion, 0);
+    };
+
+protected:
+    ExpiryBatchVector_t & m_Records;
+
+private:
+    BatchRecordCollector();
+    BatchRecordCollector(const BatchRecordCollector &);
+    BatchRecordCollector & operator=(const BatchRecordCollector &);
+
+};  // class BatchRecordCollector
+
+
+void
+ExpiryModuleEE::GetBatchRecords(
+    const WriteBatch & Batch,
+    ExpiryBatchVector_t & Records)
+{
+    BatchRecordCollector collector(Records);
+
+    Records.clear();
+    Records.reserve(WriteBatchInternal::Count(&Batch));
+    Batch.Iterate(&collector);
+
+}   // ExpiryModuleEE::GetBatchRecords
 
 
 /**
- * Setup expiry environment by bucket, then call
- *  OS version (callback to db/write_batch.cc MemTableInserter())
+ * Per record work shared by single and batch inserter callbacks,
+ *  once the record's settings (bucket or this module) are known.
+ *  A value parsed for the tombstone test also gives the write time
+ *  here, so the Riak object is parsed once per record.  The open
+ *  source callback then finds the write time set and does not call
+ *  GenerateWriteTimeMicros().
  *
- * Failed lookup ok to use default since only sets
- *  write time within key.
+ *  NoWaitFallback means ModuleOS is this module standing in for a
+ *  bucket not yet cached.  The tombstone conversion is skipped, the
+ *  tombstone is left to Riak's delete_mode reaper.  The key always
+ *  gets a write time, even if these settings do not age keys:  a
+ *  plain key never expires, so only a write time lets compaction's
+ *  KeyRetirementCallback() apply the bucket's own settings later.
  */
-bool                     // always true, return ignored
-ExpiryModuleEE::MemTableInserterCallback(
-    const Slice & Key,   // input: user's key about to be written
-    const Slice & Value, // input: user's value object
-    ValueType & ValType,   // input/output: key type. call might change
-    ExpiryTimeMicros & Expiry)   // input/output: 0 or specific expiry. call might change
-    const
+bool
+ExpiryModuleEE::InserterClassify(
+    const ExpiryModuleOS * ModuleOS,
+    bool NoWaitFallback,
+    const Slice & Key,
+    const Slice & Value,
+    ValueType & ValType,
+    ExpiryTimeMicros & Expiry) const
 {
-    const ExpiryModuleOS * module_os(this);
+    bool ret_flag, parsed(false);
+    uint64_t tombstone_minutes, write_micros;
+    RiakObjectView view;
 
     if (IsExpiryEnabled())
     {
-        bool good(true);
-        ExpiryPropPtr_t expiry_prop;
-        Slice composite_bucket;
-
-        good=KeyGetBucket(Key, composite_bucket);
+        // Riak tombstone gets short explicit expiry
+        tombstone_minutes=((const ExpiryModuleEE *)ModuleOS)->GetTombstoneMinutes();
+        if (kTypeValue==ValType && 0!=tombstone_minutes
+            && !NoWaitFallback && ModuleOS->IsExpiryEnabled())
+        {
+            parsed=view.Parse(Value);
 
-        // see if properties found
-        good=good && expiry_prop.Lookup(composite_bucket);
+            if (parsed && view.IsAllDeleted())
+            {
+                ValType=kTypeValueExplicitExpiry;
+                Expiry=GetCachedTimeMicros()
+                    + tombstone_minutes*60*port::UINT64_ONE_SECOND_MICROS;
+            }   // if
+        }   // if
 
-        // yes, use bucket level properties
-        if (good)
-            module_os=expiry_prop.get();
+        // open source callback fills in the write time
+        if (kTypeValue==ValType && NoWaitFallback)
+        {
+            ValType=kTypeValueWriteTime;
+            Expiry=0;
+        }   // if
 
+        // aging settings:  write time from the parse above
+        if (parsed && kTypeValue==ValType && ModuleOS->IsExpiryEnabled()
+            && 0!=ModuleOS->GetExpiryMinutes() && !ModuleOS->IsExpiryUnlimited()
+            && ValueGetLastModTimeMicros(view, Value, write_micros))
+        {
+            ValType=kTypeValueWriteTime;
+            Expiry=write_micros;
+        }   // if
     }   // if
 
-    return(module_os->ExpiryModuleOS::MemTableInserterCallback(Key, Value, ValType, Expiry));
+    ret_flag=ModuleOS->ExpiryModuleOS::MemTableInserterCallback(Key, Value, ValType, Expiry);
 
-}   // ExpiryModuleEE::MemTableInserterCallback
+    return(ret_flag);
+
+}   // ExpiryModuleEE::InserterClassify
 
 
 /**
@@ -229,20 +1164,14 @@ ExpiryModuleEE::KeyRetirementCallback(
 
     if (IsExpiryEnabled())
     {
-        bool good(true);
-        ExpiryPropPtr_t expiry_prop;
-        Slice composite_bucket;
-
-        good=KeyGetBucket(Ikey.user_key, composite_bucket);
-
-        // see if properties found
-        good=good && expiry_prop.Lookup(composite_bucket);
+        // keys arrive sorted, thread's cursor often already
+        //  holds this key's bucket properties
+        module_os=BucketCursor::GetThreadCursor()->Find(Ikey.user_key);
 
         // yes, use bucket level properties
         //  (no, do nothing because no-bucket is error)
-        if (good)
+        if (NULL!=module_os)
         {
-            module_os=expiry_prop.get();
             is_expired=module_os->ExpiryModuleOS::KeyRetirementCallback(Ikey);
         }   // if
     }   // if
@@ -252,6 +1181,51 @@ ExpiryModuleEE::KeyRetirementCallback(
 }   // ExpiryModuleEE::KeyRetirementCallback
 
 
+/**
+ * Keys written while expiry was disabled (globally or for their
+ *  bucket) carry no write time, so they can never expire.  Once
+ *  their bucket enables expiry, the next compaction decodes the
+ *  Riak object's last modified time and rewrites the key as
+ *  kTypeValueWriteTime.  Every later compaction and read then
+ *  decides from the key alone.  Sort order is unchanged since
+ *  internal keys order by user key and sequence only.
+ *
+ *  Values without a Riak last modified time are left alone rather
+ *  than given "now", which would restart their expiry clock.
+ *
+ *  Old objects can expire as soon as they are rewritten, so this
+ *  only happens with IsCompactionWriteTime() on the database's
+ *  module.  By default such keys stay plain and never expire.
+ */
+bool
+ExpiryModuleEE::CompactionWriteTimeCallback(
+    const ParsedInternalKey & Ikey,
+    const Slice & Value,
+    ValueType & ValType,
+    ExpiryTimeMicros & Expiry) const
+{
+    bool ret_flag(false);
+    const ExpiryModuleOS * module_os;
+    uint64_t write_micros;
+
+    if (IsExpiryEnabled() && m_CompactionWriteTime && kTypeValue==Ikey.type)
+    {
+        module_os=BucketCursor::GetThreadCursor()->Find(Ikey.user_key);
+
+        if (NULL!=module_os && module_os->IsExpiryEnabled()
+            && ValueGetLastModTimeMicros(Value, write_micros))
+        {
+            ValType=kTypeValueWriteTime;
+            Expiry=write_micros;
+            ret_flag=true;
+        }   // if
+    }   // if
+
+    return(ret_flag);
+
+}   // ExpiryModuleEE::CompactionWriteTimeCallback
+
+
 /**
  * Setup expiry environment by bucket, then call
  *  OS version
@@ -266,30 +1240,325 @@ ExpiryModuleEE::TableBuilderCallback(
     const Slice & Key,
     SstCounters & Counters) const
 {
-    const ExpiryModuleOS * module_os(this);
+    const ExpiryModuleOS * module_os;
+
+    module_os=TableBuilderModule(Key);
+
+    return(module_os->ExpiryModuleOS::TableBuilderCallback(Key, Counters));
+
+}   // ExpiryModuleEE::TableBuilderCallback
+
+
+/**
+ * Size test comes first, so the two bucket decodes only happen once
+ *  a table is large enough to cut.  A boundary is a change of
+ *  composite bucket or of key head, the same test as
+ *  IsSingleBucketFile():  bucket B's object keys and 2i keys are not
+ *  adjacent, every other bucket's object keys sort between them.
+ *  A Riak key next to a non-Riak key is a boundary too.  Splits only
+ *  pay off through whole file expiry, so nothing is cut while expiry
+ *  is disabled.
+ */
+bool
+ExpiryModuleEE::CompactionSplitCallback(
+    const Slice & PriorKey,
+    const Slice & Key,
+    uint64_t CurrentBytes) const
+{
+    bool ret_flag(false), prior_good, key_good;
+    Slice prior_composite, key_composite, prior_head, key_head;
+
+    if (IsExpiryEnabled() && 0!=m_BucketSplitBytes
+        && m_BucketSplitBytes<=CurrentBytes && 0!=PriorKey.size())
+    {
+        prior_good=KeyGetBucket(PriorKey, prior_composite);
+        key_good=KeyGetBucket(Key, key_composite);
+
+        if (prior_good && key_good)
+        {
+            prior_head=Slice(PriorKey.data(), prior_composite.data() - PriorKey.data());
+            key_head=Slice(Key.data(), key_composite.data() - Key.data());
+        }   // if
+
+        ret_flag=(prior_good!=key_good
+                  || (prior_good && (prior_composite!=key_composite
+                                     || prior_head!=key_head)));
+    }   // if
+
+    return(ret_flag);
+
+}   // ExpiryModuleEE::CompactionSplitCallback
+
+
+/**
+ * True if SstFile's first and last keys share one composite bucket
+ *  and the same key head.  All object keys sort ahead of all 2i keys,
+ *  so a file from {o,B,..} through {i,B,..} spans every other
+ *  bucket's keys even though both ends name bucket B.
+ */
+static bool
+IsSingleBucketFile(
+    const FileMetaData & SstFile,
+    Slice & CompositeBucket)
+{
+    bool good;
+    Slice high_composite, low_head, high_head, temp_key;
+
+    temp_key=SstFile.smallest.internal_key();
+    good=KeyGetBucket(temp_key, CompositeBucket);
+    low_head=Slice(temp_key.data(), CompositeBucket.data() - temp_key.data());
+    temp_key=SstFile.largest.internal_key();
+    good=good && KeyGetBucket(temp_key, high_composite);
+    high_head=Slice(temp_key.data(), high_composite.data() - temp_key.data());
+
+    return(good && CompositeBucket==high_composite && low_head==high_head);
+
+}   // IsSingleBucketFile
+
+
+/**
+ * Bytes past Module's expiry minutes, write times taken as spread
+ *  evenly from WriteLow to WriteHigh.  Plain keys only, or no aged
+ *  keys, leave WriteLow at 0 or ULLONG_MAX and give no estimate.
+ *  Explicit expiry keys are not estimated, their share is not known.
+ */
+static uint64_t
+AgedBytesEstimate(
+    const ExpiryModuleOS & Module,
+    uint64_t Bytes,
+    ExpiryTimeMicros WriteLow,
+    ExpiryTimeMicros WriteHigh,
+    ExpiryTimeMicros Now)
+{
+    uint64_t ret_bytes(0), age_micros;
+    ExpiryTimeMicros cutoff;
+
+    age_micros=Module.GetExpiryMinutes()*60*port::UINT64_ONE_SECOND_MICROS;
+
+    if (Module.IsExpiryEnabled() && !Module.IsExpiryUnlimited()
+        && 0!=age_micros && age_micros<Now
+        && 0!=WriteLow && ULLONG_MAX!=WriteLow && WriteLow<=WriteHigh)
+    {
+        cutoff=Now - age_micros;
+
+        if (WriteHigh<cutoff)
+            ret_bytes=Bytes;
+        else if (WriteLow<cutoff)
+            ret_bytes=(uint64_t)((double)Bytes * (double)(cutoff - WriteLow)
+                                 / (double)(WriteHigh - WriteLow));
+    }   // if
+
+    return(ret_bytes);
+
+}   // AgedBytesEstimate
+
+
+/**
+ * Estimate uses the file's bucket settings when IsSingleBucketFile().
+ *  A file that spans buckets gets no estimate:  its write time range
+ *  mixes buckets with different expiry minutes, and this module's
+ *  minutes say nothing about any of them.  A file whose first and
+ *  last keys are both non-Riak uses this module, as the per bucket
+ *  overload does for its "" range.
+ */
+uint64_t
+ExpiryModuleEE::ExpiredBytesEstimate(
+    const FileMetaData & SstFile,
+    ExpiryTimeMicros Now) const
+{
+    uint64_t ret_bytes(0);
+    const ExpiryModuleOS * module_os(NULL), * bucket_os;
+    Slice composite_bucket;
 
     if (IsExpiryEnabled())
     {
-        bool good(true);
-        ExpiryPropPtr_t expiry_prop;
-        Slice composite_bucket;
+        if (IsSingleBucketFile(SstFile, composite_bucket))
+        {
+            // runs under the db mutex, a missing bucket uses this module
+            bucket_os=BucketCursor::GetThreadCursor()->FindNoWait(SstFile.smallest.internal_key());
+            module_os=(NULL!=bucket_os) ? bucket_os : this;
+        }   // if
+        else if (!KeyGetBucket(SstFile.smallest.internal_key(), composite_bucket)
+                 && !KeyGetBucket(SstFile.largest.internal_key(), composite_bucket))
+        {
+            module_os=this;
+        }   // else if
 
-        good=KeyGetBucket(Key, composite_bucket);
+        if (NULL!=module_os)
+            ret_bytes=AgedBytesEstimate(*module_os, SstFile.file_size,
+                                        SstFile.exp_write_low, SstFile.exp_write_high, Now);
+    }   // if
 
-        // see if properties found
-        good=good && expiry_prop.Lookup(composite_bucket);
+    return(ret_bytes);
 
-        // yes, use bucket level properties
-        if (good)
-            module_os=expiry_prop.get();
+}   // ExpiryModuleEE::ExpiredBytesEstimate
+
+
+/**
+ * Each bucket's ranges stand in for the file's, as in IsFileExpired().
+ *  A bucket's share of the file is its share of the keys, or an even
+ *  split for ranges decoded from version 1 blocks.  A bucket whose
+ *  properties are not cached adds nothing, its minutes are unknown.
+ *  Non-Riak keys use this module's settings.
+ */
+uint64_t
+ExpiryModuleEE::ExpiredBytesEstimate(
+    const FileMetaData & SstFile,
+    const BucketExpiryRanges & Ranges,
+    ExpiryTimeMicros Now) const
+{
+    uint64_t ret_bytes(0), total_keys, bucket_bytes;
+    BucketExpiryRanges::RangeMap_t::const_iterator it;
 
+    if (Ranges.GetRanges().empty())
+    {
+        ret_bytes=ExpiredBytesEstimate(SstFile, Now);
     }   // if
 
-    return(module_os->ExpiryModuleOS::TableBuilderCallback(Key, Counters));
+    else if (IsExpiryEnabled())
+    {
+        total_keys=0;
+        for (it=Ranges.GetRanges().begin(); Ranges.GetRanges().end()!=it; ++it)
+            total_keys+=it->second.m_Keys;
+
+        for (it=Ranges.GetRanges().begin(); Ranges.GetRanges().end()!=it; ++it)
+        {
+            const ExpiryModuleOS * module_os(this);
+            ExpiryPropPtr_t expiry_prop;
+
+            // runs under the db mutex, never wait on the router
+            if (!it->first.empty())
+            {
+                if (BucketCursor::GetThreadCursor()->LookupNoWait(it->first, expiry_prop))
+                    module_os=expiry_prop.get();
+                else
+                    module_os=NULL;
+            }   // if
+
+            if (NULL!=module_os)
+            {
+                if (0!=total_keys)
+                    bucket_bytes=(uint64_t)((double)SstFile.file_size
+                                            * (double)it->second.m_Keys / (double)total_keys);
+                else
+                    bucket_bytes=SstFile.file_size / Ranges.GetRanges().size();
+
+                ret_bytes+=AgedBytesEstimate(*module_os, bucket_bytes,
+                                             it->second.m_WriteLow, it->second.m_WriteHigh, Now);
+            }   // if
+        }   // for
+    }   // else if
+
+    return(ret_bytes);
+
+}   // ExpiryModuleEE::ExpiredBytesEstimate
+
+
+double
+ExpiryModuleEE::ExpiredLevelScore(
+    const std::vector<FileMetaData *> & Files,
+    ExpiryTimeMicros Now,
+    const FileMetaData * & BestFile) const
+{
+    std::vector<const BucketExpiryRanges *> no_ranges;
+
+    return(ExpiredLevelScore(Files, no_ranges, Now, BestFile));
+
+}   // ExpiryModuleEE::ExpiredLevelScore
+
+
+double
+ExpiryModuleEE::ExpiredLevelScore(
+    const std::vector<FileMetaData *> & Files,
+    const std::vector<const BucketExpiryRanges *> & Ranges,
+    ExpiryTimeMicros Now,
+    const FileMetaData * & BestFile) const
+{
+    double ret_score(0.0);
+    uint64_t total_bytes, expired_bytes, file_bytes, best_bytes;
+    std::vector<FileMetaData *>::const_iterator it;
+    size_t index;
+
+    BestFile=NULL;
+    total_bytes=0;
+    expired_bytes=0;
+    best_bytes=0;
+
+    if (IsExpiryEnabled())
+    {
+        for (it=Files.begin(), index=0; Files.end()!=it; ++it, ++index)
+        {
+            if (index<Ranges.size() && NULL!=Ranges[index])
+                file_bytes=ExpiredBytesEstimate(**it, *Ranges[index], Now);
+            else
+                file_bytes=ExpiredBytesEstimate(**it, Now);
+
+            total_bytes+=(*it)->file_size;
+            expired_bytes+=file_bytes;
+
+            if (best_bytes<file_bytes)
+            {
+                best_bytes=file_bytes;
+                BestFile=*it;
+            }   // if
+        }   // for
+
+        if (0!=total_bytes)
+            ret_score=(double)expired_bytes / (double)total_bytes;
+    }   // if
+
+    return(ret_score);
+
+}   // ExpiryModuleEE::ExpiredLevelScore
+
+
+/**
+ * TableBuilderCallback() plus the key's bucket counters in Ranges.
+ *  Both use the same settings, so per bucket counters always agree
+ *  with the file's.
+ */
+bool
+ExpiryModuleEE::TableBuilderCallback(
+    const Slice & Key,
+    SstCounters & Counters,
+    BucketExpiryRanges & Ranges) const
+{
+    bool ret_flag;
+    const ExpiryModuleOS * module_os;
+
+    module_os=TableBuilderModule(Key);
+
+    ret_flag=module_os->ExpiryModuleOS::TableBuilderCallback(Key, Counters);
+    Ranges.Add(Key, *module_os);
+
+    return(ret_flag);
 
 }   // ExpiryModuleEE::TableBuilderCallback
 
 
+const ExpiryModuleOS *
+ExpiryModuleEE::TableBuilderModule(
+    const Slice & Key) const
+{
+    const ExpiryModuleOS * module_os(this), * bucket_os;
+
+    if (IsExpiryEnabled())
+    {
+        // keys arrive sorted, thread's cursor often already
+        //  holds this key's bucket properties
+        bucket_os=BucketCursor::GetThreadCursor()->Find(Key);
+
+        // yes, use bucket level properties
+        if (NULL!=bucket_os)
+            module_os=bucket_os;
+
+    }   // if
+
+    return(module_os);
+
+}   // ExpiryModuleEE::TableBuilderModule
+
+
 /**
  * MemTableCallback routes through KeyRetirementCallback ... no new code for EE required
  */
@@ -306,6 +1575,9 @@ ExpiryModuleEE::TableBuilderCallback(
  *
  * This routine could expiry incorrectly if Lookup fails (returns NULL).  Aborts
  *  test in such case (returns false).
+ *
+ * Files whose first and last keys differ in bucket need the table's
+ *  BucketExpiryRanges, see the overload below.
  */
 bool
 ExpiryModuleEE::IsFileExpired(
@@ -313,7 +1585,7 @@ ExpiryModuleEE::IsFileExpired(
     ExpiryTimeMicros Now) const
 {
     bool expired_file(false), good;
-    Slice low_composite, high_composite, temp_key;
+    Slice composite_bucket;
     ExpiryPropPtr_t expiry_prop;
     const ExpiryModuleOS * module_os(this);
 
@@ -323,19 +1595,12 @@ ExpiryModuleEE::IsFileExpired(
         // only delete files with matching buckets for first
         //  and last key.  Do not process / make any assumptions
         //  if first and last have different buckets.
-        temp_key=SstFile.smallest.internal_key();
-        good=KeyGetBucket(temp_key, low_composite);
-        temp_key=SstFile.largest.internal_key();
-        good=good && KeyGetBucket(temp_key, high_composite);
-        //assert(good);
-
-        // smallest & largest bucket names match, file eligible for whole file expiry
-        expired_file=(good && low_composite==high_composite);
+        expired_file=IsSingleBucketFile(SstFile, composite_bucket);
 
         if (expired_file)
         {
             // see if properties found
-            good=expiry_prop.Lookup(low_composite);
+            good=expiry_prop.Lookup(composite_bucket);
 
             // yes, use bucket level properties
             if (good)
@@ -358,4 +1623,201 @@ ExpiryModuleEE::IsFileExpired(
 }   // ExpiryModuleEE::IsFileExpired
 
 
+/**
+ * Each bucket's ranges stand in for the file's, so the open source
+ *  rules decide each bucket just as they would a one bucket file.
+ *  A bucket whose properties are not found stops the file from
+ *  expiring, as above.  Non-Riak keys use this module's settings.
+ */
+bool
+ExpiryModuleEE::IsFileExpired(
+    const FileMetaData & SstFile,
+    const BucketExpiryRanges & Ranges,
+    ExpiryTimeMicros Now) const
+{
+    bool expired_file(false);
+    BucketExpiryRanges::RangeMap_t::const_iterator it;
+
+    if (Ranges.GetRanges().empty())
+    {
+        expired_file=IsFileExpired(SstFile, Now);
+    }   // if
+
+    else if (IsExpiryEnabled())
+    {
+        FileMetaData bucket_file(SstFile);
+
+        expired_file=true;
+        for (it=Ranges.GetRanges().begin();
+             Ranges.GetRanges().end()!=it && expired_file; ++it)
+        {
+            const ExpiryModuleOS * module_os(this);
+            ExpiryPropPtr_t expiry_prop;
+
+            if (!it->first.empty())
+            {
+                expired_file=expiry_prop.Lookup(it->first);
+                if (expired_file)
+                    module_os=expiry_prop.get();
+            }   // if
+
+            if (expired_file)
+            {
+                bucket_file.exp_write_low=it->second.m_WriteLow;
+                bucket_file.exp_write_high=it->second.m_WriteHigh;
+                bucket_file.exp_explicit_high=it->second.m_ExplicitHigh;
+                expired_file=module_os->ExpiryModuleOS::IsFileExpired(bucket_file, Now);
+            }   // if
+        }   // for
+    }   // else if
+
+    return(expired_file);
+
+}   // ExpiryModuleEE::IsFileExpired
+
+
+/**
+ * A new range starts as the open source callback leaves a table's
+ *  counters after its first key (eSstCountKeys of 1):  write low at
+ *  ULLONG_MAX so the first write time key lowers it.  m_Scratch
+ *  never counts keys, so the callback never resets a range.
+ */
+BucketExpiryRanges::BucketExpiryRanges()
+    : m_Last(m_Ranges.end())
+{
+    m_Initial.m_WriteLow=ULLONG_MAX;
+    m_Initial.m_WriteHigh=0;
+    m_Initial.m_ExplicitHigh=0;
+    m_Initial.m_Keys=0;
+
+}   // BucketExpiryRanges::BucketExpiryRanges
+
+
+/**
+ * The open source callback updates a scratch SstCounters loaded
+ *  with this bucket's range, so the per bucket rules can never
+ *  drift from the per file rules.
+ */
+void
+BucketExpiryRanges::Add(
+    const Slice & Key,
+    const ExpiryModuleOS & Module)
+{
+    Slice composite_bucket;
+
+    // same composite bucket as prior key?
+    if (m_Ranges.end()==m_Last || m_Prefix.empty()
+        || Key.size()<=m_Prefix.size()
+        || 0!=memcmp(Key.data(), m_Prefix.data(), m_Prefix.size()))
+    {
+        if (KeyGetBucket(Key, composite_bucket))
+        {
+            m_Prefix.assign(Key.data(),
+                            (composite_bucket.data() + composite_bucket.size()) - Key.data());
+        }   // if
+        else
+        {
+            composite_bucket=Slice();
+            m_Prefix.clear();
+        }   // else
+
+        std::string name(composite_bucket.data(), composite_bucket.size());
+
+        m_Last=m_Ranges.find(name);
+        if (m_Ranges.end()==m_Last)
+            m_Last=m_Ranges.insert(RangeMap_t::value_type(name, m_Initial)).first;
+    }   // if
+
+    m_Scratch.Set(eSstCountExpiry1, m_Last->second.m_WriteLow);
+    m_Scratch.Set(eSstCountExpiry2, m_Last->second.m_WriteHigh);
+    m_Scratch.Set(eSstCountExpiry3, m_Last->second.m_ExplicitHigh);
+
+    Module.ExpiryModuleOS::TableBuilderCallback(Key, m_Scratch);
+
+    m_Last->second.m_WriteLow=m_Scratch.Value(eSstCountExpiry1);
+    m_Last->second.m_WriteHigh=m_Scratch.Value(eSstCountExpiry2);
+    m_Last->second.m_ExplicitHigh=m_Scratch.Value(eSstCountExpiry3);
+    ++m_Last->second.m_Keys;
+
+}   // BucketExpiryRanges::Add
+
+
+// current block format, version 1 lacks key counts
+static const uint32_t cBucketExpiryVersion=2;
+
+
+/**
+ * Block format, all varints:  version, range count, then per
+ *  range:  length prefixed composite bucket, write low, write high,
+ *  explicit high, key count
+ */
+void
+BucketExpiryRanges::EncodeTo(
+    std::string & Output) const
+{
+    RangeMap_t::const_iterator it;
+
+    PutVarint32(&Output, cBucketExpiryVersion);
+    PutVarint64(&Output, m_Ranges.size());
+
+    for (it=m_Ranges.begin(); m_Ranges.end()!=it; ++it)
+    {
+        PutLengthPrefixedSlice(&Output, it->first);
+        PutVarint64(&Output, it->second.m_WriteLow);
+        PutVarint64(&Output, it->second.m_WriteHigh);
+        PutVarint64(&Output, it->second.m_ExplicitHigh);
+        PutVarint64(&Output, it->second.m_Keys);
+    }   // for
+
+}   // BucketExpiryRanges::EncodeTo
+
+
+bool
+BucketExpiryRanges::DecodeFrom(
+    const Slice & Block)
+{
+    bool good;
+    Slice input(Block), name;
+    uint32_t version;
+    uint64_t count, loop;
+    Range range;
+
+    Clear();
+
+    good=GetVarint32(&input, &version)
+        && (1==version || cBucketExpiryVersion==version)
+        && GetVarint64(&input, &count);
+
+    for (loop=0; good && loop<count; ++loop)
+    {
+        range.m_Keys=0;
+        good=GetLengthPrefixedSlice(&input, &name)
+            && GetVarint64(&input, &range.m_WriteLow)
+            && GetVarint64(&input, &range.m_WriteHigh)
+            && GetVarint64(&input, &range.m_ExplicitHigh)
+            && (1==version || GetVarint64(&input, &range.m_Keys));
+
+        if (good)
+            m_Ranges[name.ToString()]=range;
+    }   // for
+
+    good=good && 0==input.size();
+    if (!good)
+        Clear();
+
+    return(good);
+
+}   // BucketExpiryRanges::DecodeFrom
+
+
+void
+BucketExpiryRanges::Clear()
+{
+    m_Ranges.clear();
+    m_Last=m_Ranges.end();
+    m_Prefix.clear();
+
+}   // BucketExpiryRanges::Clear
+
+
 }  // namespace leveldb
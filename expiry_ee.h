@@ -23,6 +23,8 @@
 #ifndef EXPIRY_EE_H
 #define EXPIRY_EE_H
 
+#include <map>
+#include <string>
 #include <vector>
 
 #include "leveldb/cache.h"
@@ -36,11 +38,85 @@
 namespace leveldb
 {
 
+class WriteBatch;
+
+/**
+ * One WriteBatch record for MemTableInserterBatchCallback().
+ *  Key and Value point into the batch's own storage.
+ */
+struct ExpiryBatchRecord
+{
+    Slice m_Key;
+    Slice m_Value;
+    ValueType m_ValType;          // input/output, as MemTableInserterCallback
+    ExpiryTimeMicros m_Expiry;    // input/output, as MemTableInserterCallback
+};
+
+typedef std::vector<ExpiryBatchRecord> ExpiryBatchVector_t;
+
+
+/**
+ * A table's expiry counters (eSstCountExpiry1-3, which become
+ *  FileMetaData's exp_write_low, exp_write_high, and exp_explicit_high)
+ *  kept per composite bucket.  Whole file expiry can then judge a
+ *  table that spans buckets one bucket at a time.  Filled through
+ *  ExpiryModuleEE::TableBuilderCallback() with a Ranges parameter,
+ *  kept by the caller with the file's metadata via EncodeTo() /
+ *  DecodeFrom().
+ */
+class BucketExpiryRanges
+{
+public:
+    struct Range
+    {
+        ExpiryTimeMicros m_WriteLow;      // as FileMetaData::exp_write_low
+        ExpiryTimeMicros m_WriteHigh;     // as FileMetaData::exp_write_high
+        ExpiryTimeMicros m_ExplicitHigh;  // as FileMetaData::exp_explicit_high
+        uint64_t m_Keys;                  // keys added, 0 if decoded from version 1
+    };
+
+    // composite bucket (sext bytes) to range, non-Riak keys under ""
+    typedef std::map<std::string, Range> RangeMap_t;
+
+    BucketExpiryRanges();
+
+    // account for one internal key, Module is the settings the
+    //  table's own counters used for this key
+    void Add(const Slice & Key, const ExpiryModuleOS & Module);
+
+    void EncodeTo(std::string & Output) const;
+
+    // replaces current contents, false if corrupt
+    bool DecodeFrom(const Slice & Block);
+
+    void Clear();
+
+    const RangeMap_t & GetRanges() const {return(m_Ranges);};
+
+    // name of meta block should the caller keep ranges in the .sst file
+    static const char * MetaBlockName() {return("riak.bucket_expiry");};
+
+protected:
+    RangeMap_t m_Ranges;
+    RangeMap_t::iterator m_Last;  // keys arrive sorted, often same bucket as last
+    std::string m_Prefix;         // key bytes through end of m_Last's bucket
+    SstCounters m_Scratch;        // holds one range while the OS callback runs
+    Range m_Initial;              // expiry counters of a new range
+
+private:
+    BucketExpiryRanges(const BucketExpiryRanges &);
+    BucketExpiryRanges & operator=(const BucketExpiryRanges &);
+
+};  // class BucketExpiryRanges
+
+
 class ExpiryModuleEE : public ExpiryModuleOS
 {
 public:
     ExpiryModuleEE()
-        : m_ExpiryModuleExpiryMicros(0)
+        : m_ExpiryModuleExpiryMicros(0), m_TombstoneMinutes(0),
+          m_PropertyNoWait(false), m_BucketSplitBytes(0),
+          m_CompactionWriteTime(false)
     {};
 
     virtual ~ExpiryModuleEE() {};
@@ -52,6 +128,9 @@ public:
     virtual void Dump(Logger * log) const;
 
     // db/write_batch.cc MemTableInserter::Put() calls this.
+    //  Riak EE:  the Riak object's last modified time is decoded here,
+    //  once, and kept in the key's expiry field (kTypeValueWriteTime).
+    //  Compaction and reads decide from the key and never decode values.
     // returns false on internal error
     virtual bool MemTableInserterCallback(
         const Slice & Key,   // input: user's key about to be written
@@ -59,18 +138,94 @@ public:
         ValueType & ValType,   // input/output: key type. call might change
         ExpiryTimeMicros & Expiry) const;  // input/output: 0 or specific expiry. call might change
 
+    // Riak EE:  db/write_batch.cc WriteBatchInternal::InsertInto() may call
+    //  this once per batch, then insert each record with its ValType / Expiry
+    //  instead of calling MemTableInserterCallback per record.  Same results,
+    //  but each composite bucket is decoded and looked up once per batch.
+    // returns false on internal error
+    bool MemTableInserterBatchCallback(
+        ExpiryBatchVector_t & Records) const;  // input/output: every record of one batch
+
+    // Riak EE:  fill Records from Batch, in batch order
+    static void GetBatchRecords(const WriteBatch & Batch, ExpiryBatchVector_t & Records);
+
     // db/dbformat.cc KeyRetirement::operator() calls this.
     // db/version_set.cc SaveValue() calls this too.
     // returns true if key is expired, returns false if key not expired
     virtual bool KeyRetirementCallback(
         const ParsedInternalKey & Ikey) const;  // input: key to examine for retirement
 
+    // Riak EE:  db/db_impl.cc DoCompactionWork() may call this for each
+    //  key it keeps (parent hookup, not in leveldb_ee).  returns true if
+    //  key should be written as ValType / Expiry instead:  with
+    //  IsCompactionWriteTime(), a kTypeValue key whose bucket now has
+    //  expiry enabled gets its Riak object's last modified time, decoded
+    //  this one time.  These are the only keys without a cached write
+    //  time.  Always false by default.
+    bool CompactionWriteTimeCallback(
+        const ParsedInternalKey & Ikey,  // input: key being written
+        const Slice & Value,             // input: its value
+        ValueType & ValType,             // output: replacement type
+        ExpiryTimeMicros & Expiry) const;  // output: replacement expiry
+
     // table/table_builder.cc TableBuilder::Add() calls this.
     // returns false on internal error
     virtual bool TableBuilderCallback(
         const Slice & key,       // input: internal key
         SstCounters & counters) const; // input/output: counters for new sst table
 
+    // Riak EE:  db/db_impl.cc DoCompactionWork() may call this before
+    //  adding each key.  returns true if the current output table should
+    //  be finished first so Key starts a new one:  Key begins a new
+    //  composite bucket or key head (object keys to 2i keys), and the
+    //  table already holds GetBucketSplitBytes().
+    bool CompactionSplitCallback(
+        const Slice & PriorKey,        // input: internal key last added, or empty
+        const Slice & Key,             // input: internal key about to be added
+        uint64_t CurrentBytes) const;  // input: current output table's size
+
+    // Riak EE:  estimated bytes of SstFile already past its bucket's
+    //  expiry minutes, taking write times as spread evenly from
+    //  exp_write_low to exp_write_high.  0 for a file that spans
+    //  buckets, see the overload below.
+    uint64_t ExpiredBytesEstimate(const FileMetaData & SstFile, ExpiryTimeMicros Now) const;
+
+    // Riak EE:  sum of each bucket's estimate from the table's
+    //  BucketExpiryRanges, the file's bytes shared by key count.
+    //  Same as above if Ranges is empty.
+    uint64_t ExpiredBytesEstimate(const FileMetaData & SstFile,
+                                  const BucketExpiryRanges & Ranges,
+                                  ExpiryTimeMicros Now) const;
+
+    // Riak EE:  db/version_set.cc VersionSet::Finalize() may call this
+    //  for each level.  returns the expired fraction (0.0 to 1.0) of the
+    //  level's bytes, BestFile set to the file with the most expired
+    //  bytes (NULL if none).  Never waits on the router.
+    double ExpiredLevelScore(const std::vector<FileMetaData *> & Files,
+                             ExpiryTimeMicros Now,
+                             const FileMetaData * & BestFile) const;
+
+    // Riak EE:  as above, with Ranges[i] the BucketExpiryRanges of
+    //  Files[i] (NULL, or past the end of Ranges, if not kept)
+    double ExpiredLevelScore(const std::vector<FileMetaData *> & Files,
+                             const std::vector<const BucketExpiryRanges *> & Ranges,
+                             ExpiryTimeMicros Now,
+                             const FileMetaData * & BestFile) const;
+
+    // Riak EE:  table/table_builder.cc TableBuilder::Add() may call this
+    //  instead, to also keep the table's expiry counters per bucket
+    bool TableBuilderCallback(
+        const Slice & Key,             // input: internal key
+        SstCounters & Counters,        // input/output: counters for new sst table
+        BucketExpiryRanges & Ranges) const;  // input/output: per bucket counters
+
+    // Riak EE:  whole file expiry of a file that may span buckets.
+    //  Every bucket in Ranges must be expired.  Same as
+    //  CompactionFinalizeCallback()'s IsFileExpired() if Ranges is empty.
+    bool IsFileExpired(const FileMetaData & SstFile,
+                       const BucketExpiryRanges & Ranges,
+                       ExpiryTimeMicros Now) const;
+
     virtual uint64_t ExpiryModuleExpiryMicros() {return(m_ExpiryModuleExpiryMicros);};
 
     // Riak EE:  stash a user created module with settings
@@ -79,6 +234,46 @@ public:
     // Riak EE:  establish timeout for things going to property cache
     void SetExpiryModuleExpiryMicros(uint64_t Expire) {m_ExpiryModuleExpiryMicros=Expire;};
 
+    // Riak EE:  minutes to keep a Riak tombstone (all siblings deleted)
+    //  before compaction may purge it.  0 disables.
+    uint64_t GetTombstoneMinutes() const {return(m_TombstoneMinutes);};
+    void SetTombstoneMinutes(uint64_t Minutes) {m_TombstoneMinutes=Minutes;};
+
+    // Riak EE:  write path does not wait on the router for missing
+    //  bucket properties.  The write uses these (database) settings
+    //  but always records a write time, properties arrive in the
+    //  background, and compaction ages the key by the bucket's settings.
+    bool IsPropertyNoWait() const {return(m_PropertyNoWait);};
+    void SetPropertyNoWait(bool Flag) {m_PropertyNoWait=Flag;};
+
+    // Riak EE:  util/prop_cache_ee.cc PropertyCache::LookupWait() asks
+    //  if the calling thread is within a no wait write path lookup
+    static bool IsThreadPropertyNoWait();
+
+    // Riak EE:  smallest compaction output table that is cut at the
+    //  next composite bucket boundary, so short lived buckets get files
+    //  of their own for whole file expiry.  0 disables.
+    uint64_t GetBucketSplitBytes() const {return(m_BucketSplitBytes);};
+    void SetBucketSplitBytes(uint64_t Bytes) {m_BucketSplitBytes=Bytes;};
+
+    // Riak EE:  compaction gives plain keys of buckets that later enabled
+    //  expiry their Riak write time (CompactionWriteTimeCallback()).
+    //  Such keys may then expire at once, so off unless asked for.
+    bool IsCompactionWriteTime() const {return(m_CompactionWriteTime);};
+    void SetCompactionWriteTime(bool Flag) {m_CompactionWriteTime=Flag;};
+
+    // Riak EE:  compaction bucket reuse statistics (all threads)
+    static void GetBucketCursorCounts(uint64_t & Hits, uint64_t & Misses);
+
+    // Riak EE:  write path bucket snapshot statistics (all threads)
+    static void GetBucketSnapshotCounts(uint64_t & Hits, uint64_t & Misses);
+
+    // Riak EE:  util/prop_cache.cc PropertyCache::Insert() must call this
+    //  after storing a bucket's properties (parent hookup, not in
+    //  leveldb_ee), so writers republish the bucket now instead of at
+    //  the next snapshot refresh, up to one second later
+    static void NoteBucketPropertiesChanged(const Slice & CompositeBucket);
+
 
 protected:
     // utility to CompactionFinalizeCallback to review
@@ -89,10 +284,29 @@ protected:
     //  open source versus enterprise edition
     virtual uint64_t GenerateWriteTimeMicros(const Slice & Key, const Slice & Value) const;
 
+    // settings table building uses for Key:  its bucket's, or this
+    const ExpiryModuleOS * TableBuilderModule(const Slice & Key) const;
+
+    // inserter work for one record once its settings (bucket or this) are known,
+    //  NoWaitFallback if this stands in for a bucket a no wait lookup missed
+    bool InserterClassify(const ExpiryModuleOS * ModuleOS, bool NoWaitFallback,
+                          const Slice & Key, const Slice & Value,
+                          ValueType & ValType, ExpiryTimeMicros & Expiry) const;
+
+    // composite buckets remembered by MemTableInserterBatchCallback()
+    static const int cBatchGroups=4;
 
 
     uint64_t m_ExpiryModuleExpiryMicros; // for bucket settings, when to flush and reload
                                          //  (zero for "unused")
+    uint64_t m_TombstoneMinutes;         // explicit expiry given to Riak tombstones
+                                         //  (zero for "unused")
+    bool m_PropertyNoWait;               // write path requests missing bucket
+                                         //  properties but does not wait
+    uint64_t m_BucketSplitBytes;         // compaction output size that cuts at
+                                         //  next bucket boundary (zero for "unused")
+    bool m_CompactionWriteTime;          // compaction adds write time to plain
+                                         //  keys of expiry enabled buckets
 private:
     ExpiryModuleEE(const ExpiryModuleEE &);  // copy blocked
 
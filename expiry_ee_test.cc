@@ -21,6 +21,7 @@
 // -------------------------------------------------------------------
 
 #include <limits.h>
+#include <stdio.h>
 #include <algorithm>
 #include <memory>
 #include <string>
@@ -41,6 +42,7 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "port/port.h"
+#include "util/coding.h"
 #include "util/mutexlock.h"
 #include "util/throttle.h"
 #include "util/prop_cache.h"
@@ -58,7 +60,9 @@ namespace leveldb {
 static void ClearMetaArray(Version::FileMetaDataVector_t & ClearMe);
 
 static bool TestRouter(EleveldbRouterActions_t Action, int ParamCount, const void ** Params);
-static volatile int gRouterCalls(0), gRouterFails(0);
+static volatile int gRouterCalls(0), gRouterFails(0), gRouterRequests(0);
+static volatile bool gRouterMute(false);  // count requests, answer none
+static volatile bool gRouterNote(false);  // report property change after insert
 
 
 /**
@@ -80,6 +84,7 @@ TestRouter(
         ExpiryPropPtr_t cache;
         ExpiryModuleEE * ee;
 
+        ++gRouterRequests;
         ee=(leveldb::ExpiryModuleEE *)ExpiryModule::CreateExpiryModule(NULL);
 
         if ('\0'==*params[0] && 0==strcmp(params[1],"hello"))
@@ -117,10 +122,35 @@ TestRouter(
             ee->SetWholeFileExpiryEnabled(true);
             use_flag=true;
         }   // else if
+        else if ('\0'==*params[0] && 0==strcmp(params[1],"tombstone"))
+        {
+            ee->SetExpiryEnabled(true);
+            ee->SetExpiryMinutes(0);
+            ee->SetWholeFileExpiryEnabled(false);
+            ee->SetTombstoneMinutes(10);
+            use_flag=true;
+        }   // else if
+        else if(0==strcmp(params[0],"type_two") && 0==strcmp(params[1],"racer"))
+        {
+            ee->SetExpiryEnabled(true);
+            ee->SetExpiryMinutes(20);
+            ee->SetWholeFileExpiryEnabled(false);
+            use_flag=true;
+        }   // else if
+        else if ('\0'==*params[0] && 0==strcmp(params[1],"tombstone_aged"))
+        {
+            ee->SetExpiryEnabled(true);
+            ee->SetExpiryMinutes(30);
+            ee->SetWholeFileExpiryEnabled(false);
+            ee->SetTombstoneMinutes(10);
+            use_flag=true;
+        }   // else if
 
-        if (use_flag)
+        if (use_flag && !gRouterMute)
         {
             ret_flag=cache.Insert(*(Slice *)Params[2], (ExpiryModuleOS*)ee);
+            if (ret_flag && gRouterNote)
+                ExpiryModuleEE::NoteBucketPropertiesChanged(*(Slice *)Params[2]);
             if (ret_flag)
                 ++gRouterCalls;
             else
@@ -589,6 +619,559 @@ TEST(ExpiryEETester, MemTableCallback)
 }   // test MemTableCallback
 
 
+/**
+ * Validate that Riak tombstones in a bucket with tombstone
+ *  minutes become explicit expiry keys
+ */
+TEST(ExpiryEETester, TombstoneMinutes)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    ValueType type;
+    ExpiryTimeMicros expiry;
+    uint64_t now;
+    std::string key_string, tombstone, live;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(0);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+
+    flag=BuildRiakObject("", now, 2, true, tombstone);
+    ASSERT_TRUE(flag);
+    flag=BuildRiakObject("data", now, 2, false, live);
+    ASSERT_TRUE(flag);
+
+    // tombstone in bucket with 10 minute tombstone setting
+    flag=BuildRiakKey("", "tombstone", "key1", key_string);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, tombstone, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValueExplicitExpiry);
+    ASSERT_EQ(expiry, now + 10*60*port::UINT64_ONE_SECOND_MICROS);
+
+    ParsedInternalKey ikey(key_string, expiry, 1, type);
+    ASSERT_EQ(module.KeyRetirementCallback(ikey), false);
+    SetCachedTimeMicros(now + 11*60*port::UINT64_ONE_SECOND_MICROS);
+    ASSERT_EQ(module.KeyRetirementCallback(ikey), true);
+    SetCachedTimeMicros(now);
+
+    // live object, same bucket, untouched
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, live, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValue);
+    ASSERT_EQ(expiry, 0);
+
+    // live object where both tombstone and aged expiry apply:  write
+    //  time comes from the object parsed for the tombstone test
+    flag=BuildRiakObject("data", now - 5*port::UINT64_ONE_SECOND_MICROS, 2, false, live);
+    ASSERT_TRUE(flag);
+    flag=BuildRiakKey("", "tombstone_aged", "key1", key_string);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, live, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValueWriteTime);
+    ASSERT_EQ(expiry, now - 5*port::UINT64_ONE_SECOND_MICROS);
+
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, tombstone, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValueExplicitExpiry);
+    ASSERT_EQ(expiry, now + 10*60*port::UINT64_ONE_SECOND_MICROS);
+
+    // tombstone in bucket without tombstone setting
+    flag=BuildRiakKey("", "dolly", "key1", key_string);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, tombstone, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValue);
+    ASSERT_EQ(expiry, 0);
+
+}   // test TombstoneMinutes
+
+
+/**
+ * Validate that the batch inserter callback gives each record
+ *  the same result as the per record callback
+ */
+TEST(ExpiryEETester, MemTableInserterBatchCallback)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    ExpiryBatchVector_t records, original;
+    WriteBatch batch;
+    ValueType type;
+    ExpiryTimeMicros expiry;
+    uint64_t now;
+    size_t loop;
+    int set_size, set;
+    std::string key_string, tombstone, live;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(30);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+
+    flag=BuildRiakObject("", now, 2, true, tombstone);
+    ASSERT_TRUE(flag);
+    flag=BuildRiakObject("data", now, 2, false, live);
+    ASSERT_TRUE(flag);
+
+    // more buckets than cBatchGroups, revisited out of order,
+    //  plus tombstones, deletes, 2i entries, and a non-Riak key
+    set_size=sizeof(Set1)/sizeof(Set1[0]);
+    for (set=0; set<2*set_size; ++set)
+    {
+        flag=BuildRiakKey(Set1[(set*3) % set_size].m_BucketType,
+                          Set1[(set*3) % set_size].m_Bucket, "Text", key_string);
+        ASSERT_TRUE(flag);
+        batch.Put(key_string, live);
+        batch.Put(key_string, tombstone);
+        batch.Delete(key_string);
+
+        flag=BuildRiakIndexKey(Set1[(set*3) % set_size].m_BucketType,
+                               Set1[(set*3) % set_size].m_Bucket,
+                               "field_bin", "term", "Text", key_string);
+        ASSERT_TRUE(flag);
+        batch.Put(key_string, Slice());
+    }   // for
+
+    flag=BuildRiakKey("", "tombstone", "key1", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, tombstone);
+    batch.Put("not a riak key", live);
+
+    ExpiryModuleEE::GetBatchRecords(batch, records);
+    ASSERT_EQ(8*set_size + 2, (int)records.size());
+    original=records;
+
+    flag=module.MemTableInserterBatchCallback(records);
+    ASSERT_EQ(flag, true);
+
+    for (loop=0; loop<records.size(); ++loop)
+    {
+        type=original[loop].m_ValType;
+        expiry=original[loop].m_Expiry;
+        flag=module.MemTableInserterCallback(records[loop].m_Key, records[loop].m_Value,
+                                             type, expiry);
+        ASSERT_EQ(flag, true);
+        ASSERT_EQ(type, records[loop].m_ValType);
+        ASSERT_EQ(expiry, records[loop].m_Expiry);
+    }   // for
+
+    // tombstone bucket's setting reached through batch path
+    ASSERT_EQ(kTypeValueExplicitExpiry, records[records.size()-2].m_ValType);
+
+}   // test MemTableInserterBatchCallback
+
+
+/**
+ * Validate that sorted keys of one bucket reuse the thread's
+ *  bucket cursor instead of decoding and looking up each key,
+ *  and that recent buckets are found again by bucket ID
+ */
+TEST(ExpiryEETester, BucketCursor)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    int loop, router_count, router_fail;
+    uint64_t hits, misses, hits_after, misses_after, now;
+    std::string key_string;
+    char key_text[16];
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(5);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+    router_count=gRouterCalls;
+    router_fail=gRouterFails;
+    ExpiryModuleEE::GetBucketCursorCounts(hits, misses);
+
+    // 100 sorted keys in bucket with 15 minute expiry, aged 20 minutes
+    for (loop=0; loop<100; ++loop)
+    {
+        snprintf(key_text, sizeof(key_text), "key%04d", loop);
+        flag=BuildRiakKey("type_two", "dos_equis", key_text, key_string);
+        ASSERT_TRUE(flag);
+
+        ParsedInternalKey ikey(key_string, now - 20*60*port::UINT64_ONE_SECOND_MICROS,
+                               loop, kTypeValueWriteTime);
+        flag=module.KeyRetirementCallback(ikey);
+        ASSERT_EQ(flag, true);
+    }   // for
+
+    // at most one router trip to load dos_equis
+    ASSERT_TRUE(gRouterCalls <= router_count+1);
+
+    // different bucket (unlimited) ends the run and publishes counts
+    flag=BuildRiakKey("", "hello", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    ParsedInternalKey hello_key(key_string, now - 20*60*port::UINT64_ONE_SECOND_MICROS,
+                                100, kTypeValueWriteTime);
+    flag=module.KeyRetirementCallback(hello_key);
+    ASSERT_EQ(flag, false);
+
+    ExpiryModuleEE::GetBucketCursorCounts(hits_after, misses_after);
+    ASSERT_TRUE(hits+99 <= hits_after);
+    ASSERT_TRUE(misses_after <= misses+2);
+
+    // at most one more to load hello
+    ASSERT_TRUE(gRouterCalls <= router_count+2);
+    ASSERT_EQ(router_fail, gRouterFails);
+
+    // keys alternating between the two buckets (a merge of two
+    //  tables, or reads) find both by bucket ID, no lookups
+    router_count=gRouterCalls;
+    ExpiryModuleEE::GetBucketCursorCounts(hits, misses);
+    for (loop=0; loop<100; ++loop)
+    {
+        snprintf(key_text, sizeof(key_text), "key%04d", loop);
+        flag=BuildRiakKey(0==(loop & 1) ? "type_two" : "",
+                          0==(loop & 1) ? "dos_equis" : "hello", key_text, key_string);
+        ASSERT_TRUE(flag);
+
+        ParsedInternalKey ikey(key_string, now - 20*60*port::UINT64_ONE_SECOND_MICROS,
+                               loop, kTypeValueWriteTime);
+        flag=module.KeyRetirementCallback(ikey);
+        ASSERT_EQ(flag, 0==(loop & 1));
+    }   // for
+
+    // a different bucket publishes this thread's hits
+    flag=BuildRiakKey("type_one", "free", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    ParsedInternalKey free_key(key_string, now, 101, kTypeValueWriteTime);
+    module.KeyRetirementCallback(free_key);
+
+    ExpiryModuleEE::GetBucketCursorCounts(hits_after, misses_after);
+    ASSERT_TRUE(hits+100 <= hits_after);
+    ASSERT_TRUE(misses_after <= misses+1);
+    ASSERT_TRUE(gRouterCalls <= router_count+1);
+    ASSERT_EQ(router_fail, gRouterFails);
+
+}   // test BucketCursor
+
+
+/**
+ * Validate that writes find bucket settings in the published
+ *  snapshot after the first write of each bucket, and that a
+ *  property change or an old entry goes back to the property cache
+ */
+TEST(ExpiryEETester, BucketSnapshot)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    int loop, router_fail;
+    uint64_t hits, misses, hits_after, misses_after, now;
+    std::string key_string, value;
+    char key_text[16];
+    ValueType type, first_type[2];
+    ExpiryTimeMicros expiry;
+    Slice composite_bucket;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(30);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+    router_fail=gRouterFails;
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits, misses);
+
+    flag=BuildRiakObject("data", now, 1, false, value);
+    ASSERT_TRUE(flag);
+
+    // writes alternating between two buckets, first of each loads
+    for (loop=0; loop<100; ++loop)
+    {
+        snprintf(key_text, sizeof(key_text), "key%04d", loop);
+        flag=BuildRiakKey(0==(loop & 1) ? "type_two" : "",
+                          0==(loop & 1) ? "dos_equis" : "hello", key_text, key_string);
+        ASSERT_TRUE(flag);
+
+        type=kTypeValue;
+        expiry=0;
+        flag=module.MemTableInserterCallback(key_string, value, type, expiry);
+        ASSERT_EQ(flag, true);
+
+        if (loop<2)
+            first_type[loop]=type;
+        else
+            ASSERT_EQ(first_type[loop & 1], type);
+    }   // for
+
+    // bucket without properties misses, and publishes thread's hits
+    flag=BuildRiakKey("type_two", "odouls", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits_after, misses_after);
+    ASSERT_TRUE(hits+98 <= hits_after);
+    ASSERT_TRUE(misses_after <= misses+3);
+    ASSERT_EQ(router_fail, gRouterFails);
+
+    // property change drops dos_equis from snapshot, next write misses
+    flag=BuildRiakKey("type_two", "dos_equis", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    flag=KeyGetBucket(key_string, composite_bucket);
+    ASSERT_TRUE(flag);
+    ExpiryModuleEE::NoteBucketPropertiesChanged(composite_bucket);
+
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits, misses);
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(first_type[0], type);
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits_after, misses_after);
+    ASSERT_EQ(misses+1, misses_after);
+
+    // old entry is confirmed against property cache, same result
+    SetCachedTimeMicros(now + 2*port::UINT64_ONE_SECOND_MICROS);
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(first_type[0], type);
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits, misses);
+    ASSERT_EQ(misses_after+1, misses);
+
+    // property change during the lookup:  result is used, not published
+    flag=BuildRiakKey("type_two", "racer", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    gRouterNote=true;
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    gRouterNote=false;
+    ASSERT_EQ(kTypeValueWriteTime, type);
+
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(kTypeValueWriteTime, type);
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits_after, misses_after);
+    ASSERT_EQ(misses+2, misses_after);
+
+    // no change during this lookup, so published and next write hits
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ExpiryModuleEE::GetBucketSnapshotCounts(hits, misses);
+    ASSERT_EQ(misses_after, misses);
+
+    SetCachedTimeMicros(port::TimeMicros());
+
+}   // test BucketSnapshot
+
+
+/**
+ * Validate that a no wait write of a bucket without cached
+ *  properties uses database settings and requests the bucket
+ *  from the router only once while the request is in flight
+ */
+TEST(ExpiryEETester, PropertyNoWait)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    int request_count;
+    uint64_t now;
+    std::string key_string, value;
+    ValueType type;
+    ExpiryTimeMicros expiry;
+    WriteBatch batch;
+    ExpiryBatchVector_t records;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(30);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+
+    flag=BuildRiakObject("data", now, 1, false, value);
+    ASSERT_TRUE(flag);
+
+    // router never answers for odouls, waiting writes ask every time
+    flag=BuildRiakKey("type_two", "odouls", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    request_count=gRouterRequests;
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(request_count+2, gRouterRequests);
+
+    // no wait writes ask once, still use database settings
+    module.SetPropertyNoWait(true);
+    ASSERT_TRUE(!ExpiryModuleEE::IsThreadPropertyNoWait());
+    request_count=gRouterRequests;
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(kTypeValueWriteTime, type);
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(kTypeValueWriteTime, type);
+    ASSERT_EQ(request_count+1, gRouterRequests);
+
+    // and again once the request is old
+    SetCachedTimeMicros(now + 2*port::UINT64_ONE_SECOND_MICROS);
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(request_count+2, gRouterRequests);
+
+    // database tombstone setting never converts a no wait fallback,
+    //  the bucket's own settings are not known yet
+    module.SetTombstoneMinutes(10);
+    flag=BuildRiakObject("", now, 1, true, value);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(kTypeValueWriteTime, type);
+    module.SetTombstoneMinutes(0);
+
+    // database settings that never age keys still record write time,
+    //  else compaction could not apply the bucket's settings later
+    module.SetExpiryMinutes(0);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(kTypeValueWriteTime, type);
+    ASSERT_TRUE(0!=expiry);
+    module.SetExpiryMinutes(30);
+
+    // a router that posts during its call still gives bucket settings
+    flag=BuildRiakKey("", "tombstone", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    flag=BuildRiakObject("", now, 1, true, value);
+    ASSERT_TRUE(flag);
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    ASSERT_EQ(kTypeValueExplicitExpiry, type);
+
+    // batch:  tombstone's snapshot hit reuses the odouls fallback
+    //  group's slot, and must not inherit its fallback
+    flag=BuildRiakKey("type_two", "odouls", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, value);
+    flag=BuildRiakKey("", "hello", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, value);
+    flag=BuildRiakKey("", "dolly", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, value);
+    flag=BuildRiakKey("type_one", "free", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, value);
+    flag=BuildRiakKey("", "tombstone", "key0000", key_string);
+    ASSERT_TRUE(flag);
+    batch.Put(key_string, value);
+    ExpiryModuleEE::GetBatchRecords(batch, records);
+    module.SetTombstoneMinutes(10);
+    flag=module.MemTableInserterBatchCallback(records);
+    module.SetTombstoneMinutes(0);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(5, (int)records.size());
+    ASSERT_EQ(kTypeValueWriteTime, records[0].m_ValType);
+    ASSERT_EQ(kTypeValueExplicitExpiry, records[4].m_ValType);
+
+    // property cache object (5 minute life, earlier tests ran the clock
+    //  ahead) and snapshot entry both aged out, router silent:  bucket's
+    //  last known settings, not database settings
+    SetCachedTimeMicros(now + 60*60*port::UINT64_ONE_SECOND_MICROS);
+    gRouterMute=true;
+    type=kTypeValue;
+    expiry=0;
+    module.MemTableInserterCallback(key_string, value, type, expiry);
+    gRouterMute=false;
+    ASSERT_EQ(kTypeValueExplicitExpiry, type);
+
+    SetCachedTimeMicros(port::TimeMicros());
+
+}   // test PropertyNoWait
+
+
+/**
+ * Validate that compaction leaves plain keys alone by default, and
+ *  with the option gives them a write time once their bucket
+ *  enables expiry
+ */
+TEST(ExpiryEETester, CompactionWriteTimeCallback)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    ValueType type;
+    ExpiryTimeMicros expiry;
+    uint64_t now, written;
+    std::string key_string, object;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(5);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+    written=now - 20*60*port::UINT64_ONE_SECOND_MICROS;
+    flag=BuildRiakObject("data", written, 2, false, object);
+    ASSERT_TRUE(flag);
+
+    // bucket with 15 minute expiry:  default keeps the plain key
+    flag=BuildRiakKey("type_two", "dos_equis", "key1", key_string);
+    ASSERT_TRUE(flag);
+    ParsedInternalKey plain_key(key_string, 0, 1, kTypeValue);
+    ASSERT_EQ(module.KeyRetirementCallback(plain_key), false);
+
+    ASSERT_EQ(module.IsCompactionWriteTime(), false);
+    type=kTypeValue;
+    expiry=0;
+    flag=module.CompactionWriteTimeCallback(plain_key, object, type, expiry);
+    ASSERT_EQ(flag, false);
+    ASSERT_EQ(type, kTypeValue);
+    ASSERT_EQ(expiry, 0);
+
+    // with option, key gains write time, then expires
+    module.SetCompactionWriteTime(true);
+    flag=module.CompactionWriteTimeCallback(plain_key, object, type, expiry);
+    ASSERT_EQ(flag, true);
+    ASSERT_EQ(type, kTypeValueWriteTime);
+    ASSERT_EQ(expiry, written);
+
+    ParsedInternalKey write_key(key_string, expiry, 1, type);
+    ASSERT_EQ(module.KeyRetirementCallback(write_key), true);
+
+    // already has write time, not a Riak object
+    ASSERT_EQ(module.CompactionWriteTimeCallback(write_key, object, type, expiry), false);
+    ASSERT_EQ(module.CompactionWriteTimeCallback(plain_key, "not riak", type, expiry), false);
+
+    // bucket with expiry disabled
+    flag=BuildRiakKey("type_one", "wild", "key1", key_string);
+    ASSERT_TRUE(flag);
+    ParsedInternalKey wild_key(key_string, 0, 1, kTypeValue);
+    ASSERT_EQ(module.CompactionWriteTimeCallback(wild_key, object, type, expiry), false);
+
+}   // test CompactionWriteTimeCallback
+
+
 /**
  * Wrapper class to Version that allows manipulation
  *  of internal objects for testing purposes
@@ -793,6 +1376,320 @@ TEST(ExpiryEETester, CompactionFinalizeCallback1)
 }   // test CompactionFinalizeCallback
 
 
+/**
+ * Validate that per bucket expiry ranges let whole file expiry
+ *  judge files whose first and last keys are in different buckets
+ */
+TEST(ExpiryEETester, BucketExpiryRanges)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    BucketExpiryRanges ranges, decoded, mixed;
+    SstCounters counters;
+    FileMetaData file;
+    InternalKey ikey;
+    std::string key_string, block;
+    uint64_t now, aged;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(5);
+    module.SetWholeFileExpiryEnabled(true);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+    aged=now - 20*60*port::UINT64_ONE_SECOND_MICROS;
+
+    // dos_equis (15 minutes) object then its 2i key:  one bucket, but
+    //  first and last key heads differ.  counters count each key before
+    //  its callback, as TableBuilder::Add() does
+    flag=BuildRiakKey("type_two", "dos_equis", "AA1", key_string);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(key_string, aged, 1, kTypeValueWriteTime));
+    file.smallest=ikey;
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, ranges);
+
+    flag=BuildRiakIndexKey("type_two", "dos_equis", "field_bin", "term", "AA1", key_string);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(key_string, aged, 2, kTypeValueWriteTime));
+    file.largest=ikey;
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, ranges);
+
+    file.exp_write_low=counters.Value(eSstCountExpiry1);
+    file.exp_write_high=counters.Value(eSstCountExpiry2);
+    file.exp_explicit_high=counters.Value(eSstCountExpiry3);
+
+    ASSERT_EQ(1, (int)ranges.GetRanges().size());
+    ASSERT_EQ(aged, ranges.GetRanges().begin()->second.m_WriteLow);
+    ASSERT_EQ(aged, ranges.GetRanges().begin()->second.m_WriteHigh);
+    ASSERT_EQ((ExpiryTimeMicros)0, ranges.GetRanges().begin()->second.m_ExplicitHigh);
+    ASSERT_EQ(2, (int)ranges.GetRanges().begin()->second.m_Keys);
+    ASSERT_EQ(false, module.IsFileExpired(file, decoded, now));
+    ASSERT_EQ(true, module.IsFileExpired(file, ranges, now));
+
+    // block round trip
+    ranges.EncodeTo(block);
+    flag=decoded.DecodeFrom(block);
+    ASSERT_TRUE(flag);
+    ASSERT_EQ(1, (int)decoded.GetRanges().size());
+    ASSERT_EQ(2, (int)decoded.GetRanges().begin()->second.m_Keys);
+    ASSERT_EQ(true, module.IsFileExpired(file, decoded, now));
+    flag=decoded.DecodeFrom(Slice(block.data(), block.size()-1));
+    ASSERT_TRUE(!flag);
+    ASSERT_EQ(0, (int)decoded.GetRanges().size());
+
+    // version 1 block, no key counts
+    block.clear();
+    PutVarint32(&block, 1);
+    PutVarint64(&block, 1);
+    PutLengthPrefixedSlice(&block, ranges.GetRanges().begin()->first);
+    PutVarint64(&block, aged);
+    PutVarint64(&block, aged);
+    PutVarint64(&block, 0);
+    flag=decoded.DecodeFrom(block);
+    ASSERT_TRUE(flag);
+    ASSERT_EQ(0, (int)decoded.GetRanges().begin()->second.m_Keys);
+    ASSERT_EQ(true, module.IsFileExpired(file, decoded, now));
+
+    // not yet 15 minutes old
+    ASSERT_EQ(false, module.IsFileExpired(file, ranges,
+                                          aged + 10*60*port::UINT64_ONE_SECOND_MICROS));
+
+    // add a non-Riak key, default settings (5 minutes) decide it
+    ikey.SetFrom(ParsedInternalKey("zz not riak", aged, 3, kTypeValueWriteTime));
+    file.largest=ikey;
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, ranges);
+    ASSERT_EQ(2, (int)ranges.GetRanges().size());
+    ASSERT_EQ(true, module.IsFileExpired(file, ranges, now));
+
+    // type_one/free has no whole file expiry, holds up entire file
+    flag=BuildRiakKey("type_two", "dos_equis", "BB1", key_string);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(key_string, aged, 4, kTypeValueWriteTime));
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, mixed);
+    flag=BuildRiakKey("type_one", "free", "BB1", key_string);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(key_string, aged, 5, kTypeValueWriteTime));
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, mixed);
+    ASSERT_EQ(2, (int)mixed.GetRanges().size());
+    ASSERT_EQ(false, module.IsFileExpired(file, mixed, now));
+
+    // a plain key (no expiry) among the non-Riak keys keeps the file
+    ikey.SetFrom(ParsedInternalKey("zz not riak", 0, 6, kTypeValue));
+    counters.Inc(eSstCountKeys);
+    module.TableBuilderCallback(ikey.Encode(), counters, ranges);
+    ASSERT_EQ(false, module.IsFileExpired(file, ranges, now));
+
+}   // test BucketExpiryRanges
+
+
+/**
+ * Validate that compaction output is cut only at composite bucket
+ *  boundaries, and only once the table reaches the split size
+ */
+TEST(ExpiryEETester, CompactionSplitCallback)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    InternalKey prior, free_key, free_index, dos_key;
+    std::string key_string;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(5);
+    module.SetWholeFileExpiryEnabled(true);
+
+    flag=BuildRiakKey("type_one", "free", "AA1", key_string);
+    ASSERT_TRUE(flag);
+    prior.SetFrom(ParsedInternalKey(key_string, 0, 1, kTypeValue));
+    flag=BuildRiakKey("type_one", "free", "BB1", key_string);
+    ASSERT_TRUE(flag);
+    free_key.SetFrom(ParsedInternalKey(key_string, 0, 2, kTypeValue));
+    flag=BuildRiakIndexKey("type_one", "free", "field_bin", "term", "AA1", key_string);
+    ASSERT_TRUE(flag);
+    free_index.SetFrom(ParsedInternalKey(key_string, 0, 3, kTypeValue));
+    flag=BuildRiakKey("type_two", "dos_equis", "AA1", key_string);
+    ASSERT_TRUE(flag);
+    dos_key.SetFrom(ParsedInternalKey(key_string, 0, 4, kTypeValue));
+
+    // disabled by default
+    ASSERT_EQ(false, module.CompactionSplitCallback(prior.Encode(), dos_key.Encode(), 1 << 30));
+
+    module.SetBucketSplitBytes(1 << 20);
+    ASSERT_EQ(false, module.CompactionSplitCallback(prior.Encode(), dos_key.Encode(), (1 << 20) - 1));
+    ASSERT_EQ(true, module.CompactionSplitCallback(prior.Encode(), dos_key.Encode(), 1 << 20));
+
+    // same bucket and key head never cut
+    ASSERT_EQ(false, module.CompactionSplitCallback(prior.Encode(), free_key.Encode(), 1 << 30));
+    ASSERT_EQ(false, module.CompactionSplitCallback(free_index.Encode(), free_index.Encode(), 1 << 30));
+
+    // same bucket's object keys to its 2i keys is a cut, other
+    //  buckets' object keys sort between them
+    ASSERT_EQ(true, module.CompactionSplitCallback(prior.Encode(), free_index.Encode(), 1 << 30));
+    ASSERT_EQ(true, module.CompactionSplitCallback(dos_key.Encode(), free_index.Encode(), 1 << 30));
+
+    // first key of a table, and Riak to non-Riak
+    ASSERT_EQ(false, module.CompactionSplitCallback(Slice(), dos_key.Encode(), 1 << 30));
+    ASSERT_EQ(true, module.CompactionSplitCallback(dos_key.Encode(), Slice("zz not riak"), 1 << 30));
+
+    // expiry off, splits have no use
+    module.SetExpiryEnabled(false);
+    ASSERT_EQ(false, module.CompactionSplitCallback(prior.Encode(), dos_key.Encode(), 1 << 30));
+
+}   // test CompactionSplitCallback
+
+
+/**
+ * Validate expired byte estimates and level score from file
+ *  write time ranges and bucket expiry minutes
+ */
+TEST(ExpiryEETester, ExpiredLevelScore)
+{
+    bool flag;
+    ExpiryModuleEE module;
+    Version::FileMetaDataVector_t files;
+    FileMetaData * file_ptr, span;
+    const FileMetaData * best;
+    std::string user_key;
+    uint64_t now, minute;
+    double score;
+    BucketExpiryRanges span_ranges;
+    SstCounters counters;
+    InternalKey ikey;
+    int loop;
+    char key_text[16];
+    std::vector<FileMetaData *> span_files;
+    std::vector<const BucketExpiryRanges *> ranges_vector;
+
+    module.SetExpiryEnabled(true);
+    module.SetExpiryMinutes(5);
+    module.SetWholeFileExpiryEnabled(false);
+
+    now=port::TimeMicros();
+    SetCachedTimeMicros(now);
+    minute=60*port::UINT64_ONE_SECOND_MICROS;
+
+    // dos_equis (15 minutes), half of write time range aged
+    file_ptr=new FileMetaData;
+    flag=BuildRiakKey("type_two", "dos_equis", "AA1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->smallest.SetFrom(ParsedInternalKey(user_key, 0, 1, kTypeValue));
+    flag=BuildRiakKey("type_two", "dos_equis", "BB1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->largest.SetFrom(ParsedInternalKey(user_key, 0, 2, kTypeValue));
+    file_ptr->file_size=1000;
+    file_ptr->exp_write_low=now - 25*minute;
+    file_ptr->exp_write_high=now - 5*minute;
+    files.push_back(file_ptr);
+    ASSERT_EQ(500, (int)module.ExpiredBytesEstimate(*file_ptr, now));
+
+    // dos_equis, all aged
+    file_ptr=new FileMetaData;
+    flag=BuildRiakKey("type_two", "dos_equis", "CC1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->smallest.SetFrom(ParsedInternalKey(user_key, 0, 3, kTypeValue));
+    flag=BuildRiakKey("type_two", "dos_equis", "DD1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->largest.SetFrom(ParsedInternalKey(user_key, 0, 4, kTypeValue));
+    file_ptr->file_size=1000;
+    file_ptr->exp_write_low=now - 30*minute;
+    file_ptr->exp_write_high=now - 20*minute;
+    files.push_back(file_ptr);
+    ASSERT_EQ(1000, (int)module.ExpiredBytesEstimate(*file_ptr, now));
+
+    // hello is unlimited, nothing expires
+    file_ptr=new FileMetaData;
+    flag=BuildRiakKey("", "hello", "EE1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->smallest.SetFrom(ParsedInternalKey(user_key, 0, 5, kTypeValue));
+    flag=BuildRiakKey("", "hello", "FF1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->largest.SetFrom(ParsedInternalKey(user_key, 0, 6, kTypeValue));
+    file_ptr->file_size=1000;
+    file_ptr->exp_write_low=now - 30*minute;
+    file_ptr->exp_write_high=now - 20*minute;
+    files.push_back(file_ptr);
+    ASSERT_EQ(0, (int)module.ExpiredBytesEstimate(*file_ptr, now));
+
+    // two buckets, default 5 minutes, but plain keys give no estimate
+    file_ptr=new FileMetaData;
+    flag=BuildRiakKey("", "hello", "GG1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->smallest.SetFrom(ParsedInternalKey(user_key, 0, 7, kTypeValue));
+    flag=BuildRiakKey("type_two", "dos_equis", "HH1", user_key);
+    ASSERT_TRUE(flag);
+    file_ptr->largest.SetFrom(ParsedInternalKey(user_key, 0, 8, kTypeValue));
+    file_ptr->file_size=1000;
+    file_ptr->exp_write_low=ULLONG_MAX;
+    file_ptr->exp_write_high=now - 20*minute;
+    files.push_back(file_ptr);
+    ASSERT_EQ(0, (int)module.ExpiredBytesEstimate(*file_ptr, now));
+
+    // hello object through hello 2i key spans other buckets, no
+    //  estimate without the table's bucket ranges
+    flag=BuildRiakKey("", "hello", "II1", user_key);
+    ASSERT_TRUE(flag);
+    span.smallest.SetFrom(ParsedInternalKey(user_key, 0, 9, kTypeValue));
+    flag=BuildRiakIndexKey("", "hello", "field_bin", "term", "II1", user_key);
+    ASSERT_TRUE(flag);
+    span.largest.SetFrom(ParsedInternalKey(user_key, 0, 10, kTypeValue));
+    span.file_size=1000;
+    span.exp_write_low=now - 30*minute;
+    span.exp_write_high=now - 20*minute;
+    ASSERT_EQ(0, (int)module.ExpiredBytesEstimate(span, now));
+    ASSERT_EQ(0, (int)module.ExpiredBytesEstimate(span, span_ranges, now));
+
+    // with ranges:  hello (unlimited) 1 key, dos_equis (15 minutes) 3
+    //  keys all aged, type_two/nobody (no properties) 1 key
+    flag=BuildRiakKey("", "hello", "II1", user_key);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(user_key, now - 30*minute, 11, kTypeValueWriteTime));
+    module.TableBuilderCallback(ikey.Encode(), counters, span_ranges);
+    for (loop=0; loop<3; ++loop)
+    {
+        snprintf(key_text, sizeof(key_text), "JJ%d", loop);
+        flag=BuildRiakKey("type_two", "dos_equis", key_text, user_key);
+        ASSERT_TRUE(flag);
+        ikey.SetFrom(ParsedInternalKey(user_key, now - 20*minute, 12+loop, kTypeValueWriteTime));
+        module.TableBuilderCallback(ikey.Encode(), counters, span_ranges);
+    }   // for
+    flag=BuildRiakKey("type_two", "nobody", "KK1", user_key);
+    ASSERT_TRUE(flag);
+    ikey.SetFrom(ParsedInternalKey(user_key, now - 30*minute, 15, kTypeValueWriteTime));
+    module.TableBuilderCallback(ikey.Encode(), counters, span_ranges);
+    ASSERT_EQ(3, (int)span_ranges.GetRanges().size());
+    ASSERT_EQ(600, (int)module.ExpiredBytesEstimate(span, span_ranges, now));
+    ASSERT_EQ(0, (int)module.ExpiredBytesEstimate(span, span_ranges, now - 60*minute));
+
+    span_files.push_back(&span);
+    ranges_vector.push_back(&span_ranges);
+    score=module.ExpiredLevelScore(span_files, ranges_vector, now, best);
+    ASSERT_TRUE(0.599<score && score<0.601);
+    ASSERT_TRUE(&span==best);
+
+    score=module.ExpiredLevelScore(files, now, best);
+    ASSERT_TRUE(0.374<score && score<0.376);
+    ASSERT_TRUE(files[1]==best);
+
+    // nothing aged yet
+    score=module.ExpiredLevelScore(files, now - 60*minute, best);
+    ASSERT_TRUE(0.0==score);
+    ASSERT_TRUE(NULL==best);
+
+    // expiry off
+    module.SetExpiryEnabled(false);
+    score=module.ExpiredLevelScore(files, now, best);
+    ASSERT_TRUE(0.0==score);
+    ASSERT_TRUE(NULL==best);
+
+    ClearMetaArray(files);
+
+}   // test ExpiredLevelScore
+
+
 /**
  * Note:  constructor and destructor NOT called, this is
  *        an interface class only
@@ -22,8 +22,11 @@
 
 #include <sys/time.h>
 #include <unistd.h>
+#include <map>
+#include <string>
 
 #include "util/prop_cache.h"
+#include "leveldb_ee/expiry_ee.h"
 #include "leveldb_ee/riak_object.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -31,32 +34,96 @@
 
 namespace leveldb {
 
+// buckets requested by no wait lookups, and when.  Keeps writers from
+//  sending one router request per write while properties are in
+//  flight.  Protected by PropertyCache::m_Mutex.
+static std::map<std::string, uint64_t> gNoWaitRequests;
+
+// resend a no wait request not answered within this time
+static const uint64_t kNoWaitRetryMicros=port::UINT64_ONE_SECOND_MICROS;
+
+// forget all requests once this many are outstanding
+static const size_t kNoWaitRequestsMax=1024;
+
 
 /**
  * Internal Lookup function that first requests property
  *  data from Eleveldb Router, then waits for the data
  *  to post to the cache.
+ *
+ * Riak EE:  a write path lookup with ExpiryModuleEE::IsPropertyNoWait()
+ *  only requests the data.  It returns NULL unless the router posted
+ *  during its own call, so the write never includes a router round
+ *  trip.  The writer uses database settings but stamps a write time
+ *  (ExpiryModuleEE::InserterClassify()), so compaction can age the
+ *  key by the bucket's settings once they are cached.
  */
 Cache::Handle *
 PropertyCache::LookupWait(
     const Slice & CompositeBucket)
 {
     Cache::Handle * ret_handle(NULL);
+    char parse_buffer[256];
+    Slice type_slice, bucket_slice;
     std::string type, bucket;
     const void * params[4];
-    bool flag;
+    bool flag, no_wait;
 
-    // split composite to pass to Riak
-    KeyParseBucket(CompositeBucket, type, bucket);
+    flag=true;
+    no_wait=ExpiryModuleEE::IsThreadPropertyNoWait();
 
-    params[0]=type.c_str();
-    params[1]=bucket.c_str();
-    params[2]=(void *)&CompositeBucket;
-    params[3]=NULL;
-    flag=m_Router(eGetBucketProperties, 3, params);
+    // request already in flight?
+    if (no_wait)
+    {
+        std::map<std::string, uint64_t>::iterator it;
+        std::string key(CompositeBucket.data(), CompositeBucket.size());
+        uint64_t now;
+
+        MutexLock lock(&m_Mutex);
+        now=GetCachedTimeMicros();
+
+        it=gNoWaitRequests.find(key);
+        flag=(gNoWaitRequests.end()==it || kNoWaitRetryMicros<=(now - it->second));
+
+        if (flag)
+        {
+            if (kNoWaitRequestsMax<=gNoWaitRequests.size())
+                gNoWaitRequests.clear();
+            gNoWaitRequests[key]=now;
+        }   // if
+    }   // if
 
-    // proceed with wait loop if router call successfull
     if (flag)
+    {
+        // split composite to pass to Riak.  Names normally fit
+        //  the stack buffer, only oversized names use the heap
+        if (KeyParseBucket(CompositeBucket, parse_buffer, sizeof(parse_buffer),
+                           type_slice, bucket_slice))
+        {
+            params[0]=type_slice.data();
+            params[1]=bucket_slice.data();
+        }   // if
+        else
+        {
+            KeyParseBucket(CompositeBucket, type, bucket);
+            params[0]=type.c_str();
+            params[1]=bucket.c_str();
+        }   // else
+
+        params[2]=(void *)&CompositeBucket;
+        params[3]=NULL;
+        flag=m_Router(eGetBucketProperties, 3, params);
+    }   // if
+
+    // router may have posted before returning
+    if (flag && no_wait)
+    {
+        MutexLock lock(&m_Mutex);
+        ret_handle=m_Cache->Lookup(CompositeBucket);
+    }   // if
+
+    // proceed with wait loop if router call successfull
+    else if (flag)
     {
         do
         {
@@ -0,0 +1,562 @@
+// -------------------------------------------------------------------
+//
+// riak_bench.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+// Benchmark driver for Riak shaped data.  db_bench writes plain keys
+//  and values, so none of the EE code (bucket decode, Riak object
+//  decode, per bucket expiry) ever runs under it.  This driver writes
+//  sext encoded Riak keys and Riak v1 objects instead.
+//
+//  riak_bench --num=1000000 --buckets=20 --types=2 --skew=0.99
+//      --siblings=2 --meta_entries=10 --expiry_buckets=50
+//      --benchmarks=fill,overwrite,read,compact
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/expiry.h"
+#include "leveldb/options.h"
+#include "port/port.h"
+#include "util/random.h"
+#include "util/prop_cache.h"
+#include "leveldb_ee/expiry_ee.h"
+#include "leveldb_ee/riak_object.h"
+
+
+namespace leveldb {
+
+// command line settings
+static const char * FLAGS_benchmarks="fill,overwrite,read,compact";
+static std::string FLAGS_db;
+static int FLAGS_num=1000000;         // distinct keys
+static int FLAGS_reads=-1;            // -1 means FLAGS_num
+static int FLAGS_types=0;             // 0 is default bucket type only
+static int FLAGS_buckets=10;          // buckets per type
+static double FLAGS_skew=0.0;         // zipfian theta, 0 is uniform, < 1.0
+static int FLAGS_siblings=1;
+static int FLAGS_value_size=1000;
+static int FLAGS_meta_entries=0;      // user meta pairs per sibling
+static int FLAGS_expiry_buckets=0;    // percent of buckets with expiry enabled
+static int FLAGS_expiry_minutes=60;
+static int FLAGS_expiry_meta=0;       // percent of objects with expiry base override
+static int FLAGS_tombstones=0;        // percent of overwrites that are Riak tombstones
+static int FLAGS_write_buffer_size=0; // 0 keeps leveldb default
+static bool FLAGS_use_existing_db=false;
+
+
+/**
+ * Router that eleveldb would supply.  Enables expiry for the first
+ *  FLAGS_expiry_buckets percent of bucket numbers, in every type.
+ */
+static bool
+BenchRouter(
+    EleveldbRouterActions_t /*Action*/,
+    int ParamCount,
+    const void ** Params)
+{
+    bool ret_flag(false);
+    const char ** params;
+    int bucket;
+    ExpiryPropPtr_t cache;
+    ExpiryModuleEE * ee;
+
+    params=(const char **)Params;
+
+    if (3==ParamCount && 1==sscanf(params[1], "bucket%d", &bucket))
+    {
+        ee=(ExpiryModuleEE *)ExpiryModule::CreateExpiryModule(NULL);
+
+        if (bucket*100 < FLAGS_expiry_buckets*FLAGS_buckets)
+        {
+            ee->SetExpiryEnabled(true);
+            ee->SetExpiryMinutes(FLAGS_expiry_minutes);
+            ee->SetWholeFileExpiryEnabled(true);
+        }   // if
+        else
+        {
+            ee->SetExpiryEnabled(false);
+            ee->SetExpiryMinutes(0);
+            ee->SetWholeFileExpiryEnabled(false);
+        }   // else
+
+        ret_flag=cache.Insert(*(Slice *)Params[2], (ExpiryModuleOS *)ee);
+    }   // if
+
+    return(ret_flag);
+
+}   // BenchRouter
+
+
+/**
+ * Picks key numbers, uniform or zipfian.  Zipfian follows Gray et al.
+ *  "Quickly Generating Billion-Record Synthetic Databases" (as YCSB does).
+ *  Ranks are scattered so hot keys do not all share one bucket.
+ */
+class KeyChooser
+{
+public:
+    KeyChooser(uint64_t Count, double Skew, uint32_t Seed)
+        : m_Random(Seed), m_Count(Count), m_Skew(Skew),
+          m_Alpha(0), m_Zetan(0), m_Eta(0), m_HalfPowTheta(0)
+    {
+        uint64_t loop;
+        double zeta2;
+
+        if (0.0<m_Skew)
+        {
+            for (loop=1; loop<=m_Count; ++loop)
+                m_Zetan+=1.0 / pow((double)loop, m_Skew);
+
+            zeta2=1.0 + pow(0.5, m_Skew);
+            m_HalfPowTheta=pow(0.5, m_Skew);
+            m_Alpha=1.0 / (1.0 - m_Skew);
+            m_Eta=(1.0 - pow(2.0 / m_Count, 1.0 - m_Skew)) / (1.0 - zeta2 / m_Zetan);
+        }   // if
+    };
+
+    uint64_t Next()
+    {
+        uint64_t rank;
+        double u, uz;
+
+        // Next() is 1 to 2^31-2, so u is within (0,1)
+        u=(double)m_Random.Next() / 2147483647.0;
+
+        if (0.0<m_Skew)
+        {
+            uz=u * m_Zetan;
+            if (uz<1.0)
+                rank=0;
+            else if (uz<1.0 + m_HalfPowTheta)
+                rank=1;
+            else
+                rank=(uint64_t)(m_Count * pow(m_Eta*u - m_Eta + 1.0, m_Alpha));
+
+            if (m_Count<=rank)
+                rank=m_Count-1;
+
+            rank=(rank * 2654435761ULL) % m_Count;
+        }   // if
+        else
+        {
+            rank=(uint64_t)(u * m_Count);
+        }   // else
+
+        return(rank);
+    };
+
+protected:
+    Random m_Random;
+    uint64_t m_Count;
+    double m_Skew, m_Alpha, m_Zetan, m_Eta, m_HalfPowTheta;
+
+};  // class KeyChooser
+
+
+/**
+ * Per phase timing.  Keeps every operation's latency so
+ *  percentiles are exact.
+ */
+class PhaseStats
+{
+public:
+    PhaseStats(const char * Name)
+        : m_Name(Name), m_Bytes(0), m_Found(0), m_Start(Env::Default()->NowMicros()),
+          m_OpStart(0)
+    {};
+
+    void StartOp() {m_OpStart=Env::Default()->NowMicros();};
+
+    void StopOp(size_t Bytes)
+    {
+        m_Latency.push_back(Env::Default()->NowMicros() - m_OpStart);
+        m_Bytes+=Bytes;
+    };
+
+    void NoteFound() {++m_Found;};
+
+    void Report()
+    {
+        uint64_t elapsed;
+        size_t count;
+        double seconds;
+
+        elapsed=Env::Default()->NowMicros() - m_Start;
+        seconds=(0!=elapsed ? elapsed : 1) / 1000000.0;
+        count=m_Latency.size();
+        std::sort(m_Latency.begin(), m_Latency.end());
+
+        fprintf(stdout, "%-10s: %10.0f ops/sec %8.1f MB/s  (%llu ops, %.3f secs)\n",
+                m_Name, count / seconds, m_Bytes / 1048576.0 / seconds,
+                (unsigned long long)count, seconds);
+
+        if (0!=count)
+        {
+            fprintf(stdout, "%-10s  micros/op p50 %llu  p95 %llu  p99 %llu  p99.9 %llu  max %llu\n",
+                    "", Percentile(0.50), Percentile(0.95), Percentile(0.99),
+                    Percentile(0.999), (unsigned long long)m_Latency[count-1]);
+        }   // if
+
+        if (0!=m_Found)
+            fprintf(stdout, "%-10s  %llu of %llu found\n", "",
+                    (unsigned long long)m_Found, (unsigned long long)count);
+    };
+
+protected:
+    const char * m_Name;
+    std::vector<uint64_t> m_Latency;
+    uint64_t m_Bytes, m_Found, m_Start, m_OpStart;
+
+    unsigned long long Percentile(double Fraction) const
+    {
+        size_t index;
+
+        index=(size_t)(Fraction * m_Latency.size());
+        if (m_Latency.size()<=index)
+            index=m_Latency.size()-1;
+
+        return((unsigned long long)m_Latency[index]);
+    };
+
+};  // class PhaseStats
+
+
+class RiakBenchmark
+{
+public:
+    RiakBenchmark()
+        : m_DB(NULL), m_Random(301)
+    {
+        int loop;
+
+        // printable random text, values are slices of it
+        m_ValueSource.reserve(1048576 + FLAGS_value_size);
+        for (loop=0; loop<1048576 + FLAGS_value_size; ++loop)
+            m_ValueSource.push_back((char)(' ' + m_Random.Uniform(95)));
+    };
+
+    ~RiakBenchmark()
+    {
+        delete m_DB;
+    };
+
+    void Run()
+    {
+        const char * benchmarks, * sep;
+        std::string name;
+
+        Open();
+        PrintHeader();
+
+        benchmarks=FLAGS_benchmarks;
+        while (NULL!=benchmarks && '\0'!=*benchmarks)
+        {
+            sep=strchr(benchmarks, ',');
+            if (NULL==sep)
+            {
+                name=benchmarks;
+                benchmarks=NULL;
+            }   // if
+            else
+            {
+                name=std::string(benchmarks, sep - benchmarks);
+                benchmarks=sep + 1;
+            }   // else
+
+            if ("fill"==name)
+                Fill();
+            else if ("overwrite"==name)
+                Overwrite();
+            else if ("read"==name)
+                Read();
+            else if ("compact"==name)
+                Compact();
+            else if ("stats"==name)
+                PrintStats();
+            else if (!name.empty())
+                fprintf(stderr, "unknown benchmark '%s'\n", name.c_str());
+        }   // while
+    };
+
+protected:
+    DB * m_DB;
+    Options m_Options;
+    Random m_Random;
+    std::string m_ValueSource;
+
+    void Open()
+    {
+        Status s;
+        ExpiryModuleEE * ee;
+
+        m_Options.create_if_missing=!FLAGS_use_existing_db;
+        if (0!=FLAGS_write_buffer_size)
+            m_Options.write_buffer_size=FLAGS_write_buffer_size;
+
+        // default module only consults buckets when enabled,
+        //  unlimited keeps default buckets from expiring
+        ee=(ExpiryModuleEE *)ExpiryModule::CreateExpiryModule(&BenchRouter);
+        ee->SetExpiryEnabled(0!=FLAGS_expiry_buckets);
+        ee->SetExpiryUnlimited(true);
+        ee->SetWholeFileExpiryEnabled(false);
+        ee->NoteUserExpirySettings();
+        m_Options.expiry_module=ee;
+
+        if (!FLAGS_use_existing_db)
+            DestroyDB(FLAGS_db, m_Options);
+
+        s=DB::Open(m_Options, FLAGS_db, &m_DB);
+        if (!s.ok())
+        {
+            fprintf(stderr, "open error: %s\n", s.ToString().c_str());
+            exit(1);
+        }   // if
+    };
+
+    void PrintHeader()
+    {
+        std::string object;
+
+        BuildRiakObject(Slice(m_ValueSource.data(), FLAGS_value_size), 0,
+                        FLAGS_siblings, false, FLAGS_meta_entries, 0, object);
+
+        fprintf(stdout, "Keys:       %d across %d bucket(s) in %d type(s)\n",
+                FLAGS_num, FLAGS_buckets, (0==FLAGS_types ? 1 : FLAGS_types));
+        fprintf(stdout, "Objects:    %d sibling(s), %d byte values, %d meta pairs, %d bytes each\n",
+                FLAGS_siblings, FLAGS_value_size, FLAGS_meta_entries, (int)object.size());
+        fprintf(stdout, "Skew:       %.2f\n", FLAGS_skew);
+        fprintf(stdout, "Expiry:     %d%% of buckets (%d minutes), %d%% objects with base override\n",
+                FLAGS_expiry_buckets, FLAGS_expiry_minutes, FLAGS_expiry_meta);
+        fprintf(stdout, "Tombstones: %d%% of overwrites\n", FLAGS_tombstones);
+        fprintf(stdout, "------------------------------------------------\n");
+    };
+
+    // key number to {Type, Bucket, Key}
+    void MakeKey(uint64_t Number, std::string & Key)
+    {
+        char type[16], bucket[16], key[24];
+        uint64_t temp;
+
+        temp=Number;
+        if (0!=FLAGS_types)
+        {
+            snprintf(type, sizeof(type), "type%02d", (int)(temp % FLAGS_types));
+            temp/=FLAGS_types;
+        }   // if
+        else
+        {
+            type[0]='\0';
+        }   // else
+
+        snprintf(bucket, sizeof(bucket), "bucket%03d", (int)(temp % FLAGS_buckets));
+        snprintf(key, sizeof(key), "key%012llu", (unsigned long long)Number);
+
+        BuildRiakKey(type, bucket, key, Key);
+    };
+
+    void MakeObject(bool Tombstone, std::string & Object)
+    {
+        uint64_t now, expiry_base;
+        Slice value;
+
+        now=Env::Default()->NowMicros();
+        expiry_base=0;
+        if ((int)m_Random.Uniform(100) < FLAGS_expiry_meta)
+            expiry_base=now / 1000000;
+
+        if (!Tombstone)
+            value=Slice(m_ValueSource.data() + m_Random.Uniform(1048576), FLAGS_value_size);
+
+        BuildRiakObject(value, now, (Tombstone ? 1 : FLAGS_siblings), Tombstone,
+                        (Tombstone ? 0 : FLAGS_meta_entries), expiry_base, Object);
+    };
+
+    void Write(uint64_t Number, bool Tombstone, PhaseStats & Stats)
+    {
+        std::string key, object;
+        Status s;
+
+        MakeKey(Number, key);
+        MakeObject(Tombstone, object);
+
+        Stats.StartOp();
+        s=m_DB->Put(WriteOptions(), key, object);
+        Stats.StopOp(key.size() + object.size());
+
+        if (!s.ok())
+        {
+            fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+            exit(1);
+        }   // if
+    };
+
+    // every key once, scattered order
+    void Fill()
+    {
+        PhaseStats stats("fill");
+        uint64_t loop, step, a, b, t;
+
+        // step coprime with FLAGS_num visits every key
+        for (step=2654435761ULL % FLAGS_num; ; ++step)
+        {
+            for (a=step, b=FLAGS_num; 0!=b; t=a % b, a=b, b=t)
+                ;
+            if (1==a)
+                break;
+        }   // for
+
+        for (loop=0; loop<(uint64_t)FLAGS_num; ++loop)
+            Write((loop * step) % FLAGS_num, false, stats);
+
+        stats.Report();
+    };
+
+    void Overwrite()
+    {
+        PhaseStats stats("overwrite");
+        KeyChooser chooser(FLAGS_num, FLAGS_skew, 1001);
+        int loop;
+
+        for (loop=0; loop<FLAGS_num; ++loop)
+            Write(chooser.Next(), (int)m_Random.Uniform(100) < FLAGS_tombstones, stats);
+
+        stats.Report();
+    };
+
+    void Read()
+    {
+        PhaseStats stats("read");
+        KeyChooser chooser(FLAGS_num, FLAGS_skew, 2002);
+        std::string key, object;
+        Status s;
+        int loop, reads;
+
+        reads=(FLAGS_reads<0 ? FLAGS_num : FLAGS_reads);
+        for (loop=0; loop<reads; ++loop)
+        {
+            MakeKey(chooser.Next(), key);
+
+            stats.StartOp();
+            s=m_DB->Get(ReadOptions(), key, &object);
+            stats.StopOp(s.ok() ? key.size() + object.size() : 0);
+
+            if (s.ok())
+                stats.NoteFound();
+        }   // for
+
+        stats.Report();
+    };
+
+    // one full manual compaction, reported as a single operation
+    void Compact()
+    {
+        PhaseStats stats("compact");
+
+        stats.StartOp();
+        m_DB->CompactRange(NULL, NULL);
+        stats.StopOp(0);
+
+        stats.Report();
+    };
+
+    void PrintStats()
+    {
+        std::string stats;
+
+        if (m_DB->GetProperty("leveldb.stats", &stats))
+            fprintf(stdout, "\n%s\n", stats.c_str());
+    };
+
+};  // class RiakBenchmark
+
+}  // namespace leveldb
+
+
+int
+main(
+    int argc,
+    char ** argv)
+{
+    int loop, n;
+    double d;
+    char junk;
+
+    leveldb::FLAGS_db=std::string("/tmp/riak_bench");
+
+    for (loop=1; loop<argc; ++loop)
+    {
+        if (0==strncmp(argv[loop], "--benchmarks=", 13))
+            leveldb::FLAGS_benchmarks=argv[loop] + 13;
+        else if (0==strncmp(argv[loop], "--db=", 5))
+            leveldb::FLAGS_db=argv[loop] + 5;
+        else if (1==sscanf(argv[loop], "--num=%d%c", &n, &junk) && 0<n)
+            leveldb::FLAGS_num=n;
+        else if (1==sscanf(argv[loop], "--reads=%d%c", &n, &junk))
+            leveldb::FLAGS_reads=n;
+        else if (1==sscanf(argv[loop], "--types=%d%c", &n, &junk) && 0<=n)
+            leveldb::FLAGS_types=n;
+        else if (1==sscanf(argv[loop], "--buckets=%d%c", &n, &junk) && 0<n)
+            leveldb::FLAGS_buckets=n;
+        else if (1==sscanf(argv[loop], "--skew=%lf%c", &d, &junk) && 0.0<=d && d<1.0)
+            leveldb::FLAGS_skew=d;
+        else if (1==sscanf(argv[loop], "--siblings=%d%c", &n, &junk) && 0<n)
+            leveldb::FLAGS_siblings=n;
+        else if (1==sscanf(argv[loop], "--value_size=%d%c", &n, &junk) && 0<=n)
+            leveldb::FLAGS_value_size=n;
+        else if (1==sscanf(argv[loop], "--meta_entries=%d%c", &n, &junk) && 0<=n)
+            leveldb::FLAGS_meta_entries=n;
+        else if (1==sscanf(argv[loop], "--expiry_buckets=%d%c", &n, &junk) && 0<=n && n<=100)
+            leveldb::FLAGS_expiry_buckets=n;
+        else if (1==sscanf(argv[loop], "--expiry_minutes=%d%c", &n, &junk) && 0<=n)
+            leveldb::FLAGS_expiry_minutes=n;
+        else if (1==sscanf(argv[loop], "--expiry_meta=%d%c", &n, &junk) && 0<=n && n<=100)
+            leveldb::FLAGS_expiry_meta=n;
+        else if (1==sscanf(argv[loop], "--tombstones=%d%c", &n, &junk) && 0<=n && n<=100)
+            leveldb::FLAGS_tombstones=n;
+        else if (1==sscanf(argv[loop], "--write_buffer_size=%d%c", &n, &junk) && 0<=n)
+            leveldb::FLAGS_write_buffer_size=n;
+        else if (1==sscanf(argv[loop], "--use_existing_db=%d%c", &n, &junk) && (0==n || 1==n))
+            leveldb::FLAGS_use_existing_db=(1==n);
+        else
+        {
+            fprintf(stderr, "Invalid flag '%s'\n", argv[loop]);
+            exit(1);
+        }   // else
+    }   // for
+
+    {
+        leveldb::RiakBenchmark benchmark;
+
+        benchmark.Run();
+    }
+
+    leveldb::ExpiryModule::ShutdownExpiryModule();
+
+    return(0);
+
+}   // main
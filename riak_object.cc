@@ -22,9 +22,12 @@
 
 
 #include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
 #include <time.h>
 
 #include "leveldb_ee/riak_object.h"
+#include "leveldb_ee/sext.h"
 #include "util/logging.h"
 
 
@@ -49,6 +52,7 @@ union Binary16_t
 const uint32_t cKeyMinSize=11;
 const Binary32_t cSextPrefix={{16,0,0,0}}; // tuple tag and 3 bytes of 4 byte size
 const Binary32_t cOKeyPrefix={{0x0c, 0xb7, 0x80, 0x08}};  // atom tag and 'o' atom
+const Binary32_t cIKeyPrefix={{0x0c, 0xb4, 0x80, 0x08}};  // atom tag and 'i' atom
 
 // riak object v1 (not v0) starts with these two bytes
 const Binary16_t cRiakObjV1={{0x35, 1}};
@@ -57,13 +61,48 @@ const Binary16_t cRiakObjV1={{0x35, 1}};
 const Binary16_t cTwoTuplePrefix={{0x68, 0x02}};
 const Binary16_t cStringPrefix={{0x6b, 0x00}};
 
+// meta list element {String, String}: 2 tuple prefix, key's string prefix,
+//  then one byte key length (must be less than 256)
+const Binary32_t cMetaPairPrefix={{0x68, 0x02, 0x6b, 0x00}};
+const size_t cMetaPairHeaderSize=5;
+
+// Erlang external term format tags seen within Riak v0 objects
+//  (riak object v0 is simply term_to_binary() of #r_object{})
+enum ErlangTermTag_t
+{
+    eTermNewFloat=0x46,
+    eTermSmallInteger=0x61,
+    eTermInteger=0x62,
+    eTermFloat=0x63,
+    eTermAtom=0x64,
+    eTermSmallTuple=0x68,
+    eTermLargeTuple=0x69,
+    eTermNil=0x6a,
+    eTermString=0x6b,
+    eTermList=0x6c,
+    eTermBinary=0x6d,
+    eTermSmallBig=0x6e,
+    eTermLargeBig=0x6f,
+    eTermSmallAtom=0x73,
+    eTermMap=0x74,
+    eTermAtomUtf8=0x76,
+    eTermSmallAtomUtf8=0x77,
+    eTermVersion=0x83
+};
+
+// deepest nesting walked within a v0 object (dict is about 5)
+const int cTermMaxDepth=32;
+
 //struct RiakV1
 
 static bool SiblingGetLastModTimeMicros(
-    const uint8_t * &Cursor,
-    const uint8_t * Limit,
+    const RiakSiblingView & Sibling,
     uint64_t & ModTimeMicros);
 
+static bool ValueV0GetLastModTimeMicros(
+    const Slice & Value,
+    uint64_t & LastModTimeMicros);
+
 static bool FindDictionaryEntry(
     const char * Key,
     uint32_t KeyLen,
@@ -80,10 +119,25 @@ static bool GetBinaryLength(const uint8_t * Cursor,
                             const uint8_t * Limit,
                             int & Length,
                             bool DecodeLength=true);
-static bool GetBinary(const uint8_t * &Cursor,
-                      const uint8_t * Limit,
-                      uint8_t * Output);
+static bool GetBinaryBytes(const uint8_t * &Cursor,
+                           const uint8_t * Limit,
+                           uint8_t * Output);
+
+/**
+ * Native order load for compares against Binary32_t constants.
+ *  memcpy avoids unaligned access, compiles to one load.
+ */
+static inline uint32_t
+LoadUint32(
+    const uint8_t * Cursor)
+{
+    uint32_t ret_val;
+
+    memcpy(&ret_val, Cursor, sizeof(uint32_t));
+
+    return(ret_val);
 
+}   // LoadUint32
 
 
 /**
@@ -117,7 +171,8 @@ KeyGetBucket(
 /**
  * Originally part of KeyGetBucket std::string.  Broken out to
  *  to allow late parsing of sext CompositeBucket by property cache.
- *  ASSUMES CompositeBucket's formatting was verified prior to call.
+ *  CompositeBucket normally comes from KeyGetBucket(), but every
+ *  step is still bounds checked.  Both outputs empty if malformed.
  */
 void
 KeyParseBucket(
@@ -125,44 +180,129 @@ KeyParseBucket(
     std::string & BucketType,
     std::string & Bucket)
 {
+    bool good;
     const uint8_t * key_end, *cursor;
     int length;
+    size_t used;
 
     BucketType.clear();
     Bucket.clear();
 
-    key_end=(uint8_t *)CompositeBucket.data() + CompositeBucket.size();
-
-    // not checking returns about formatting since all checks should
-    //  have occurred within prior KeyGetBucket() call
-    cursor=(uint8_t *)CompositeBucket.data();
+    key_end=(const uint8_t *)CompositeBucket.data() + CompositeBucket.size();
+    cursor=(const uint8_t *)CompositeBucket.data();
+    good=!CompositeBucket.empty();
 
     // tuple means bucket_type and bucket
-    if (16==*cursor)
+    if (good && 16==*cursor)
     {
         // shift cursor to first char of binary
-        cursor+=6;
-        GetBinaryLength(cursor, key_end, length);
-        BucketType.resize(length);
-        GetBinary(cursor, key_end, (uint8_t *)BucketType.data());
+        good=(6<=CompositeBucket.size());
+        cursor+=(good ? 6 : 0);
+
+        good=good && GetBinaryLength(cursor, key_end, length);
+        if (good)
+        {
+            BucketType.resize(length);
+            good=SextUnpack(cursor, key_end, (uint8_t *)BucketType.data(), length, used);
+        }   // if
+
+        good=good && cursor<key_end && 18==*cursor;
+    }   // if
 
+    // binary name for bucket
+    if (good)
+    {
         ++cursor;
-        GetBinaryLength(cursor, key_end, length);
-        Bucket.resize(length);
-        GetBinary(cursor, key_end, (uint8_t *)Bucket.data());
+        good=GetBinaryLength(cursor, key_end, length);
+        if (good)
+        {
+            Bucket.resize(length);
+            good=SextUnpack(cursor, key_end, (uint8_t *)Bucket.data(), length, used);
+        }   // if
+    }   // if
 
+    if (!good)
+    {
+        BucketType.clear();
+        Bucket.clear();
     }   // if
 
-    // binary name for bucket only
-    else
+}   // KeyParseBucket (std::string)
+
+
+/**
+ * Heap free version of KeyParseBucket.  Decodes into caller's
+ *  Buffer and returns Slices pointing into it.  Each component
+ *  is also zero terminated so data() can pass as a C string.
+ *  Buffer of CompositeBucket.size()+2 bytes is always enough.
+ *  Each binary decodes in one pass straight into Buffer, bounded
+ *  by both the composite and the Buffer.
+ */
+bool                           //< false if Buffer too small or malformed
+KeyParseBucket(
+    const Slice & CompositeBucket,
+    char * Buffer,             //< storage for decoded names
+    size_t BufferSize,
+    Slice & BucketType,        //< output: slice within Buffer, or empty
+    Slice & Bucket)            //< output: slice within Buffer
+{
+    bool ret_flag;
+    const uint8_t * key_end, *cursor;
+    char * output, * buffer_end;
+    size_t length;
+
+    BucketType.clear();
+    Bucket.clear();
+
+    key_end=(const uint8_t *)CompositeBucket.data() + CompositeBucket.size();
+    cursor=(const uint8_t *)CompositeBucket.data();
+    output=Buffer;
+    buffer_end=Buffer + BufferSize;
+    ret_flag=!CompositeBucket.empty() && 0!=BufferSize;
+
+    // tuple means bucket_type and bucket
+    if (ret_flag && 16==*cursor)
+    {
+        // shift cursor to first char of binary, one byte kept for '\0'
+        ret_flag=(6<=CompositeBucket.size());
+        cursor+=(ret_flag ? 6 : 0);
+        ret_flag=ret_flag && SextUnpack(cursor, key_end, (uint8_t *)output,
+                                        (buffer_end - output) - 1, length);
+
+        if (ret_flag)
+        {
+            output[length]='\0';
+            BucketType=Slice(output, length);
+            output+=length + 1;
+        }   // if
+
+        ret_flag=ret_flag && cursor<key_end && 18==*cursor
+            && output<buffer_end;
+    }   // if
+
+    // binary name for bucket
+    if (ret_flag)
     {
         ++cursor;
-        GetBinaryLength(cursor, key_end, length);
-        Bucket.resize(length);
-        GetBinary(cursor, key_end, (uint8_t *)Bucket.data());
-    }   // else
+        ret_flag=SextUnpack(cursor, key_end, (uint8_t *)output,
+                            (buffer_end - output) - 1, length);
+
+        if (ret_flag)
+        {
+            output[length]='\0';
+            Bucket=Slice(output, length);
+        }   // if
+    }   // if
 
-}   // KeyParseBucket
+    if (!ret_flag)
+    {
+        BucketType.clear();
+        Bucket.clear();
+    }   // if
+
+    return(ret_flag);
+
+}   // KeyParseBucket (buffer)
 
 
 /**
@@ -178,73 +318,59 @@ KeyGetBucket(
                               //    or binary bucket name
 {
     bool ret_flag;
-    const uint8_t * cursor, * key_end, *cursor_temp;
+    const uint8_t * cursor, * key_end, * composite;
     int length;
 
     ret_flag=false;
     CompositeBucket.clear();
 
     // hard coded decode for sext prefix of <<bucket>> or {<<bucket type>>,<<bucket>>}
-    /// detect prefix
+    /// detect prefix.  cKeyMinSize covers every fixed byte read before
+    ///  the first binary, binaries are bounds checked by GetBinaryLength()
     cursor=(const uint8_t *)Key.data();
     key_end=cursor + Key.size();
 
-    if (cKeyMinSize<=Key.size() && cSextPrefix.m_Uint32==*(uint32_t *)cursor)
+    if (cKeyMinSize<=Key.size() && cSextPrefix.m_Uint32==LoadUint32(cursor))
     {
         cursor+=sizeof(uint32_t);
 
-        // looking for {o, <<bucket>> | {<<bucket type>>,<<bucket>>}, <<key>>}
-        if (3==*cursor)   // tuple size of 3
+        // looking for {o, Bucket, <<key>>} object keys or
+        //  {i, Bucket, <<field>>, Term, <<key>>} secondary index (2i) keys.
+        //  Both place Bucket, <<bucket>> | {<<bucket type>>,<<bucket>>}, second
+        //  so 2i entries share their objects' composite bucket.
+        if ((3==*cursor && cOKeyPrefix.m_Uint32==LoadUint32(cursor+1))
+            || (5==*cursor && cIKeyPrefix.m_Uint32==LoadUint32(cursor+1)))
         {
-            ++cursor;
-
-            // 'o' atom?
-            if (cOKeyPrefix.m_Uint32==*(uint32_t *)cursor)
+            // tuple size and atom
+            cursor+=1+sizeof(uint32_t);
+            composite=cursor;
+
+            // second tuple is a 2 tuple. its first element is binary tag 18: bucket type, bucket
+            if (6<=(size_t)(key_end-cursor) && 16==cursor[0]
+                && 0==cursor[1] && 0==cursor[2] && 0==cursor[3] && 2==cursor[4]
+                && 18==cursor[5])
             {
-                cursor+=sizeof(uint32_t);
+                // shift cursor to first char of bucket type's binary
+                cursor+=6;
+                ret_flag=GetBinaryLength(cursor, key_end, length, false);
+                cursor+=(ret_flag ? length : 0);
+
+                // test for binary (bucket name)
+                ret_flag=ret_flag && cursor<key_end && 18==*cursor
+                    && GetBinaryLength(cursor+1, key_end, length, false);
+            }   // if
 
-                // second tuple is a tuple. its first tuple is binary tag 18: bucket type, bucket
-                if ((cursor+5)<key_end && 16==*cursor && 2==*(cursor+4) && 18==*(cursor+5))
-                {
-                    // return entire {<<bucket type>>, <<bucket>>} slice
-                    cursor_temp=cursor;
-
-                    // shift cursor to first char of bucket type's binary
-                    cursor+=6;
-                    if (GetBinaryLength(cursor, key_end, length, false))
-                    {
-                        cursor+=length;
-
-                        // test for binary (bucket name)
-                        ret_flag=cursor<key_end && 18==*cursor;
-
-                        ++cursor;
-                        if (ret_flag && GetBinaryLength(cursor, key_end, length, false))
-                        {
-                            cursor+=length;
-                            Slice temp((const char *)cursor_temp, (cursor-cursor_temp));
-                            CompositeBucket=temp;
-                        }   // if
-                        else
-                        {
-                            ret_flag=false;
-                        }   // else
-                    }   // if
-                }   // if
+            // 18 is binary tag:  bucket only
+            else if (18==*cursor)
+            {
+                ret_flag=GetBinaryLength(cursor+1, key_end, length, false);
+            }   // else if
 
-                // 18 is binary tag:  bucket only
-                else if (18==*cursor)
-                {
-                    cursor_temp=cursor;
-                    ++cursor;
-                    if (GetBinaryLength(cursor, key_end, length, false))
-                    {
-                        cursor+=length;
-                        Slice temp((const char *)cursor_temp, (cursor-cursor_temp));
-                        CompositeBucket=temp;
-                        ret_flag=true;
-                    }   // if
-                }   // else if
+            // return entire {<<bucket type>>, <<bucket>>} or <<bucket>> slice
+            if (ret_flag)
+            {
+                cursor+=1 + length;
+                CompositeBucket=Slice((const char *)composite, cursor - composite);
             }   // if
         }   // if
     }   // if
@@ -254,6 +380,27 @@ KeyGetBucket(
 }   // KeyGetBucket (slice)
 
 
+/**
+ * True if Key is a sext encoded Riak secondary index (2i) entry,
+ *  {i, Bucket, Field, Term, Key}.  KeyGetBucket() returns its
+ *  bucket just as for object keys.
+ */
+bool
+KeyIsRiakIndex(
+    const Slice & Key)
+{
+    const uint8_t * cursor;
+
+    cursor=(const uint8_t *)Key.data();
+
+    return(cKeyMinSize<=Key.size()
+           && cSextPrefix.m_Uint32==LoadUint32(cursor)
+           && 5==cursor[sizeof(uint32_t)]
+           && cIKeyPrefix.m_Uint32==LoadUint32(cursor + 1 + sizeof(uint32_t)));
+
+}   // KeyIsRiakIndex
+
+
 // from riak_kv/src/riak_object.erl
 //
 // Definition of Riak Object version 1 (in Erlangese)
@@ -262,182 +409,680 @@ KeyGetBucket(
 //   meta:  <<LastModBin/binary, VTagLen:8/integer, VTagBin:VTagLen/binary, Deleted:1/binary-unit:8, RestBin/binary>>.
 
 
+/**
+ * Bounds checked read of big endian uint32_t, advances Cursor.
+ *  memcpy avoids unaligned access.
+ */
+static inline bool
+ReadBigEndian32(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    uint32_t & Value)
+{
+    bool ret_flag;
+
+    ret_flag=(sizeof(uint32_t) <= (size_t)(Limit - Cursor));
+    if (ret_flag)
+    {
+        memcpy(&Value, Cursor, sizeof(uint32_t));
+        Value=ntohl(Value);
+        Cursor+=sizeof(uint32_t);
+    }   // if
+
+    return(ret_flag);
+
+}   // ReadBigEndian32
+
+
+/**
+ * Bounds checked Slice of Length bytes, advances Cursor.
+ */
+static inline bool
+ReadSlice(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    size_t Length,
+    Slice & Output)
+{
+    bool ret_flag;
+
+    ret_flag=(Length <= (size_t)(Limit - Cursor));
+    if (ret_flag)
+    {
+        Output=Slice((const char *)Cursor, Length);
+        Cursor+=Length;
+    }   // if
+
+    return(ret_flag);
+
+}   // ReadSlice
+
+
+void
+RiakObjectView::Clear()
+{
+    m_Valid=false;
+    m_VClock.clear();
+    m_SiblingCount=0;
+    m_Overflow.clear();
+
+}   // RiakObjectView::Clear
+
+
+RiakSiblingView &
+RiakObjectView::NextSibling()
+{
+    RiakSiblingView * ret_ptr;
+
+    if (m_SiblingCount<kInlineSiblings)
+    {
+        ret_ptr=&m_Inline[m_SiblingCount];
+    }   // if
+    else
+    {
+        m_Overflow.resize(m_SiblingCount - kInlineSiblings + 1);
+        ret_ptr=&m_Overflow.back();
+    }   // else
+
+    ++m_SiblingCount;
+
+    return(*ret_ptr);
+
+}   // RiakObjectView::NextSibling
+
+
+/**
+ * Single pass decode of Riak v1 object.  Every length is tested
+ *  against the remaining bytes before use.  Returns false for
+ *  anything that is not a complete v1 object.
+ */
+bool
+RiakObjectView::Parse(
+    const Slice & Value)
+{
+    bool good;
+    const uint8_t * cursor, * limit, * meta_cursor, * meta_limit;
+    uint32_t sib_count(0), length, mega, secs, micros, loop;
+
+    Clear();
+    cursor=(const uint8_t *)Value.data();
+    limit=cursor + Value.size();
+
+    // does this value object start like a Riak v1 object
+    good=(2<=Value.size() && cRiakObjV1.m_Bytes[0]==cursor[0]
+          && cRiakObjV1.m_Bytes[1]==cursor[1]);
+    cursor+=(good ? 2 : 0);
+
+    good=good && ReadBigEndian32(cursor, limit, length)
+        && ReadSlice(cursor, limit, length, m_VClock)
+        && ReadBigEndian32(cursor, limit, sib_count);
+
+    for (loop=0; loop<sib_count && good; ++loop)
+    {
+        RiakSiblingView & sibling=NextSibling();
+
+        good=ReadBigEndian32(cursor, limit, length)
+            && ReadSlice(cursor, limit, length, sibling.m_Value)
+            && ReadBigEndian32(cursor, limit, length)
+            && ReadSlice(cursor, limit, length, sibling.m_Meta);
+
+        // meta:  <<LastModBin/binary, VTagLen:8/integer, VTagBin:VTagLen/binary,
+        //          Deleted:1/binary-unit:8, RestBin/binary>>
+        if (good)
+        {
+            meta_cursor=(const uint8_t *)sibling.m_Meta.data();
+            meta_limit=meta_cursor + sibling.m_Meta.size();
+
+            // LastMod is Erlang timestamp {megaseconds, seconds, microseconds}
+            good=ReadBigEndian32(meta_cursor, meta_limit, mega)
+                && ReadBigEndian32(meta_cursor, meta_limit, secs)
+                && ReadBigEndian32(meta_cursor, meta_limit, micros)
+                && meta_cursor<meta_limit;
+
+            if (good)
+            {
+                sibling.m_LastModMicros=((uint64_t)mega*1000000 + secs)*1000000 + micros;
+                length=*meta_cursor;
+                ++meta_cursor;
+                good=ReadSlice(meta_cursor, meta_limit, length, sibling.m_VTag)
+                    && meta_cursor<meta_limit;
+            }   // if
+
+            if (good)
+            {
+                sibling.m_Deleted=(1==*meta_cursor);
+                ++meta_cursor;
+                sibling.m_Dictionary=Slice((const char *)meta_cursor, meta_limit - meta_cursor);
+            }   // if
+        }   // if
+    }   // for
+
+    m_Valid=good;
+    if (!good)
+        Clear();
+
+    return(m_Valid);
+
+}   // RiakObjectView::Parse
+
+
+uint64_t
+RiakObjectView::GetLastModMicros() const
+{
+    uint64_t most_recent;
+    size_t loop;
+
+    most_recent=0;
+    for (loop=0; loop<m_SiblingCount; ++loop)
+    {
+        if (most_recent<GetSibling(loop).m_LastModMicros)
+            most_recent=GetSibling(loop).m_LastModMicros;
+    }   // for
+
+    return(most_recent);
+
+}   // RiakObjectView::GetLastModMicros
+
+
+bool
+RiakObjectView::IsAllDeleted() const
+{
+    bool ret_flag;
+    size_t loop;
+
+    ret_flag=(0!=m_SiblingCount);
+    for (loop=0; loop<m_SiblingCount && ret_flag; ++loop)
+        ret_flag=GetSibling(loop).m_Deleted;
+
+    return(ret_flag);
+
+}   // RiakObjectView::IsAllDeleted
+
+
 /**
  * The Value is likely a Riak version 0 or version 1 "Riak Object".
- *  Initial implementation only decodes version 1.  Everything else
- *  is ignored.
+ *  Version 1 decodes via RiakObjectView, version 0 via
+ *  ValueV0GetLastModTimeMicros.  Everything else is ignored.
  */
 bool
 ValueGetLastModTimeMicros(
     Slice Value,
     uint64_t & LastModTimeMicros)
+{
+    RiakObjectView view;
+
+    view.Parse(Value);
+
+    return(ValueGetLastModTimeMicros(view, Value, LastModTimeMicros));
+
+}   // ValueGetLastModTimeMicros
+
+
+/**
+ * Same as above, but View already holds RiakObjectView::Parse(Value).
+ *  Lets a caller that also needs other fields of the object
+ *  (i.e. tombstone test) parse the value once.
+ */
+bool
+ValueGetLastModTimeMicros(
+    const RiakObjectView & View,
+    const Slice & Value,
+    uint64_t & LastModTimeMicros)
 {
     bool ret_flag, good;
-    const uint8_t * cursor, * limit;
-    int sib_count, vclock_len, loop;
+    size_t loop;
     uint64_t most_recent, sib_time;
 
     ret_flag=false;
     LastModTimeMicros=0;
-    cursor=(const uint8_t *)Value.data();
-    limit=cursor + Value.size();
-    sib_time=0;
 
-    // does this value object start like a Riak v1 object
-    if (cRiakObjV1.m_Uint16==*(uint16_t *)cursor && (cursor+1)<limit)
+    // does this value object parse as a Riak v1 object
+    if (View.IsValid())
     {
-        cursor+=sizeof(cRiakObjV1.m_Uint16);;
-
-        // skip over vclock
-        vclock_len=ntohl(*(uint32_t *)cursor);
-        cursor+=sizeof(uint32_t);
-        cursor+=vclock_len;
-
-        // get sibling count
-        sib_count=ntohl(*(uint32_t *)cursor);
-        cursor+=sizeof(uint32_t);
-
         most_recent=0;
-        for (loop=0, good=true; loop<sib_count && good && cursor<limit; ++loop)
+        for (loop=0, good=true; loop<View.GetSiblingCount() && good; ++loop)
         {
-            good=SiblingGetLastModTimeMicros(cursor, limit, sib_time);
+            good=SiblingGetLastModTimeMicros(View.GetSibling(loop), sib_time);
             if (good && most_recent<sib_time)
                 most_recent=sib_time;
         }   // for
 
-        ret_flag=good && 0!=most_recent;
+        ret_flag=good && 0!=most_recent;
+
+        if (ret_flag)
+            LastModTimeMicros=most_recent;
+    }   // if
+
+    // older Riak objects are Erlang term_to_binary() format
+    else if (!Value.empty() && eTermVersion==(uint8_t)Value[0])
+    {
+        ret_flag=ValueV0GetLastModTimeMicros(Value, LastModTimeMicros);
+    }   // else if
+
+    return(ret_flag);
+
+}   // ValueGetLastModTimeMicros
+
+
+/**
+ * Riak v1 object whose siblings are all marked deleted
+ *  (Riak's tombstone)
+ */
+bool
+ValueIsRiakTombstone(
+    const Slice & Value)
+{
+    RiakObjectView view;
+
+    return(view.Parse(Value) && view.IsAllDeleted());
+
+}   // ValueIsRiakTombstone
+
+
+/**
+ * Walk one Erlang external term.  While walking, watch for the
+ *  improper list [Key | Value] that dict uses for each key/value
+ *  pair and report where Value starts.  An empty Key only skips
+ *  the term.
+ */
+static bool                         //< false if term malformed or too deep
+WalkTerm(
+    const uint8_t * & Cursor,       //< start of term, output: first byte after term
+    const uint8_t * Limit,
+    const Slice & Key,              //< binary key to find, or empty
+    int Depth,
+    const uint8_t * & Found)        //< output: start of Key's value, unchanged if not found
+{
+    bool good;
+    uint32_t count, loop, element_size;
+    uint8_t tag;
+
+    good=(Cursor<Limit && Depth<cTermMaxDepth);
+    count=0;
+    element_size=0;
+
+    if (good)
+    {
+        tag=*Cursor;
+        ++Cursor;
+
+        switch(tag)
+        {
+            case eTermSmallInteger: element_size=1; break;
+            case eTermInteger:      element_size=4; break;
+            case eTermNewFloat:     element_size=8; break;
+            case eTermFloat:        element_size=31; break;
+            case eTermNil:          element_size=0; break;
+
+            case eTermSmallAtom:
+            case eTermSmallAtomUtf8:
+                good=(Cursor<Limit);
+                element_size=good ? 1 + *Cursor : 0;
+                break;
+
+            case eTermAtom:
+            case eTermAtomUtf8:
+            case eTermString:
+                good=(2<=(Limit-Cursor));
+                element_size=good ? 2 + (((uint32_t)Cursor[0] << 8) | Cursor[1]) : 0;
+                break;
+
+            case eTermBinary:
+                good=ReadBigEndian32(Cursor, Limit, element_size);
+                break;
+
+            case eTermSmallBig:
+                good=(Cursor<Limit);
+                element_size=good ? 2 + *Cursor : 0;
+                break;
+
+            case eTermLargeBig:
+                // digit count plus sign byte, test before add so
+                //  0xFFFFFFFF cannot wrap to 0
+                good=ReadBigEndian32(Cursor, Limit, element_size)
+                    && element_size<(size_t)(Limit-Cursor);
+                element_size=good ? element_size + 1 : 0;
+                break;
+
+            case eTermSmallTuple:
+                good=(Cursor<Limit);
+                if (good)
+                {
+                    count=*Cursor;
+                    ++Cursor;
+                }   // if
+                for (loop=0; loop<count && good; ++loop)
+                    good=WalkTerm(Cursor, Limit, Key, Depth+1, Found);
+                break;
+
+            case eTermLargeTuple:
+            case eTermMap:
+                good=ReadBigEndian32(Cursor, Limit, count);
+                if (eTermMap==tag)
+                    count*=2;
+                for (loop=0; loop<count && good; ++loop)
+                    good=WalkTerm(Cursor, Limit, Key, Depth+1, Found);
+                break;
+
+            case eTermList:
+                good=ReadBigEndian32(Cursor, Limit, count);
+
+                // [Key | Value]:  one binary element matching Key
+                if (good && 1==count && !Key.empty()
+                    && 5+Key.size() <= (size_t)(Limit-Cursor)
+                    && eTermBinary==Cursor[0]
+                    && Key.size()==(((uint32_t)Cursor[1] << 24) | ((uint32_t)Cursor[2] << 16)
+                                    | ((uint32_t)Cursor[3] << 8) | Cursor[4])
+                    && 0==memcmp(Cursor+5, Key.data(), Key.size()))
+                {
+                    Found=Cursor + 5 + Key.size();
+                }   // if
+
+                // elements, then tail
+                for (loop=0; loop<=count && good; ++loop)
+                    good=WalkTerm(Cursor, Limit, Key, Depth+1, Found);
+                break;
+
+            default:
+                // unknown or unexpected tag
+                good=false;
+                break;
+        }   // switch
+
+        good=good && element_size<=(size_t)(Limit-Cursor);
+        if (good)
+            Cursor+=element_size;
+    }   // if
+
+    return(good);
+
+}   // WalkTerm
+
+
+static bool
+SkipTerm(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit)
+{
+    const uint8_t * unused;
+
+    return(WalkTerm(Cursor, Limit, Slice(), 0, unused));
+
+}   // SkipTerm
+
+
+/**
+ * Read a non-negative small integer or integer term
+ */
+static bool
+ReadTermInteger(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    uint32_t & Value)
+{
+    bool good;
+
+    good=(Cursor<Limit);
+
+    if (good && eTermSmallInteger==*Cursor)
+    {
+        ++Cursor;
+        good=(Cursor<Limit);
+        if (good)
+        {
+            Value=*Cursor;
+            ++Cursor;
+        }   // if
+    }   // if
+    else if (good && eTermInteger==*Cursor)
+    {
+        ++Cursor;
+        good=ReadBigEndian32(Cursor, Limit, Value) && 0==(Value & 0x80000000);
+    }   // else if
+    else
+    {
+        good=false;
+    }   // else
+
+    return(good);
+
+}   // ReadTermInteger
+
+
+/**
+ * Read tuple header, and its first element if it is the atom
+ *  naming a record
+ */
+static bool
+ReadTermRecord(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    const char * Name,
+    uint32_t Arity)
+{
+    bool good;
+    size_t name_len;
+
+    name_len=strlen(Name);
+
+    good=(2+3+name_len <= (size_t)(Limit-Cursor))
+        && eTermSmallTuple==Cursor[0] && Arity==Cursor[1]
+        && eTermAtom==Cursor[2] && 0==Cursor[3] && name_len==Cursor[4]
+        && 0==memcmp(Cursor+5, Name, name_len);
+
+    if (good)
+        Cursor+=5 + name_len;
+
+    return(good);
+
+}   // ReadTermRecord
+
+
+// from riak_kv/src/riak_object.erl
+//
+// Definition of Riak Object version 0 (in Erlangese)
+//   term_to_binary(#r_object{bucket, key, contents, vclock, updatemetadata, updatevalue})
+//   contents:  [#r_content{metadata, value}]
+//   metadata:  dict() holding <<"X-Riak-Last-Modified">> => {MegaSecs, Secs, MicroSecs}
+
+/**
+ * Version 0 objects are walked as generic terms.  Each content's
+ *  metadata dict is searched for X-Riak-Last-Modified.
+ */
+bool
+ValueV0GetLastModTimeMicros(
+    const Slice & Value,
+    uint64_t & LastModTimeMicros)
+{
+    bool good;
+    const uint8_t * cursor, * limit, * found, * temp;
+    uint32_t count, loop, mega, secs, micros;
+    uint64_t most_recent;
+    const Slice last_mod_key("X-Riak-Last-Modified");
+
+    cursor=(const uint8_t *)Value.data();
+    limit=cursor + Value.size();
+    most_recent=0;
+    count=0;
+
+    good=(cursor<limit && eTermVersion==*cursor);
+    ++cursor;
+
+    // bucket and key not needed
+    good=good && ReadTermRecord(cursor, limit, "r_object", 7)
+        && SkipTerm(cursor, limit) && SkipTerm(cursor, limit);
+
+    // contents
+    good=good && cursor<limit && eTermList==*cursor;
+    ++cursor;
+    good=good && ReadBigEndian32(cursor, limit, count);
+
+    for (loop=0; loop<count && good; ++loop)
+    {
+        found=NULL;
+        good=ReadTermRecord(cursor, limit, "r_content", 3)
+            && WalkTerm(cursor, limit, last_mod_key, 0, found)
+            && SkipTerm(cursor, limit);
+
+        // {MegaSecs, Secs, MicroSecs}
+        if (good && NULL!=found)
+        {
+            temp=found;
+            if (2<=(limit-temp) && eTermSmallTuple==temp[0] && 3==temp[1])
+            {
+                temp+=2;
+                if (ReadTermInteger(temp, limit, mega)
+                    && ReadTermInteger(temp, limit, secs)
+                    && ReadTermInteger(temp, limit, micros))
+                {
+                    uint64_t sib_time;
+
+                    sib_time=((uint64_t)mega*1000000 + secs)*1000000 + micros;
+                    if (most_recent<sib_time)
+                        most_recent=sib_time;
+                }   // if
+            }   // if
+        }   // if
+    }   // for
 
-        if (ret_flag)
-            LastModTimeMicros=most_recent;
-    }   // if
+    // contents tail, then vclock, updatemetadata, updatevalue:
+    //  only accept a complete object
+    good=good && SkipTerm(cursor, limit) && SkipTerm(cursor, limit)
+        && SkipTerm(cursor, limit) && SkipTerm(cursor, limit)
+        && cursor==limit;
 
-    return(ret_flag);
+    good=good && 0!=most_recent;
+    if (good)
+        LastModTimeMicros=most_recent;
 
-}   // ValueGetLastModTimeMicros
+    return(good);
 
+}   // ValueV0GetLastModTimeMicros
 
+
+/**
+ * Sibling's write time is its LastMod, unless user supplied
+ *  X-Riak-Meta-Expiry-Base-Seconds within X-Riak-Meta.
+ */
 bool
 SiblingGetLastModTimeMicros(
-    const uint8_t * &Cursor, // start of sibling, output set to next sibling
-    const uint8_t * Limit,   // overrun test
+    const RiakSiblingView & Sibling,
     uint64_t & ModTimeMicros)
 {
     bool ret_flag;
-    const uint8_t * cursor;
+    const uint8_t * cursor, * limit;
     uint32_t field_size;
 
-    ret_flag=false;
-
-    // process (skip) the first field pair which are value size and value
-    cursor=Cursor;
-    if ((cursor+sizeof(uint32_t))<Limit)
-    {
-        // bytes within the value
-        field_size=ntohl(*(uint32_t *)cursor);
+    ModTimeMicros=Sibling.m_LastModMicros;
+    ret_flag=true;
 
-        // and skip value
-        cursor+=sizeof(uint32_t);
-        cursor+=field_size;
-    }   // if
+    //
+    // secondary search of X-Riak-Meta for user supplied mod time
+    //
+    cursor=(const uint8_t *)Sibling.m_Dictionary.data();
+    limit=cursor + Sibling.m_Dictionary.size();
 
-    // process Metadata fields
-    if ((cursor+sizeof(uint32_t))<Limit)
+    // now at series of key/value pairs
+    //  <<KeyLen:32/integer, KeyBin/binary, ValueLen:32/integer, ValueBin/binary>>
+    //  11 is strlen("X-Riak-Meta").  do not want to compute it every call.
+    if (FindDictionaryEntry("X-Riak-Meta", 11, cursor, limit))
     {
-        // bytes within the value
-        field_size=ntohl(*(uint32_t *)cursor);
-
-        // and skip value
-        cursor+=sizeof(uint32_t);
-
-        // set external cursor to next sibling
-        Cursor+=(cursor - Cursor) + field_size;
-
-        // read Metadata's LastModTime, an Erlang timestamp
-        //  (three uint32_t integers:  "megaseconds", seconds, microseconds)
-        if ((cursor+sizeof(uint32_t)*3)<Limit)
+        // find entry, see if cursor updated to string header
+        //  31 is length of string
+        if (FindMetaEntry("X-Riak-Meta-Expiry-Base-Seconds", 31, cursor, limit)
+            && (cursor+3)<limit && 0x6b==*cursor)
         {
             uint64_t temp;
 
-            temp=ntohl(*(uint32_t *)cursor);
-            temp*=1000000;
-            cursor+=sizeof(uint32_t);
+            ++cursor;
+            // external term format ... must be short string
+            field_size=((uint32_t)cursor[0] << 8) | cursor[1];
+            cursor+=sizeof(uint16_t);
 
-            temp+=ntohl(*(uint32_t *)cursor);
-            temp*=1000000;
-            cursor+=sizeof(uint32_t);
+            // strtol() like conversion
+            temp=0;
+            while(field_size && cursor<limit)
+            {
+                // validate that these are digits
+                if (0x30<=*cursor && *cursor<= 0x39)
+                {
+                    temp=temp*10 + (*cursor & 0x0f);
+                    ++cursor;
+                    --field_size;
+                }   // if
+                else
+                {
+                    // terminate decode
+                    cursor=limit;
+                    temp=0;
+                }   // else
 
-            temp+=ntohl(*(uint32_t *)cursor);
-            cursor+=sizeof(uint32_t);
+            }   // while
 
-            ModTimeMicros=temp;
-            ret_flag=true;
+            // look useful: 1980-01-01 < temp < 2080-01-01
+            if (315550800 < temp && temp < 3471310800ULL && cursor<limit)
+            {
+                // ModTime in microseconds
+                ModTimeMicros=temp*1000000;
+            }   // if
         }   // if
+    }   // if
 
-        //
-        // secondary search of X-Riak-Meta for user supplied mod time
-        //
+    return(ret_flag);
 
-        // skip vtag
-        if (cursor<Limit)
-        {
-            field_size=*cursor;
-            cursor+= 1 + field_size;
-        }   // if
+}   // SiblingGetLastModTimeMicros
 
-        // skip deleted tag
-        ++cursor;
 
-        // now at series of key/value pairs
-        //  <<KeyLen:32/integer, KeyBin/binary, ValueLen:32/integer, ValueBin/binary>>
-        //  11 is strlen("X-Riak-Meta").  do not want to compute it every call.
-        if (FindDictionaryEntry("X-Riak-Meta", 11, cursor, Limit))
-        {
-            // find entry, see if cursor updated to string header
-            //  31 is length of string
-            if (FindMetaEntry("X-Riak-Meta-Expiry-Base-Seconds", 31, cursor, Limit)
-                && 0x6b==*cursor && (cursor+3)<Limit)
-            {
-                uint64_t temp;
+/**
+ * Final eight bytes of a search key, loaded once per search.
+ *  Zero for keys shorter than a word.
+ */
+static inline uint64_t
+KeyTail(
+    const char * Key,
+    uint32_t KeyLen)
+{
+    uint64_t tail;
 
-                ++cursor;
-                // external term format ... must be short string
-                field_size=ntohs(*(uint16_t *)cursor);
-                cursor+=sizeof(uint16_t);
+    tail=0;
+    if (sizeof(uint64_t)<=KeyLen)
+        memcpy(&tail, Key + KeyLen - sizeof(uint64_t), sizeof(uint64_t));
 
-                // strtol() like conversion
-                temp=0;
-                while(field_size && cursor<Limit)
-                {
-                    // validate that these are digits
-                    if (0x30<=*cursor && *cursor<= 0x39)
-                    {
-                        temp=temp*10 + (*cursor & 0x0f);
-                        ++cursor;
-                        --field_size;
-                    }   // if
-                    else
-                    {
-                        // terminate decode
-                        cursor=Limit;
-                        temp=0;
-                    }   // else
-
-                }   // while
-
-                // look useful: 1980-01-01 < temp < 2080-01-01
-                if (315550800 < temp && temp < 3471310800 && cursor<Limit)
-                {
-                    // ModTime in microseconds
-                    ModTimeMicros=temp*1000000;
-                    ret_flag=true;
-                }   // if
-            }   // if
-        }   // if
+    return(tail);
+
+}   // KeyTail
+
+
+/**
+ * Candidate is already known to be KeyLen bytes.  Riak's dictionary
+ *  and user meta keys share long leading text ("X-Riak-Meta-..."),
+ *  so one word compare of the key's tail rejects nearly every
+ *  same length neighbor before memcmp is called.
+ */
+static inline bool
+KeyMatches(
+    const uint8_t * Candidate,
+    const char * Key,
+    uint32_t KeyLen,
+    uint64_t Tail)            // KeyTail(Key, KeyLen)
+{
+    bool ret_flag;
+    uint64_t candidate_tail;
+
+    if (sizeof(uint64_t)<=KeyLen)
+    {
+        memcpy(&candidate_tail, Candidate + KeyLen - sizeof(uint64_t), sizeof(uint64_t));
+        ret_flag=(candidate_tail==Tail
+                  && 0==memcmp(Candidate, Key, KeyLen - sizeof(uint64_t)));
     }   // if
+    else
+    {
+        ret_flag=(0==memcmp(Candidate, Key, KeyLen));
+    }   // else
 
     return(ret_flag);
 
-}   // SiblingGetLastModTimeMicros
+}   // KeyMatches
 
 
 /**
@@ -451,29 +1096,36 @@ FindDictionaryEntry(
     const uint8_t * &Cursor, // first dictionary entry, output is matched value
     const uint8_t * Limit)   // overrun test
 {
-    bool ret_flag;
+    bool ret_flag, good;
     uint32_t key_len, val_len;
+    uint64_t key_tail;
 
     ret_flag=false;
+    good=true;
+    key_tail=KeyTail(Key, KeyLen);
 
-    while((Cursor+sizeof(uint32_t))<Limit && !ret_flag)
+    while(good && !ret_flag && Cursor<Limit)
     {
-        key_len=ntohl(*(uint32_t *)Cursor);
-        Cursor+=sizeof(uint32_t);
+        good=ReadBigEndian32(Cursor, Limit, key_len)
+            && key_len<(size_t)(Limit - Cursor);
 
-        // +1 is for "type byte" preamble
-        if (key_len==(KeyLen+1) && (Cursor+key_len)<Limit)
-            ret_flag=(0==memcmp(Key, (Cursor+1), KeyLen));
+        if (good)
+        {
+            // +1 is for "type byte" preamble
+            if (key_len==(KeyLen+1))
+                ret_flag=KeyMatches(Cursor+1, Key, KeyLen, key_tail);
 
-        // move to value
-        Cursor+=key_len;
+            // move to value
+            Cursor+=key_len;
 
-        // skip over value if no match
-        if (!ret_flag)
-        {
-            val_len=ntohl(*(uint32_t *)Cursor);
-            Cursor+=sizeof(uint32_t);
-            Cursor+=val_len;
+            // skip over value if no match
+            if (!ret_flag)
+            {
+                good=ReadBigEndian32(Cursor, Limit, val_len)
+                    && val_len<=(size_t)(Limit - Cursor);
+                if (good)
+                    Cursor+=val_len;
+            }   // if
         }   // if
     }   // while
 
@@ -495,86 +1147,68 @@ FindMetaEntry(
     const uint8_t * Limit)   // overrun test
 {
     bool ret_flag, good;
-    uint32_t meta_len, key_len, list_len;
+    uint32_t meta_len, key_len, val_len, list_len;
     const uint8_t * meta_limit;
     uint16_t temp16;
+    uint32_t temp32;
+    uint64_t key_tail;
 
     meta_limit=Limit;
     ret_flag=false;
     list_len=0;
-    good=((Cursor+sizeof(uint32_t))<Limit);
+    key_tail=KeyTail(Key, KeyLen);
+    // meta length must fit within dictionary entry
+    good=ReadBigEndian32(Cursor, Limit, meta_len)
+        && meta_len<=(size_t)(Limit - Cursor);
 
+    // test for list tag, get count of elements:
+    //  "type byte", "new term" tag, "list term" tag, then list length
     if (good)
     {
-        meta_len=ntohl(*(uint32_t *)Cursor);
         meta_limit=Cursor+meta_len;
-        Cursor+=sizeof(uint32_t);
-    }   // if
-
-    // test for list tag, get count of elements
-    if (good && Cursor<meta_limit && meta_limit<=Limit)
-    {
-        good=(0x00==*Cursor);
-        ++Cursor;
-        // look for "new term" tag
-        good=(good && Cursor<meta_limit && 0x83==*Cursor);
-        ++Cursor;
-        // look for "list term" tag
-        good=(good && Cursor<meta_limit && 0x6c==*Cursor);
-        ++Cursor;
-
-        good=(good && (Cursor+sizeof(uint32_t))<meta_limit);
-        if (good)
-        {
-            list_len=ntohl(*(uint32_t *)Cursor);
-            Cursor+=sizeof(uint32_t);
-        }   // if
+        good=(3+sizeof(uint32_t) < meta_len)
+            && 0x00==Cursor[0] && 0x83==Cursor[1] && 0x6c==Cursor[2];
+        Cursor+=(good ? 3 : 0);
+        good=good && ReadBigEndian32(Cursor, meta_limit, list_len);
     }   // if
 
     // walk each of the meta list elements.  if we hit one
     //  we do not understand, stop.  maybe log to syslog
-    while(good && list_len && (Cursor+1)<meta_limit && !ret_flag)
+    //  Each element is 68 02 6b 00 KeyLen Key 6b 00 ValLen Value,
+    //  so one word compare validates the element and key headers
+    //  and one bounds test covers key plus value header.
+    while(good && list_len && !ret_flag)
     {
         // element should be a two element tuple
         //  (element NIL_EXT will be last in list and fail prefix test)
-        temp16=*(uint16_t *)Cursor;
-        Cursor+=sizeof(uint16_t);
-        good=cTwoTuplePrefix.m_Uint16==temp16 && (Cursor+sizeof(uint16_t))<meta_limit;
-
-        // decode "key"
+        good=(cMetaPairHeaderSize < (size_t)(meta_limit - Cursor));
         if (good)
         {
-            temp16=*(uint16_t *)Cursor;
-            Cursor+=sizeof(uint16_t);
-            good=cStringPrefix.m_Uint16==temp16 && (Cursor+sizeof(uint16_t))<meta_limit;
-
-            // get string/key length
-            if (good)
-                key_len=*Cursor;
-            else
-                key_len=0;
-            ++Cursor;
-
-            if (good && key_len==KeyLen && (Cursor+key_len)<meta_limit)
-                ret_flag=(0==memcmp(Cursor, Key, key_len));
-
-            Cursor+=key_len;
+            memcpy(&temp32, Cursor, sizeof(uint32_t));
+            key_len=Cursor[sizeof(uint32_t)];
+            Cursor+=cMetaPairHeaderSize;
+            good=(cMetaPairPrefix.m_Uint32==temp32
+                  && key_len + sizeof(uint16_t) < (size_t)(meta_limit - Cursor));
         }   // if
 
-        // skip over value if wrong key
-        if (good && !ret_flag)
+        if (good)
         {
-            temp16=*(uint16_t *)Cursor;
-            Cursor+=sizeof(uint16_t);
-            good=cStringPrefix.m_Uint16==temp16 && (Cursor+sizeof(uint16_t))<meta_limit;
+            if (key_len==KeyLen)
+                ret_flag=KeyMatches(Cursor, Key, KeyLen, key_tail);
 
-            // get string/key length
-            if (good)
-                key_len=*Cursor;
-            else
-                key_len=0;
-            Cursor+=(1+key_len);
-            --list_len;
+            Cursor+=key_len;
+
+            // skip over value if wrong key
+            if (!ret_flag)
+            {
+                memcpy(&temp16, Cursor, sizeof(uint16_t));
+                val_len=Cursor[sizeof(uint16_t)];
+                Cursor+=sizeof(uint16_t) + 1;
+                good=cStringPrefix.m_Uint16==temp16
+                    && val_len<=(size_t)(meta_limit - Cursor);
+                Cursor+=(good ? val_len : 0);
+                --list_len;
+            }   // if
         }   // if
     }   // while
 
@@ -584,104 +1218,106 @@ FindMetaEntry(
 
 
 
-bool
+/**
+ * Length of sext binary starting at Cursor, fully validated
+ *  (1 bits, pad bits, terminator) and never reading at or past
+ *  Limit.  Whole 9 byte groups take one 64 bit load each.
+ */
+static inline bool
 GetBinaryLength(
     const uint8_t * Cursor, // first byte of binary (after tag)
     const uint8_t * Limit,  // safety limit / overrun protection
     int & Length,           // output: count of bytes
-    bool DecodedLength)
+    bool DecodedLength)     // true: decoded bytes, false: encoded bytes incl. terminator
 {
-    bool good, again;
-    uint8_t mask;
-    const uint8_t * start;
-
-    mask=0x80;
-    Length=0;
-    start=Cursor;
-
-    do
-    {
-        good=Cursor<Limit;
-
-        if (good)
-        {
-            again=(0!=(*Cursor & mask));
-            if (again)
-            {
-                ++Length;
-                ++Cursor;
-                mask>>=1;
+    bool good;
+    const uint8_t * cursor;
+    size_t length;
 
-                if (0==mask)
-                {
-                    ++Cursor;
-                    mask=0x80;
-                }   // if
-            }   // if
-        }   // if
-    } while(again && good);
+    cursor=Cursor;
+    good=SextMeasure(cursor, Limit, length);
 
-    // +2 -> +1 for Cursor on 0 byte, +1 to next
     if (!DecodedLength)
-        Length=(Cursor-start) +2;
+        length=cursor - Cursor;
+
+    Length=(good ? (int)length : 0);
 
     return(good);
 
 }   // GetBinaryLength
 
 
-bool GetBinary(
+/**
+ * Original bit at a time decode, kept as the reference for
+ *  SextUnpack() in tests.  Bounds checked before every read.
+ */
+bool GetBinaryBytes(
     const uint8_t * &Cursor, // first byte of binary (after tag), output: position after binary
     const uint8_t * Limit,  // safety limit / overrun protection
     uint8_t * Output)       // output: guaranteed storage
 {
     bool good, again;
     uint8_t mask, temp_char, high_bits, low_bits, shift;
+    const uint8_t * start;
 
     mask=0x80;
     low_bits=0x7f;
     high_bits=0x80;
     shift=1;
+    start=Cursor;
 
     do
     {
         good=Cursor<Limit;
+        again=good && (0!=(*Cursor & mask));
 
-        if (good)
+        if (again)
         {
-            again=(0!=(*Cursor & mask));
-            if (again)
-            {
-                temp_char=(*Cursor & low_bits) << shift;
-                ++Cursor;
-                temp_char+=(*Cursor & high_bits) >> (8 - shift);
+            temp_char=(*Cursor & low_bits) << shift;
+            ++Cursor;
+            good=Cursor<Limit;
+        }   // if
 
-                *Output=temp_char;
-                ++Output;
+        if (again && good)
+        {
+            temp_char+=(*Cursor & high_bits) >> (8 - shift);
 
-                mask>>=1;
-                low_bits &=(~mask);
-                high_bits |= mask;
-                ++shift;
+            *Output=temp_char;
+            ++Output;
 
-                if (0==mask)
-                {
-                    ++Cursor;
-                    mask=0x80;
-                    low_bits=0x7f;
-                    high_bits=0x80;
-                    shift=1;
-                }   // if
+            mask>>=1;
+            low_bits &=(~mask);
+            high_bits |= mask;
+            ++shift;
+
+            if (0==mask)
+            {
+                ++Cursor;
+                mask=0x80;
+                low_bits=0x7f;
+                high_bits=0x80;
+                shift=1;
             }   // if
         }   // if
     } while(again && good);
 
-    ++Cursor;
-    ++Cursor;
+    // empty binary is the terminator alone, otherwise
+    //  zero pad bits from mask down, then terminator
+    if (good && start==Cursor && 8==*Cursor)
+    {
+        ++Cursor;
+    }   // if
+    else
+    {
+        good=good && 0==(*Cursor & ((mask << 1) - 1))
+            && 2<=(Limit - Cursor) && 8==Cursor[1];
+        if (good)
+            Cursor+=2;
+    }   // else
 
     return(good);
 
-}   // GetBinary
+}   // GetBinaryBytes
 
 
 /**
@@ -695,47 +1331,102 @@ BuildRiakKey(
     std::string & Output)
 {
     bool ret_flag(true);
-    int tot_size;
-    char * cursor;
+    size_t type_len, bucket_len, key_len, tot_size;
 
     Output.clear();
 
     if (NULL!=Bucket && NULL!=Key)
     {
-        // calculate size of output
-        tot_size=5;       // tuple tag & tuple count
-        tot_size+=4;      // atom tag & 'o'
+        type_len=(NULL!=BucketType ? strlen(BucketType) : 0);
+        bucket_len=strlen(Bucket);
+        key_len=strlen(Key);
+
+        // exact size of output
+        tot_size=SextTupleSize() + SextBinarySize(1);
+        if (0!=type_len)
+            tot_size+=SextTupleSize() + SextBinarySize(type_len);
+        tot_size+=SextBinarySize(bucket_len) + SextBinarySize(key_len);
+
+        Output.resize(tot_size);
+        SextWriter writer((char *)Output.data(), Output.size());
+
+        writer.PutTuple(3);         // Riak key is a 3 tuple
+        writer.PutAtom("o");
 
-        if (NULL!=BucketType && '\0'!=*BucketType)
+        if (0!=type_len)
         {
-            tot_size+=5;  // tuple tag & tuple count
-            tot_size+= (strlen(BucketType)*8)/7 +3;
-        }
+            writer.PutTuple(2);     // {type,bucket} tuple prefix
+            writer.PutBinary(Slice(BucketType, type_len));
+        }   // if
+
+        writer.PutBinary(Slice(Bucket, bucket_len));
+        writer.PutBinary(Slice(Key, key_len));
 
-        tot_size+= (strlen(Bucket)*8)/7 +3;
-        tot_size+= (strlen(Key)*8)/7 +3;
+        ret_flag=writer.IsGood() && writer.GetSize()==tot_size;
+    }   // if
+    else
+    {
+        ret_flag=false;
+    }   // else
+
+    return(ret_flag);
+
+}   // BuildRiakKey
+
+
+/**
+ * Testing tool:  builds sext encoded 2i entry
+ *  {i, Bucket, <<Field>>, <<Term>>, <<Key>>}
+ *  (Riak also allows integer Terms, not supported here)
+ */
+bool
+BuildRiakIndexKey(
+    const char * BucketType,
+    const char * Bucket,
+    const char * Field,
+    const char * Term,
+    const char * Key,
+    std::string & Output)
+{
+    bool ret_flag(true);
+    size_t type_len, tot_size;
+    Slice bucket, field, term, key;
+
+    Output.clear();
+
+    if (NULL!=Bucket && NULL!=Field && NULL!=Term && NULL!=Key)
+    {
+        type_len=(NULL!=BucketType ? strlen(BucketType) : 0);
+        bucket=Bucket;
+        field=Field;
+        term=Term;
+        key=Key;
+
+        // exact size of output
+        tot_size=SextTupleSize() + SextBinarySize(1);
+        if (0!=type_len)
+            tot_size+=SextTupleSize() + SextBinarySize(type_len);
+        tot_size+=SextBinarySize(bucket.size()) + SextBinarySize(field.size())
+            + SextBinarySize(term.size()) + SextBinarySize(key.size());
 
         Output.resize(tot_size);
-        cursor=(char *)Output.data();
-        *(uint32_t *)cursor=cSextPrefix.m_Uint32;
-        cursor+=4;
-        *cursor=0x3;        // Riak key is a 3 tuple
-        ++cursor;
-        *(uint32_t *)cursor=cOKeyPrefix.m_Uint32;
-        cursor+=4;
+        SextWriter writer((char *)Output.data(), Output.size());
 
-        if (NULL!=BucketType && '\0'!=*BucketType)
-        {
-            *(uint32_t *)cursor=cSextPrefix.m_Uint32;
-            cursor+=4;
-            *cursor=0x2;        // {type,bucket} tuple prefix
-            ++cursor;
+        writer.PutTuple(5);         // 2i key is a 5 tuple
+        writer.PutAtom("i");
 
-            WriteSextString(18, BucketType, cursor);
+        if (0!=type_len)
+        {
+            writer.PutTuple(2);     // {type,bucket} tuple prefix
+            writer.PutBinary(Slice(BucketType, type_len));
         }   // if
 
-        WriteSextString(18, Bucket, cursor);
-        WriteSextString(18, Key, cursor);
+        writer.PutBinary(bucket);
+        writer.PutBinary(field);
+        writer.PutBinary(term);
+        writer.PutBinary(key);
+
+        ret_flag=writer.IsGood() && writer.GetSize()==tot_size;
     }   // if
     else
     {
@@ -744,66 +1435,196 @@ BuildRiakKey(
 
     return(ret_flag);
 
-}   // BuildRiakKey
+}   // BuildRiakIndexKey
 
 
 /**
- * Writes a binary encoded sext string.  Assumes
- *  storage already allocated properly
+ * Testing tool:  builds Riak v1 object with Siblings copies of
+ *  Value, all with the same LastMod time and deleted flag
  */
 bool
-WriteSextString(
-    int Prefix,
-    const char * Text,
-    char * & Cursor)
+BuildRiakObject(
+    const Slice & Value,
+    uint64_t LastModMicros,
+    int Siblings,
+    bool Deleted,
+    std::string & Output)
 {
-    bool ret_flag(true), skip(false);
-    int position;
-    uint8_t new_char, carry_over, *input;
+    return(BuildRiakObject(Value, LastModMicros, Siblings, Deleted, 0, 0, Output));
 
-    position=1;
-    carry_over=0;
-    input=(uint8_t *)Text;
+}   // BuildRiakObject
 
-    *Cursor=(char)Prefix;
-    ++Cursor;
 
-    while(*input)
+/**
+ * Testing / benchmark tool:  as above, plus an X-Riak-Meta dictionary
+ *  entry holding MetaEntries user meta pairs.  A non-zero
+ *  ExpiryBaseSeconds adds X-Riak-Meta-Expiry-Base-Seconds as the
+ *  final pair (so a search walks every other pair first).
+ */
+bool
+BuildRiakObject(
+    const Slice & Value,
+    uint64_t LastModMicros,
+    int Siblings,
+    bool Deleted,
+    int MetaEntries,
+    uint64_t ExpiryBaseSeconds,
+    std::string & Output)
+{
+    bool ret_flag(true);
+    int loop, pairs;
+    uint32_t temp;
+    std::string user_meta;
+    char name[32], number[24];
+    static const char vclock[]="fake_vclock";
+    static const char vtag[]="4v21oeEizRddgF1BGC9Rjy";
+    static const char meta_key[]="X-Riak-Meta";
+    static const char expiry_key[]="X-Riak-Meta-Expiry-Base-Seconds";
+    uint32_t meta_size=3*sizeof(uint32_t) + 1 + sizeof(vtag)-1 + 1;
+
+    Output.clear();
+
+    // X-Riak-Meta value:  type byte, then term_to_binary() of
+    //  [{"X-Riak-Meta-Name", "Value"}, ...]
+    pairs=MetaEntries + (0!=ExpiryBaseSeconds ? 1 : 0);
+    if (0!=pairs)
     {
-        *Cursor=(1<<(8-position)) + carry_over + (*input >> position);
-        carry_over=((uint8_t)*input<<(8-position));
-        ++Cursor;
-        ++input;
-        ++position;
-        if (8==position)
+        user_meta.push_back((char)0);
+        user_meta.push_back((char)eTermVersion);
+        user_meta.push_back((char)eTermList);
+        temp=htonl(pairs);
+        user_meta.append((const char *)&temp, sizeof(temp));
+
+        for (loop=0; loop<pairs; ++loop)
         {
-            position=1;
-            *Cursor=carry_over + (*input ? 1 : 0);
-            ++Cursor;
-            carry_over=0;
-            if (*input)
+            if (loop<MetaEntries)
             {
-                *Cursor=*input;
-                ++input;
-                ++Cursor;
+                snprintf(name, sizeof(name), "X-Riak-Meta-Field-%06d", loop);
+                snprintf(number, sizeof(number), "value%d", loop);
             }   // if
             else
             {
-                skip=true;
-            }   // elxe
+                snprintf(name, sizeof(name), "%s", expiry_key);
+                snprintf(number, sizeof(number), "%llu", (unsigned long long)ExpiryBaseSeconds);
+            }   // else
+
+            user_meta.append((const char *)cTwoTuplePrefix.m_Bytes, sizeof(cTwoTuplePrefix.m_Bytes));
+            user_meta.append((const char *)cStringPrefix.m_Bytes, sizeof(cStringPrefix.m_Bytes));
+            user_meta.push_back((char)strlen(name));
+            user_meta.append(name);
+            user_meta.append((const char *)cStringPrefix.m_Bytes, sizeof(cStringPrefix.m_Bytes));
+            user_meta.push_back((char)strlen(number));
+            user_meta.append(number);
+        }   // for
+        user_meta.push_back((char)eTermNil);
+
+        // dictionary item: key length, type byte + key, value length, value
+        meta_size+=sizeof(uint32_t) + 1 + sizeof(meta_key)-1
+            + sizeof(uint32_t) + user_meta.size();
+    }   // if
+
+    Output.append((const char *)cRiakObjV1.m_Bytes, sizeof(cRiakObjV1.m_Bytes));
+
+    temp=htonl(sizeof(vclock)-1);
+    Output.append((const char *)&temp, sizeof(temp));
+    Output.append(vclock, sizeof(vclock)-1);
+
+    temp=htonl(Siblings);
+    Output.append((const char *)&temp, sizeof(temp));
+
+    for (loop=0; loop<Siblings; ++loop)
+    {
+        temp=htonl(Value.size());
+        Output.append((const char *)&temp, sizeof(temp));
+        Output.append(Value.data(), Value.size());
+
+        temp=htonl(meta_size);
+        Output.append((const char *)&temp, sizeof(temp));
+
+        // LastMod:  megaseconds, seconds, microseconds
+        temp=htonl((uint32_t)(LastModMicros / 1000000000000ULL));
+        Output.append((const char *)&temp, sizeof(temp));
+        temp=htonl((uint32_t)((LastModMicros / 1000000) % 1000000));
+        Output.append((const char *)&temp, sizeof(temp));
+        temp=htonl((uint32_t)(LastModMicros % 1000000));
+        Output.append((const char *)&temp, sizeof(temp));
+
+        Output.push_back((char)(sizeof(vtag)-1));
+        Output.append(vtag, sizeof(vtag)-1);
+        Output.push_back(Deleted ? 1 : 0);
+
+        if (0!=pairs)
+        {
+            temp=htonl(1 + sizeof(meta_key)-1);
+            Output.append((const char *)&temp, sizeof(temp));
+            Output.push_back((char)0);
+            Output.append(meta_key, sizeof(meta_key)-1);
+
+            temp=htonl(user_meta.size());
+            Output.append((const char *)&temp, sizeof(temp));
+            Output.append(user_meta);
         }   // if
-    }   // while
+    }   // for
+
+    return(ret_flag);
+
+}   // BuildRiakObject
 
-    if (!skip)
+
+/**
+ * Writes a binary encoded sext string.  Assumes
+ *  storage already allocated properly, SextBinarySize(strlen(Text))
+ */
+bool
+WriteSextString(
+    int Prefix,
+    const char * Text,
+    char * & Cursor)
+{
+    *Cursor=(char)Prefix;
+    ++Cursor;
+    Cursor+=SextPack((const uint8_t *)Text, strlen(Text), Cursor);
+
+    return(true);
+
+}   // WriteSextString
+
+
+/**
+ * Testing tool:  decodes one sext binary (tag byte included)
+ *  using either the whole group decode or the original bit at
+ *  a time decode.
+ */
+bool
+DecodeSextBinary(
+    const Slice & Encoded,
+    std::string & Output,
+    bool WholeGroups)
+{
+    bool ret_flag;
+    const uint8_t * cursor, * limit;
+    int length;
+    size_t used;
+
+    Output.clear();
+    cursor=(const uint8_t *)Encoded.data();
+    limit=cursor + Encoded.size();
+
+    ret_flag=(cursor<limit && 18==*cursor);
+    ++cursor;
+
+    ret_flag=ret_flag && GetBinaryLength(cursor, limit, length);
+    if (ret_flag)
     {
-        *Cursor=carry_over;
-        ++Cursor;
+        Output.resize(length);
+        if (WholeGroups)
+            ret_flag=SextUnpack(cursor, limit, (uint8_t *)Output.data(), length, used);
+        else
+            ret_flag=GetBinaryBytes(cursor, limit, (uint8_t *)Output.data());
     }   // if
-    *Cursor=0x08;
-    ++Cursor;
 
     return(ret_flag);
 
-}   // WriteSextString
+}   // DecodeSextBinary
 
 }  // namespace leveldb
@@ -24,6 +24,7 @@
 #define RIAK_OBJECT_H
 
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 #include "leveldb/slice.h"
@@ -31,16 +32,85 @@
 
 namespace leveldb
 {
+    /**
+     * One sibling of a Riak v1 object.  All Slices point into
+     *  the value given to RiakObjectView::Parse().
+     */
+    struct RiakSiblingView
+    {
+        Slice m_Value;             // sibling's value (user data)
+        Slice m_Meta;              // sibling's entire metadata binary
+        uint64_t m_LastModMicros;  // metadata's LastMod timestamp
+        Slice m_VTag;
+        bool m_Deleted;            // metadata's deleted flag
+        Slice m_Dictionary;        // remaining metadata key/value pairs
+    };
+
+
+    /**
+     * Zero copy map of a Riak v1 object built by one bounds
+     *  checked pass.  Reusing one view across values avoids
+     *  repeated allocation for objects with many siblings.
+     */
+    class RiakObjectView
+    {
+    public:
+        RiakObjectView() : m_Valid(false), m_SiblingCount(0) {};
+
+        // true if Value is a complete Riak v1 object
+        bool Parse(const Slice & Value);
+
+        void Clear();
+
+        bool IsValid() const {return(m_Valid);};
+        const Slice & GetVClock() const {return(m_VClock);};
+        size_t GetSiblingCount() const {return(m_SiblingCount);};
+        const RiakSiblingView & GetSibling(size_t Index) const
+            {return(Index<kInlineSiblings ? m_Inline[Index] : m_Overflow[Index-kInlineSiblings]);};
+
+        // most recent LastMod across siblings, 0 if none
+        uint64_t GetLastModMicros() const;
+
+        // true if at least one sibling and all marked deleted
+        bool IsAllDeleted() const;
+
+    protected:
+        static const size_t kInlineSiblings=4;
+
+        RiakSiblingView & NextSibling();
+
+        bool m_Valid;
+        Slice m_VClock;
+        size_t m_SiblingCount;
+        RiakSiblingView m_Inline[kInlineSiblings];     // typical objects
+        std::vector<RiakSiblingView> m_Overflow;        // sibling explosions
+    };  // class RiakObjectView
+
+
     bool KeyGetBucket(const Slice & Key, std::string & BucketType, std::string & Bucket);
     bool KeyGetBucket(const Slice & Key, Slice & CompositeBucket);
+    bool KeyIsRiakIndex(const Slice & Key);
     void KeyParseBucket(const Slice & CompositeBucket,
                         std::string & BucketType, std::string & Bucket);
+    bool KeyParseBucket(const Slice & CompositeBucket, char * Buffer, size_t BufferSize,
+                        Slice & BucketType, Slice & Bucket);
 
     bool ValueGetLastModTimeMicros(Slice Value, uint64_t & LastModTimeMicros);
+    bool ValueGetLastModTimeMicros(const RiakObjectView & View, const Slice & Value,
+                                   uint64_t & LastModTimeMicros);
+    bool ValueIsRiakTombstone(const Slice & Value);
 
     // routines for unit test support
     bool WriteSextString(int Prefix, const char * Text, char * & Cursor);
     bool BuildRiakKey(const char * BucketType, const char * Bucket, const char * Key, std::string & Output);
+    bool BuildRiakIndexKey(const char * BucketType, const char * Bucket, const char * Field,
+                           const char * Term, const char * Key, std::string & Output);
+    bool DecodeSextBinary(const Slice & Encoded, std::string & Output, bool WholeGroups=true);
+    bool BuildRiakObject(const Slice & Value, uint64_t LastModMicros, int Siblings,
+                         bool Deleted, std::string & Output);
+    bool BuildRiakObject(const Slice & Value, uint64_t LastModMicros, int Siblings,
+                         bool Deleted, int MetaEntries, uint64_t ExpiryBaseSeconds,
+                         std::string & Output);
 
 }  // namespace leveldb
 
@@ -0,0 +1,128 @@
+// -------------------------------------------------------------------
+//
+// riak_object_fuzz.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+
+// libFuzzer entry for the key and value decoders that see every
+//  write and compaction.  Build with clang:
+//
+//    clang++ -g -O1 -fsanitize=fuzzer,address,undefined -I.. -I../include
+//        -DRIAK_OBJECT_FUZZ riak_object_fuzz.cc riak_object.cc sext.cc
+//        -o riak_object_fuzz
+//
+//  Define RIAK_OBJECT_FUZZ_STANDALONE as well to build without
+//  libFuzzer; the program then replays the files named on its command
+//  line (a saved crash, or a corpus) under any compiler's sanitizers.
+//
+//  Without RIAK_OBJECT_FUZZ the file compiles to nothing, so the
+//  library build's *.cc source list may include it safely.
+
+#ifdef RIAK_OBJECT_FUZZ
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "leveldb/slice.h"
+#include "leveldb_ee/riak_object.h"
+#include "leveldb_ee/sext.h"
+
+
+extern "C" int
+LLVMFuzzerTestOneInput(
+    const uint8_t * Data,
+    size_t Size)
+{
+    leveldb::Slice input((const char *)Data, Size), composite, type_slice, bucket_slice, skipped;
+    std::string type, bucket;
+    char buffer[64];
+    uint64_t micros;
+    leveldb::RiakObjectView view;
+
+    // same input as key ...
+    if (leveldb::KeyGetBucket(input, composite))
+    {
+        leveldb::KeyParseBucket(composite, type, bucket);
+        leveldb::KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+    }   // if
+    leveldb::KeyIsRiakIndex(input);
+
+    // ... as a composite bucket that KeyGetBucket did not vet ...
+    leveldb::KeyParseBucket(input, type, bucket);
+    leveldb::KeyParseBucket(input, buffer, sizeof(buffer), type_slice, bucket_slice);
+
+    // ... as general sext ...
+    leveldb::SextReader reader(input);
+    while (reader.Skip(skipped))
+    {}
+
+    // ... and as value
+    leveldb::ValueGetLastModTimeMicros(input, micros);
+    leveldb::ValueIsRiakTombstone(input);
+    view.Parse(input);
+
+    return(0);
+
+}   // LLVMFuzzerTestOneInput
+
+
+#ifdef RIAK_OBJECT_FUZZ_STANDALONE
+/**
+ * Replay each file named on the command line
+ */
+int
+main(
+    int argc,
+    char ** argv)
+{
+    int loop, ret_val;
+    FILE * file;
+    std::string input;
+    char block[4096];
+    size_t count;
+
+    ret_val=0;
+    for (loop=1; loop<argc; ++loop)
+    {
+        file=fopen(argv[loop], "rb");
+        if (NULL!=file)
+        {
+            input.clear();
+            while (0!=(count=fread(block, 1, sizeof(block), file)))
+                input.append(block, count);
+            fclose(file);
+
+            LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+        }   // if
+        else
+        {
+            fprintf(stderr, "unable to open %s\n", argv[loop]);
+            ret_val=1;
+        }   // else
+    }   // for
+
+    return(ret_val);
+
+}   // main
+#endif  // RIAK_OBJECT_FUZZ_STANDALONE
+
+#endif  // RIAK_OBJECT_FUZZ
@@ -20,14 +20,46 @@
 //
 // -------------------------------------------------------------------
 
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string>
 
 #include "util/testharness.h"
 #include "util/testutil.h"
 
+#include "port/port.h"
+
 #include "leveldb_ee/riak_object.h"
 
 
+// count of heap allocations, lets tests prove a path is malloc free
+static volatile int gNewCalls(0);
+
+void *
+operator new(
+    size_t Size)
+{
+    void * ret_ptr;
+
+    ++gNewCalls;
+    ret_ptr=malloc(Size);
+    if (NULL==ret_ptr)
+        throw std::bad_alloc();
+
+    return(ret_ptr);
+
+}   // operator new
+
+
+void
+operator delete(
+    void * Ptr) throw()
+{
+    free(Ptr);
+}   // operator delete
+
+
 /**
  * Execution routine
  */
@@ -330,6 +362,129 @@ TEST(RiakObjectTester, KeyDecodeTest)
 }   // KeyDecodeTester
 
 
+/**
+ * Buffer based KeyParseBucket must match std::string version
+ *  and never touch the heap
+ */
+TEST(RiakObjectTester, KeyParseBufferTest)
+{
+    bool ret_flag;
+    int new_calls;
+    std::string key_bt, key_b, bucket_type, bucket;
+    Slice composite, type_slice, bucket_slice;
+    char buffer[256], small_buffer[8];
+
+    ret_flag=BuildRiakKey("really_long_bucket_type_name", "even_longer_than_really_long_bucket_name",
+                          "key0", key_bt);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=BuildRiakKey(NULL, "a_bucket_name_longer_than_sso", "key0", key_b);
+    ASSERT_TRUE(ret_flag);
+
+    // bucket type and bucket
+    new_calls=gNewCalls;
+    ret_flag=KeyGetBucket(key_bt, composite);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(new_calls, gNewCalls);
+
+    KeyParseBucket(composite, bucket_type, bucket);
+    ASSERT_TRUE(type_slice==Slice(bucket_type));
+    ASSERT_TRUE(bucket_slice==Slice(bucket));
+    ASSERT_EQ(0, strcmp(type_slice.data(), "really_long_bucket_type_name"));
+    ASSERT_EQ(0, strcmp(bucket_slice.data(), "even_longer_than_really_long_bucket_name"));
+
+    // buffer sized by composite is always enough
+    ASSERT_TRUE(composite.size()+2 <= sizeof(buffer));
+    ret_flag=KeyParseBucket(composite, buffer, composite.size()+2, type_slice, bucket_slice);
+    ASSERT_TRUE(ret_flag);
+
+    // too small a buffer reports failure, no overrun
+    ret_flag=KeyParseBucket(composite, small_buffer, sizeof(small_buffer), type_slice, bucket_slice);
+    ASSERT_FALSE(ret_flag);
+    ASSERT_TRUE(type_slice.empty() && bucket_slice.empty());
+
+    // bucket only
+    new_calls=gNewCalls;
+    ret_flag=KeyGetBucket(key_b, composite);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(new_calls, gNewCalls);
+
+    ASSERT_TRUE(type_slice.empty());
+    ASSERT_EQ(0, strcmp(type_slice.data(), ""));
+    ASSERT_EQ(0, strcmp(bucket_slice.data(), "a_bucket_name_longer_than_sso"));
+
+}   // KeyParseBufferTest
+
+
+/**
+ * Secondary index (2i) entries report their object's bucket
+ */
+TEST(RiakObjectTester, IndexKeyTest)
+{
+    bool ret_flag;
+    std::string object_key, index_key, bucket_type, bucket, atom;
+    Slice object_composite, index_composite;
+    char * cursor;
+
+    // 'i' atom as sext encodes it
+    atom.resize(8);
+    cursor=(char *)atom.data();
+    WriteSextString(12, "i", cursor);
+    atom.resize(cursor - atom.data());
+
+    // bucket type and bucket
+    ret_flag=BuildRiakKey("type_two", "dos_equis", "key0", object_key);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=BuildRiakIndexKey("type_two", "dos_equis", "age_int", "42", "key0", index_key);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(5, index_key[4]);
+    ASSERT_TRUE(Slice(index_key.data()+5, atom.size())==Slice(atom));
+
+    ASSERT_FALSE(KeyIsRiakIndex(object_key));
+    ASSERT_TRUE(KeyIsRiakIndex(index_key));
+
+    ret_flag=KeyGetBucket(object_key, object_composite);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=KeyGetBucket(index_key, index_composite);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(object_composite==index_composite);
+
+    ret_flag=KeyGetBucket(index_key, bucket_type, bucket);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(0, strcmp(bucket_type.c_str(), "type_two"));
+    ASSERT_EQ(0, strcmp(bucket.c_str(), "dos_equis"));
+
+    // bucket only
+    ret_flag=BuildRiakKey(NULL, "hello", "key0", object_key);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=BuildRiakIndexKey(NULL, "hello", "name_bin", "a_term", "key0", index_key);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(KeyIsRiakIndex(index_key));
+
+    ret_flag=KeyGetBucket(object_key, object_composite);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=KeyGetBucket(index_key, index_composite);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(object_composite==index_composite);
+
+    // all object keys sort ahead of all 2i keys
+    ASSERT_TRUE(object_key < index_key);
+
+    // a 5 tuple with 'o' atom is neither
+    index_key[5+1]=object_key[5+1];
+    ASSERT_FALSE(KeyIsRiakIndex(index_key));
+    ASSERT_FALSE(KeyGetBucket(index_key, index_composite));
+
+    // truncated 2i entry
+    ret_flag=BuildRiakIndexKey(NULL, "hello", "name_bin", "a_term", "key0", index_key);
+    ASSERT_FALSE(KeyGetBucket(Slice(index_key.data(), 12), index_composite));
+
+}   // IndexKeyTest
+
+
 /**
  * Test decode of various last write time values
  *  (look for quiet failures)
@@ -338,6 +493,7 @@ TEST(RiakObjectTester, LastModTest)
 {
     bool ret_flag;
     uint64_t ret_time;
+    size_t len;
 
     // X-Riak-Meta-Expiry-Base-Seconds: 1245495600 (date -d "2009-06-20 07:00:00" +%s)
     const char patriot_val[]={0x35, 0x01, 0x00, 0x00, 0x00, 0x22, 0x83, 0x6c, 0x00, 0x00,
@@ -565,10 +721,528 @@ TEST(RiakObjectTester, LastModTest)
     ASSERT_TRUE(ret_flag);
     ASSERT_TRUE(1478342700000000==ret_time);
 
+
+    // Riak v0 object (term_to_binary of #r_object{}), two contents
+    //  with X-Riak-Last-Modified {1478,342700,123456} and {1478,342701,5}
+    const char v0_val[]={0x83, 0x68, 0x07, 0x64, 0x00, 0x08, 0x72, 0x5f, 0x6f, 0x62,
+                         0x6a, 0x65, 0x63, 0x74, 0x6d, 0x00, 0x00, 0x00, 0x05, 0x62,
+                         0x75, 0x63, 0x6b, 0x30, 0x6d, 0x00, 0x00, 0x00, 0x04, 0x6b,
+                         0x65, 0x79, 0x30, 0x6c, 0x00, 0x00, 0x00, 0x02, 0x68, 0x03,
+                         0x64, 0x00, 0x09, 0x72, 0x5f, 0x63, 0x6f, 0x6e, 0x74, 0x65,
+                         0x6e, 0x74, 0x68, 0x09, 0x64, 0x00, 0x04, 0x64, 0x69, 0x63,
+                         0x74, 0x61, 0x03, 0x61, 0x10, 0x61, 0x10, 0x61, 0x08, 0x61,
+                         0x50, 0x61, 0x30, 0x68, 0x10, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x68, 0x01, 0x68, 0x10, 0x6c, 0x00, 0x00, 0x00, 0x01,
+                         0x6c, 0x00, 0x00, 0x00, 0x01, 0x6d, 0x00, 0x00, 0x00, 0x0c,
+                         0x63, 0x6f, 0x6e, 0x74, 0x65, 0x6e, 0x74, 0x2d, 0x74, 0x79,
+                         0x70, 0x65, 0x6b, 0x00, 0x0a, 0x74, 0x65, 0x78, 0x74, 0x2f,
+                         0x70, 0x6c, 0x61, 0x69, 0x6e, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6c, 0x00, 0x00, 0x00, 0x01, 0x6c, 0x00, 0x00, 0x00, 0x01,
+                         0x6d, 0x00, 0x00, 0x00, 0x0b, 0x58, 0x2d, 0x52, 0x69, 0x61,
+                         0x6b, 0x2d, 0x56, 0x54, 0x61, 0x67, 0x6b, 0x00, 0x16, 0x34,
+                         0x76, 0x32, 0x31, 0x6f, 0x65, 0x45, 0x69, 0x7a, 0x52, 0x64,
+                         0x64, 0x67, 0x46, 0x31, 0x42, 0x47, 0x43, 0x39, 0x52, 0x6a,
+                         0x79, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6c, 0x00, 0x00, 0x00,
+                         0x01, 0x6c, 0x00, 0x00, 0x00, 0x01, 0x6d, 0x00, 0x00, 0x00,
+                         0x14, 0x58, 0x2d, 0x52, 0x69, 0x61, 0x6b, 0x2d, 0x4c, 0x61,
+                         0x73, 0x74, 0x2d, 0x4d, 0x6f, 0x64, 0x69, 0x66, 0x69, 0x65,
+                         0x64, 0x68, 0x03, 0x62, 0x00, 0x00, 0x05, 0xc6, 0x62, 0x00,
+                         0x05, 0x3a, 0xac, 0x62, 0x00, 0x01, 0xe2, 0x40, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6d, 0x00, 0x00, 0x00, 0x09, 0x76,
+                         0x61, 0x6c, 0x75, 0x65, 0x20, 0x6f, 0x6e, 0x65, 0x68, 0x03,
+                         0x64, 0x00, 0x09, 0x72, 0x5f, 0x63, 0x6f, 0x6e, 0x74, 0x65,
+                         0x6e, 0x74, 0x68, 0x09, 0x64, 0x00, 0x04, 0x64, 0x69, 0x63,
+                         0x74, 0x61, 0x02, 0x61, 0x10, 0x61, 0x10, 0x61, 0x08, 0x61,
+                         0x50, 0x61, 0x30, 0x68, 0x10, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x68, 0x01, 0x68, 0x10, 0x6c, 0x00, 0x00, 0x00, 0x01,
+                         0x6c, 0x00, 0x00, 0x00, 0x01, 0x6d, 0x00, 0x00, 0x00, 0x14,
+                         0x58, 0x2d, 0x52, 0x69, 0x61, 0x6b, 0x2d, 0x4c, 0x61, 0x73,
+                         0x74, 0x2d, 0x4d, 0x6f, 0x64, 0x69, 0x66, 0x69, 0x65, 0x64,
+                         0x68, 0x03, 0x62, 0x00, 0x00, 0x05, 0xc6, 0x62, 0x00, 0x05,
+                         0x3a, 0xad, 0x61, 0x05, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6c,
+                         0x00, 0x00, 0x00, 0x01, 0x6c, 0x00, 0x00, 0x00, 0x01, 0x6d,
+                         0x00, 0x00, 0x00, 0x0b, 0x58, 0x2d, 0x52, 0x69, 0x61, 0x6b,
+                         0x2d, 0x4d, 0x65, 0x74, 0x61, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6d, 0x00, 0x00,
+                         0x00, 0x09, 0x76, 0x61, 0x6c, 0x75, 0x65, 0x20, 0x74, 0x77,
+                         0x6f, 0x6a, 0x6c, 0x00, 0x00, 0x00, 0x01, 0x68, 0x02, 0x6d,
+                         0x00, 0x00, 0x00, 0x08, 0x23, 0x09, 0xfe, 0xf9, 0xbe, 0x22,
+                         0xbd, 0x40, 0x68, 0x02, 0x61, 0x01, 0x62, 0x00, 0x00, 0x03,
+                         0xe8, 0x6a, 0x68, 0x09, 0x64, 0x00, 0x04, 0x64, 0x69, 0x63,
+                         0x74, 0x61, 0x00, 0x61, 0x10, 0x61, 0x10, 0x61, 0x08, 0x61,
+                         0x50, 0x61, 0x30, 0x68, 0x10, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x68, 0x01, 0x68, 0x10, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a, 0x6a,
+                         0x6a, 0x64, 0x00, 0x09, 0x75, 0x6e, 0x64, 0x65, 0x66, 0x69,
+                         0x6e, 0x65, 0x64};
+    Slice v0_slice(v0_val, sizeof(v0_val));
+
+    ret_flag=ValueGetLastModTimeMicros(v0_slice, ret_time);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(1478342701000005==ret_time);
+
+    // truncated v0 objects must fail quietly
+    for (len=0; len<sizeof(v0_val); ++len)
+    {
+        ret_flag=ValueGetLastModTimeMicros(Slice(v0_val, len), ret_time);
+        ASSERT_FALSE(ret_flag);
+    }   // for
+
+    // bucket replaced by a large bignum claiming 0xFFFFFFFF digits:
+    //  must fail, not wrap to a zero length term and parse on
+    std::string huge_big(v0_val, 14);
+    huge_big.append("\x6f\xff\xff\xff\xff", 5);
+    huge_big.append(v0_val + 24, sizeof(v0_val) - 24);
+    ret_flag=ValueGetLastModTimeMicros(huge_big, ret_time);
+    ASSERT_FALSE(ret_flag);
+
     return;
 
 }   // LastModTest
 
 
+// helpers to assemble Riak v1 objects for tests
+static void
+AppendBigEndian32(
+    std::string & Output,
+    uint32_t Value)
+{
+    Output.push_back((char)(Value >> 24));
+    Output.push_back((char)(Value >> 16));
+    Output.push_back((char)(Value >> 8));
+    Output.push_back((char)Value);
+}   // AppendBigEndian32
+
+
+static void
+AppendSibling(
+    std::string & Output,
+    const std::string & Value,
+    uint64_t LastModSeconds,
+    const std::string & VTag,
+    bool Deleted)
+{
+    std::string meta;
+
+    AppendBigEndian32(meta, (uint32_t)(LastModSeconds / 1000000));
+    AppendBigEndian32(meta, (uint32_t)(LastModSeconds % 1000000));
+    AppendBigEndian32(meta, 123456);
+    meta.push_back((char)VTag.size());
+    meta.append(VTag);
+    meta.push_back(Deleted ? 1 : 0);
+
+    AppendBigEndian32(Output, Value.size());
+    Output.append(Value);
+    AppendBigEndian32(Output, meta.size());
+    Output.append(meta);
+}   // AppendSibling
+
+
+/**
+ * Validate RiakObjectView's map of a multi sibling object
+ *  and its rejection of truncated objects
+ */
+TEST(RiakObjectTester, ObjectViewTest)
+{
+    bool ret_flag;
+    std::string object, vclock("fake_vclock");
+    RiakObjectView view;
+    size_t loop, len;
+    uint64_t mod_time;
+
+    object.push_back((char)0x35);
+    object.push_back((char)0x01);
+    AppendBigEndian32(object, vclock.size());
+    object.append(vclock);
+    AppendBigEndian32(object, 6);
+    for (loop=0; loop<6; ++loop)
+        AppendSibling(object, std::string(loop*10, 'v'), 1478342700 + loop,
+                      "vtag", 0!=(loop & 1));
+
+    ret_flag=view.Parse(object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(view.IsValid());
+    ASSERT_TRUE(view.GetVClock()==Slice(vclock));
+    ASSERT_EQ(6, view.GetSiblingCount());
+    ASSERT_FALSE(view.IsAllDeleted());
+    ASSERT_EQ(1478342705123456ULL, view.GetLastModMicros());
+
+    for (loop=0; loop<6; ++loop)
+    {
+        const RiakSiblingView & sib=view.GetSibling(loop);
+
+        ASSERT_EQ(loop*10, sib.m_Value.size());
+        ASSERT_EQ((1478342700 + loop)*1000000ULL + 123456, sib.m_LastModMicros);
+        ASSERT_TRUE(sib.m_VTag==Slice("vtag"));
+        ASSERT_EQ(0!=(loop & 1), sib.m_Deleted);
+        ASSERT_TRUE(sib.m_Dictionary.empty());
+    }   // for
+
+    ret_flag=ValueGetLastModTimeMicros(object, mod_time);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(1478342705123456ULL, mod_time);
+
+    // every truncation must fail cleanly
+    for (len=0; len<object.size(); ++len)
+    {
+        ret_flag=view.Parse(Slice(object.data(), len));
+        ASSERT_FALSE(ret_flag);
+        ASSERT_EQ(0, view.GetSiblingCount());
+    }   // for
+
+    // all siblings deleted
+    object.resize(2);
+    AppendBigEndian32(object, vclock.size());
+    object.append(vclock);
+    AppendBigEndian32(object, 2);
+    AppendSibling(object, "", 1478342700, "", true);
+    AppendSibling(object, "", 1478342701, "tag2", true);
+    ret_flag=view.Parse(object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(view.IsAllDeleted());
+    ASSERT_TRUE(ValueIsRiakTombstone(object));
+
+    // test tool's objects
+    ret_flag=BuildRiakObject("value", 1478342700123456ULL, 3, false, object);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=view.Parse(object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(3, view.GetSiblingCount());
+    ASSERT_EQ(1478342700123456ULL, view.GetLastModMicros());
+    ASSERT_TRUE(view.GetSibling(2).m_Value==Slice("value"));
+    ASSERT_FALSE(ValueIsRiakTombstone(object));
+
+    ret_flag=BuildRiakObject("", 1478342700123456ULL, 1, true, object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(ValueIsRiakTombstone(object));
+    ASSERT_FALSE(ValueIsRiakTombstone(Slice()));
+
+    // user meta, with and without expiry base override
+    ret_flag=BuildRiakObject("value", 1478342700123456ULL, 2, false, 20, 0, object);
+    ASSERT_TRUE(ret_flag);
+    ret_flag=view.Parse(object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_EQ(2, view.GetSiblingCount());
+    ASSERT_FALSE(view.GetSibling(1).m_Dictionary.empty());
+    ASSERT_TRUE(ValueGetLastModTimeMicros(object, mod_time));
+    ASSERT_EQ(1478342700123456ULL, mod_time);
+
+    ret_flag=BuildRiakObject("value", 1478342700123456ULL, 2, false, 20, 1478342800, object);
+    ASSERT_TRUE(ret_flag);
+    ASSERT_TRUE(ValueGetLastModTimeMicros(object, mod_time));
+    ASSERT_EQ(1478342800000000ULL, mod_time);
+
+}   // ObjectViewTest
+
+
+/**
+ * Whole group decode must match bit at a time decode
+ *  for every length across several 9 byte groups
+ */
+TEST(RiakObjectTester, SextGroupDecodeTest)
+{
+    bool ret_flag;
+    int length, loop;
+    std::string text, encoded, fast, slow;
+    char * cursor;
+
+    for (length=1; length<=80; ++length)
+    {
+        // sext test tool works on C strings, no zero bytes
+        text.clear();
+        for (loop=0; loop<length; ++loop)
+            text.push_back((char)(1 + (loop*37 + length*11) % 255));
+
+        encoded.resize((length*9)/8 + 3);
+        cursor=(char *)encoded.data();
+        WriteSextString(18, text.c_str(), cursor);
+        encoded.resize(cursor - encoded.data());
+
+        ret_flag=DecodeSextBinary(encoded, fast, true);
+        ASSERT_TRUE(ret_flag);
+        ret_flag=DecodeSextBinary(encoded, slow, false);
+        ASSERT_TRUE(ret_flag);
+        ASSERT_TRUE(text==fast);
+        ASSERT_TRUE(text==slow);
+    }   // for
+
+}   // SextGroupDecodeTest
+
+
+/**
+ * Not a pass/fail test.  Reports decoded bytes per second of
+ *  whole group decode versus bit at a time decode.
+ */
+TEST(RiakObjectTester, SextDecodeSpeed)
+{
+    const char * names[]={"buck0",
+                          "customer_sessions_2016",
+                          "really_long_bucket_type_name_used_by_a_"
+                          "time_series_table_with_many_columns_in_its_"
+                          "partition_key_and_even_more_after_that"};
+    const int iterations=500000;
+    int loop, name;
+    uint64_t start, fast_micros, slow_micros, bytes;
+    std::string encoded, output;
+    char * cursor;
+
+    for (name=0; name<3; ++name)
+    {
+        encoded.resize((strlen(names[name])*9)/8 + 3);
+        cursor=(char *)encoded.data();
+        WriteSextString(18, names[name], cursor);
+        encoded.resize(cursor - encoded.data());
+        bytes=(uint64_t)strlen(names[name]) * iterations;
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            DecodeSextBinary(encoded, output, true);
+        fast_micros=port::TimeMicros() - start + 1;
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            DecodeSextBinary(encoded, output, false);
+        slow_micros=port::TimeMicros() - start + 1;
+
+        fprintf(stderr, "sext decode %3d bytes: groups %7.1f MB/s, bytes %7.1f MB/s\n",
+                (int)strlen(names[name]),
+                (double)bytes / fast_micros, (double)bytes / slow_micros);
+    }   // for
+
+}   // SextDecodeSpeed
+
+
+/**
+ * Riak v1 object, one sibling whose dictionary holds Entries items.
+ *  The last dictionary item is X-Riak-Meta holding Entries user
+ *  meta pairs, the last of which is X-Riak-Meta-Expiry-Base-Seconds.
+ *  Other keys match the searched key lengths to defeat the length test.
+ */
+static void
+BuildMetaObject(
+    int Entries,
+    std::string & Output)
+{
+    std::string meta, user_meta, term;
+    char name[40];
+    int loop;
+
+    Output.clear();
+    Output.push_back((char)0x35);
+    Output.push_back((char)0x01);
+    AppendBigEndian32(Output, 11);
+    Output.append("fake_vclock");
+    AppendBigEndian32(Output, 1);
+
+    AppendBigEndian32(meta, 1478);
+    AppendBigEndian32(meta, 342700);
+    AppendBigEndian32(meta, 0);
+    meta.push_back((char)4);
+    meta.append("vtag");
+    meta.push_back((char)0);
+
+    for (loop=1; loop<Entries; ++loop)
+    {
+        snprintf(name, sizeof(name), "X-Riak-H%03d", loop);
+        AppendBigEndian32(meta, 1 + strlen(name));
+        meta.push_back((char)0);
+        meta.append(name);
+        AppendBigEndian32(meta, 5);
+        meta.append("value");
+    }   // for
+
+    // user meta as term_to_binary list of {string, string}
+    user_meta.push_back((char)0);
+    user_meta.push_back((char)0x83);
+    user_meta.push_back((char)0x6c);
+    AppendBigEndian32(user_meta, Entries);
+    for (loop=0; loop<Entries; ++loop)
+    {
+        if (loop+1<Entries)
+        {
+            snprintf(name, sizeof(name), "X-Riak-Meta-Custom-Field-%06d", loop);
+            term="v";
+        }   // if
+        else
+        {
+            snprintf(name, sizeof(name), "X-Riak-Meta-Expiry-Base-Seconds");
+            term="1478342800";
+        }   // else
+
+        user_meta.push_back((char)0x68);
+        user_meta.push_back((char)0x02);
+        user_meta.push_back((char)0x6b);
+        user_meta.push_back((char)0x00);
+        user_meta.push_back((char)strlen(name));
+        user_meta.append(name);
+        user_meta.push_back((char)0x6b);
+        user_meta.push_back((char)0x00);
+        user_meta.push_back((char)term.size());
+        user_meta.append(term);
+    }   // for
+    user_meta.push_back((char)0x6a);
+
+    AppendBigEndian32(meta, 12);
+    meta.push_back((char)0);
+    meta.append("X-Riak-Meta");
+    AppendBigEndian32(meta, user_meta.size());
+    meta.append(user_meta);
+
+    AppendBigEndian32(Output, 5);
+    Output.append("value");
+    AppendBigEndian32(Output, meta.size());
+    Output.append(meta);
+
+}   // BuildMetaObject
+
+
+/**
+ * Not a pass/fail test (beyond the decoded time).  Reports cost of
+ *  finding X-Riak-Meta-Expiry-Base-Seconds with 1, 10, and 100
+ *  dictionary and user meta entries.
+ */
+TEST(RiakObjectTester, MetaSearchSpeed)
+{
+    const int entries[]={1, 10, 100};
+    const int iterations=100000;
+    int loop, pass;
+    uint64_t start, micros, mod_time;
+    std::string object;
+
+    for (pass=0; pass<3; ++pass)
+    {
+        BuildMetaObject(entries[pass], object);
+
+        ASSERT_TRUE(ValueGetLastModTimeMicros(object, mod_time));
+        ASSERT_EQ(1478342800000000ULL, mod_time);
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            ValueGetLastModTimeMicros(object, mod_time);
+        micros=port::TimeMicros() - start;
+
+        fprintf(stderr, "meta search %3d entries: %7.1f ns per object\n",
+                entries[pass], (double)micros * 1000.0 / iterations);
+    }   // for
+
+}   // MetaSearchSpeed
+
+
+/**
+ * Every truncation and every single bit flip of valid keys and
+ *  objects must fail cleanly or decode, never read past the
+ *  input.  Each case is copied to an exactly sized heap buffer
+ *  so address sanitizer builds catch overruns.
+ *  (riak_object_fuzz.cc drives the same decoders at random)
+ */
+TEST(RiakObjectTester, MalformedInputTest)
+{
+    std::string inputs[4], type, bucket;
+    size_t input, len, bit;
+    Slice composite, type_slice, bucket_slice;
+    uint64_t mod_time;
+    char * copy, buffer[128];
+
+    ASSERT_TRUE(BuildRiakKey(NULL, "customer_sessions", "key_000123", inputs[0]));
+    ASSERT_TRUE(BuildRiakKey("time_series_table", "b2345678", "k", inputs[1]));
+    ASSERT_TRUE(BuildRiakIndexKey("type1", "buck1", "field_bin", "term", "key0", inputs[2]));
+    ASSERT_TRUE(BuildRiakObject("value", 1478342700123456ULL, 2, false, 2, 0, inputs[3]));
+
+    for (input=0; input<4; ++input)
+    {
+        for (len=0; len<=inputs[input].size(); ++len)
+        {
+            copy=new char[len + 1];
+            memcpy(copy, inputs[input].data(), len);
+
+            if (KeyGetBucket(Slice(copy, len), composite))
+            {
+                KeyParseBucket(composite, type, bucket);
+                KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+            }   // if
+
+            // no truncation of an object holds a whole sibling
+            if (3==input && len<inputs[input].size())
+                ASSERT_FALSE(ValueGetLastModTimeMicros(Slice(copy, len), mod_time));
+
+            // bit flips only on whole input
+            for (bit=0; len==inputs[input].size() && bit<len*8; ++bit)
+            {
+                copy[bit/8]^=(char)(1 << (bit%8));
+                if (KeyGetBucket(Slice(copy, len), composite))
+                    KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+                KeyParseBucket(Slice(copy, len), buffer, sizeof(buffer), type_slice, bucket_slice);
+                ValueGetLastModTimeMicros(Slice(copy, len), mod_time);
+                copy[bit/8]^=(char)(1 << (bit%8));
+            }   // for
+
+            delete [] copy;
+        }   // for
+    }   // for
+
+    // buffer one byte short of both zero terminated names fails, output cleared
+    ASSERT_TRUE(KeyGetBucket(inputs[1], composite));
+    ASSERT_FALSE(KeyParseBucket(composite, buffer, 17+1 + 8+1 - 1, type_slice, bucket_slice));
+    ASSERT_EQ(0, type_slice.size());
+    ASSERT_EQ(0, bucket_slice.size());
+    ASSERT_TRUE(KeyParseBucket(composite, buffer, 17+1 + 8+1, type_slice, bucket_slice));
+    ASSERT_TRUE(type_slice=="time_series_table");
+    ASSERT_TRUE(bucket_slice=="b2345678");
+
+}   // MalformedInputTest
+
+
+/**
+ * Not a pass/fail test.  Reports per call cost of the decoders
+ *  that run on every write and compaction.
+ */
+TEST(RiakObjectTester, DecodeSpeed)
+{
+    const int iterations=1000000;
+    int loop, pass;
+    uint64_t start, key_micros, parse_micros, value_micros, mod_time;
+    std::string keys[2], object;
+    Slice composite, type_slice, bucket_slice;
+    char buffer[128];
+
+    ASSERT_TRUE(BuildRiakKey(NULL, "customer_sessions", "key_000123", keys[0]));
+    ASSERT_TRUE(BuildRiakKey("time_series_table", "customer_sessions_2016",
+                             "key_000123", keys[1]));
+    ASSERT_TRUE(BuildRiakObject(std::string(1000, 'v'), 1478342700123456ULL, 3, false,
+                                4, 0, object));
+
+    for (pass=0; pass<2; ++pass)
+    {
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            KeyGetBucket(keys[pass], composite);
+        key_micros=port::TimeMicros() - start;
+
+        start=port::TimeMicros();
+        for (loop=0; loop<iterations; ++loop)
+            KeyParseBucket(composite, buffer, sizeof(buffer), type_slice, bucket_slice);
+        parse_micros=port::TimeMicros() - start;
+
+        fprintf(stderr, "decode key %2d bytes: KeyGetBucket %5.1f ns, KeyParseBucket %5.1f ns\n",
+                (int)keys[pass].size(),
+                (double)key_micros * 1000.0 / iterations,
+                (double)parse_micros * 1000.0 / iterations);
+    }   // for
+
+    ASSERT_TRUE(ValueGetLastModTimeMicros(object, mod_time));
+    start=port::TimeMicros();
+    for (loop=0; loop<iterations; ++loop)
+        ValueGetLastModTimeMicros(object, mod_time);
+    value_micros=port::TimeMicros() - start;
+
+    fprintf(stderr, "decode value %d bytes: ValueGetLastModTimeMicros %5.1f ns\n",
+            (int)object.size(), (double)value_micros * 1000.0 / iterations);
+
+}   // DecodeSpeed
+
+
 }   // namespace leveldb
 
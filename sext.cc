@@ -0,0 +1,848 @@
+// -------------------------------------------------------------------
+//
+// sext.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+// Encoding follows sext.erl (github.com/uwiger/sext):
+//
+//  binary / atom:  <<Tag, << <<1:1, B:8>> || <<B>> <= Bin >>, 0:Pad, 8>>
+//                  Pad is 8 - (size(Bin) rem 8), empty is <<Tag, 8>>
+//  tuple:          <<16, Arity:32, Elements>>
+//  list:           <<17, Elements, 2>>
+//  integer:        <<10, I:31, 0:1>> for 0 =< I =< 16#7fffffff
+//                  <<9, (I+16#7fffffff):31, 0:1>> for negative
+//
+//  Eight bytes of a binary fill exactly nine encoded bytes (a "group").
+//  Both directions work a whole group per step, then finish the
+//  remaining 0 to 7 bytes.  Decode has several kernels, the fastest
+//  on the running CPU is picked once when the expiry module starts,
+//  or on first use (SextSelectKernel).
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "port/port.h"
+#include "leveldb/atomics.h"
+#include "leveldb_ee/sext.h"
+
+namespace leveldb {
+
+static const int64_t cSmallIntMax=0x7fffffffLL;
+
+// nesting limit for Skip(), Riak keys nest 2 or 3 deep
+static const int cSkipMaxDepth=32;
+
+
+static inline void
+StoreBigEndian64(
+    char * Cursor,
+    uint64_t Value)
+{
+    uint32_t high, low;
+
+    high=htonl((uint32_t)(Value >> 32));
+    low=htonl((uint32_t)Value);
+    memcpy(Cursor, &high, sizeof(uint32_t));
+    memcpy(Cursor + sizeof(uint32_t), &low, sizeof(uint32_t));
+
+}   // StoreBigEndian64
+
+
+size_t
+SextBinarySize(
+    size_t Length)
+{
+    // tag, packed bytes plus pad, terminator
+    return(0==Length ? 2 : Length + Length/8 + 3);
+
+}   // SextBinarySize
+
+
+size_t
+SextIntegerSize(
+    int64_t Value)
+{
+    return(-cSmallIntMax<=Value && Value<=cSmallIntMax ? 5 : 0);
+
+}   // SextIntegerSize
+
+
+/**
+ * Packed body plus terminator.  Each group is the 72 bit value
+ *  sum((0x100 | B[i]) << 9*(7-i)), stored as its high 64 bits
+ *  followed by B[7].
+ */
+size_t
+SextPack(
+    const uint8_t * Data,
+    size_t Length,
+    char * Output)
+{
+    char * cursor;
+    const uint8_t * limit;
+    uint64_t group;
+    size_t remain, loop;
+
+    cursor=Output;
+    limit=Data + Length;
+
+    for (; cSextGroupSize-1<=(size_t)(limit - Data); Data+=cSextGroupSize-1, cursor+=cSextGroupSize)
+    {
+        group=((uint64_t)(0x100 | Data[0]) << 55)
+            | ((uint64_t)(0x100 | Data[1]) << 46)
+            | ((uint64_t)(0x100 | Data[2]) << 37)
+            | ((uint64_t)(0x100 | Data[3]) << 28)
+            | ((uint64_t)(0x100 | Data[4]) << 19)
+            | ((uint64_t)(0x100 | Data[5]) << 10)
+            | ((uint64_t)(0x100 | Data[6]) << 1)
+            | 1;
+        StoreBigEndian64(cursor, group);
+        cursor[8]=(char)Data[7];
+    }   // for
+
+    // 0 to 7 bytes left:  remain 9 bit units plus 8-remain pad bits
+    //  is exactly remain+1 bytes.  Empty binary has no pad at all.
+    remain=limit - Data;
+    if (0!=remain || 0!=Length)
+    {
+        group=0;
+        for (loop=0; loop<remain; ++loop)
+            group|=(uint64_t)(0x100 | Data[loop]) << (55 - 9*loop);
+
+        for (loop=0; loop<=remain; ++loop)
+            cursor[loop]=(char)(group >> (56 - 8*loop));
+        cursor+=remain+1;
+    }   // if
+
+    *cursor=(char)8;
+    ++cursor;
+
+    return(cursor - Output);
+
+}   // SextPack
+
+
+/**
+ * Decode kernels.  Unit i of a group is the low 7-i bits of byte i
+ *  followed by the high i+1 bits of byte i+1.  Units<N>::Decode()
+ *  templates unroll the first N units of a group so every shift
+ *  and table row is a compile time constant.  Each kernel supplies
+ *  Group() for one whole 9 byte group (Word is its first 8 bytes
+ *  loaded big endian) and Tail() for the 0 to 7 units that end a
+ *  binary.  All kernels produce identical output.
+ */
+template<unsigned Units>
+struct SextShiftUnits
+{
+    static inline void Decode(const uint8_t * Cursor, uint8_t * Output)
+    {
+        SextShiftUnits<Units-1>::Decode(Cursor, Output);
+        Output[Units-1]=(uint8_t)((Cursor[Units-1] << Units) | (Cursor[Units] >> (8-Units)));
+    };
+};
+
+template<>
+struct SextShiftUnits<0>
+{
+    static inline void Decode(const uint8_t *, uint8_t *) {};
+};
+
+
+// cSextHigh[i][b] is byte i's share of unit i, cSextLow[i][b] is
+//  byte i+1's share.  Rows expanded by the preprocessor.
+#define SEXT_HIGH(Unit, Byte) (uint8_t)((Byte) << ((Unit)+1))
+#define SEXT_LOW(Unit, Byte) (uint8_t)((Byte) >> (7-(Unit)))
+#define SEXT_ROW4(F, Unit, Byte) F(Unit, Byte), F(Unit, (Byte)+1), F(Unit, (Byte)+2), F(Unit, (Byte)+3)
+#define SEXT_ROW16(F, Unit, Byte) SEXT_ROW4(F, Unit, Byte), SEXT_ROW4(F, Unit, (Byte)+4), \
+        SEXT_ROW4(F, Unit, (Byte)+8), SEXT_ROW4(F, Unit, (Byte)+12)
+#define SEXT_ROW64(F, Unit, Byte) SEXT_ROW16(F, Unit, Byte), SEXT_ROW16(F, Unit, (Byte)+16), \
+        SEXT_ROW16(F, Unit, (Byte)+32), SEXT_ROW16(F, Unit, (Byte)+48)
+#define SEXT_ROW(F, Unit) {SEXT_ROW64(F, Unit, 0), SEXT_ROW64(F, Unit, 64), \
+        SEXT_ROW64(F, Unit, 128), SEXT_ROW64(F, Unit, 192)}
+#define SEXT_TABLE(F) {SEXT_ROW(F, 0), SEXT_ROW(F, 1), SEXT_ROW(F, 2), SEXT_ROW(F, 3), \
+        SEXT_ROW(F, 4), SEXT_ROW(F, 5), SEXT_ROW(F, 6), SEXT_ROW(F, 7)}
+
+static const uint8_t cSextHigh[8][256]=SEXT_TABLE(SEXT_HIGH);
+static const uint8_t cSextLow[8][256]=SEXT_TABLE(SEXT_LOW);
+
+#undef SEXT_TABLE
+#undef SEXT_ROW
+#undef SEXT_ROW64
+#undef SEXT_ROW16
+#undef SEXT_ROW4
+#undef SEXT_LOW
+#undef SEXT_HIGH
+
+
+template<unsigned Units>
+struct SextTableUnits
+{
+    static inline void Decode(const uint8_t * Cursor, uint8_t * Output)
+    {
+        SextTableUnits<Units-1>::Decode(Cursor, Output);
+        Output[Units-1]=cSextHigh[Units-1][Cursor[Units-1]] | cSextLow[Units-1][Cursor[Units]];
+    };
+};
+
+template<>
+struct SextTableUnits<0>
+{
+    static inline void Decode(const uint8_t *, uint8_t *) {};
+};
+
+
+template<template<unsigned> class Units>
+static inline void
+SextDecodeTail(
+    const uint8_t * Cursor,
+    size_t Count,
+    uint8_t * Output)
+{
+    switch(Count)
+    {
+        case 7: Units<7>::Decode(Cursor, Output); break;
+        case 6: Units<6>::Decode(Cursor, Output); break;
+        case 5: Units<5>::Decode(Cursor, Output); break;
+        case 4: Units<4>::Decode(Cursor, Output); break;
+        case 3: Units<3>::Decode(Cursor, Output); break;
+        case 2: Units<2>::Decode(Cursor, Output); break;
+        case 1: Units<1>::Decode(Cursor, Output); break;
+        default: break;
+    }   // switch
+
+}   // SextDecodeTail
+
+
+struct SextShiftKernel
+{
+    static inline void Group(const uint8_t * Cursor, uint64_t, uint8_t * Output)
+        {SextShiftUnits<8>::Decode(Cursor, Output);};
+    static inline void Tail(const uint8_t * Cursor, size_t Count, uint8_t * Output)
+        {SextDecodeTail<SextShiftUnits>(Cursor, Count, Output);};
+};
+
+
+struct SextTableKernel
+{
+    static inline void Group(const uint8_t * Cursor, uint64_t, uint8_t * Output)
+        {SextTableUnits<8>::Decode(Cursor, Output);};
+    static inline void Tail(const uint8_t * Cursor, size_t Count, uint8_t * Output)
+        {SextDecodeTail<SextTableUnits>(Cursor, Count, Output);};
+};
+
+
+// whole group from the 64 bit word already loaded for the 1 bit test
+struct SextWordKernel
+{
+    static inline void Group(const uint8_t * Cursor, uint64_t Word, uint8_t * Output)
+    {
+        Output[0]=(uint8_t)(Word >> 55);
+        Output[1]=(uint8_t)(Word >> 46);
+        Output[2]=(uint8_t)(Word >> 37);
+        Output[3]=(uint8_t)(Word >> 28);
+        Output[4]=(uint8_t)(Word >> 19);
+        Output[5]=(uint8_t)(Word >> 10);
+        Output[6]=(uint8_t)(Word >> 1);
+        Output[7]=Cursor[8];
+    };
+    static inline void Tail(const uint8_t * Cursor, size_t Count, uint8_t * Output)
+        {SextDecodeTail<SextShiftUnits>(Cursor, Count, Output);};
+};
+
+
+/**
+ * Decode one packed body with Kernel.  Whole groups are recognized
+ *  by all eight of their 1 bits.  A group that ends the binary always
+ *  has a 0 pad bit where the next 1 bit would be, so it never passes
+ *  that test.  The remaining units are counted first, then one
+ *  combined test covers bounds, pad bits, and terminator before any
+ *  are decoded.
+ */
+template<class Kernel>
+static bool
+SextUnpackKernel(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    uint8_t * Output,
+    size_t OutputSize,
+    size_t & Length)
+{
+    bool good;
+    const uint8_t * cursor;
+    uint64_t group;
+    size_t unit, remain;
+
+    cursor=Cursor;
+    Length=0;
+    good=(cursor<Limit);
+
+    // empty binary
+    if (good && 8==*cursor)
+    {
+        Cursor=cursor+1;
+        return(true);
+    }   // if
+
+    while (good && cSextGroupSize<=(size_t)(Limit - cursor))
+    {
+        group=SextLoadBigEndian64(cursor);
+        if (cSextGroupMask!=(group & cSextGroupMask))
+            break;
+
+        good=(Length + cSextGroupSize-1 <= OutputSize);
+        if (good)
+            Kernel::Group(cursor, group, Output + Length);
+
+        Length+=cSextGroupSize-1;
+        cursor+=cSextGroupSize;
+    }   // while
+
+    // remaining units:  unit i's 1 bit is bit i (from top) of byte i
+    remain=Limit - cursor;
+    for (unit=0; unit<remain && unit<cSextGroupSize-1
+             && 0!=(cursor[unit] & (0x80 >> unit)); ++unit)
+    {}
+
+    // pad bits zero, then terminator
+    good=good && unit+1<remain
+        && 0==(cursor[unit] & (0xff >> unit))
+        && 8==cursor[unit+1]
+        && Length + unit <= OutputSize;
+
+    if (good)
+    {
+        Kernel::Tail(cursor, unit, Output + Length);
+        Length+=unit;
+        Cursor=cursor + unit + 2;
+    }   // if
+
+    return(good);
+
+}   // SextUnpackKernel
+
+
+typedef bool (*SextUnpack_t)(const uint8_t * &, const uint8_t *, uint8_t *, size_t, size_t &);
+
+static const SextUnpack_t gSextKernels[eSextKernelCount]=
+{
+    &SextUnpackKernel<SextShiftKernel>,
+    &SextUnpackKernel<SextWordKernel>,
+    &SextUnpackKernel<SextTableKernel>
+};
+
+static const char * gSextKernelNames[eSextKernelCount]={"shift", "word", "table"};
+
+static pthread_once_t gSextKernelOnce=PTHREAD_ONCE_INIT;
+static volatile SextKernel_t gSextKernel=eSextKernelWord;
+static bool SextUnpackFirst(const uint8_t * &, const uint8_t *, uint8_t *, size_t, size_t &);
+
+// first call goes through SextUnpackFirst(), later calls straight to the kernel
+static volatile SextUnpack_t gSextUnpack=&SextUnpackFirst;
+
+
+// compare and swap is a full barrier, a thread that sees the new
+//  pointer also sees everything SextSelectKernel() wrote
+static void
+SextPublishKernel(
+    SextKernel_t Kernel)
+{
+    SextUnpack_t old_unpack;
+
+    gSextKernel=Kernel;
+    do
+    {
+        old_unpack=gSextUnpack;
+    } while(!compare_and_swap(&gSextUnpack, old_unpack, gSextKernels[Kernel]));
+
+}   // SextPublishKernel
+
+
+/**
+ * Time each kernel on typical bucket name lengths and keep the
+ *  fastest.  Kernels alternate within each round and keep their best
+ *  round, so a stall or interrupt during one round does not decide
+ *  the choice.  The default (word) kernel is replaced only by one
+ *  at least kSextKernelMargin percent faster.  A kernel whose output
+ *  disagrees with SextPack() input is never chosen.  Costs one to
+ *  two milliseconds, once:  at SextInitKernel() when an expiry module
+ *  is created, else on the first SextUnpack().
+ */
+static void
+SextSelectKernel()
+{
+    const size_t lengths[]={5, 17, 22, 64};
+    const int rounds=5, iterations=1000;
+    const uint64_t kSextKernelMargin=10;
+    char encoded[sizeof(lengths)/sizeof(lengths[0])][80];
+    size_t encoded_size[sizeof(lengths)/sizeof(lengths[0])];
+    uint8_t data[64], decoded[64];
+    const uint8_t * cursor;
+    size_t name, used, loop;
+    int kernel, round, count;
+    SextKernel_t selected;
+    uint64_t start, elapsed, best[eSextKernelCount];
+    bool good;
+
+    for (loop=0; loop<sizeof(data); ++loop)
+        data[loop]=(uint8_t)(loop*37 + 11);
+    for (name=0; name<sizeof(lengths)/sizeof(lengths[0]); ++name)
+        encoded_size[name]=SextPack(data, lengths[name], encoded[name]);
+
+    for (kernel=0; kernel<eSextKernelCount; ++kernel)
+        best[kernel]=~(uint64_t)0;
+
+    for (round=0; round<rounds; ++round)
+    {
+        for (kernel=0; kernel<eSextKernelCount; ++kernel)
+        {
+            good=true;
+            start=port::TimeMicros();
+            for (count=0; count<iterations; ++count)
+            {
+                // limit is the packed size, kernels never see unwritten bytes
+                for (name=0; name<sizeof(lengths)/sizeof(lengths[0]); ++name)
+                {
+                    cursor=(const uint8_t *)encoded[name];
+                    good=(gSextKernels[kernel])(cursor, cursor + encoded_size[name],
+                                                decoded, sizeof(decoded), used) && good;
+                }   // for
+            }   // for
+            elapsed=port::TimeMicros() - start;
+
+            // last name decoded holds every byte of data
+            good=good && sizeof(data)==used && 0==memcmp(data, decoded, used);
+            if (good && elapsed<best[kernel])
+                best[kernel]=elapsed;
+        }   // for
+    }   // for
+
+    selected=eSextKernelWord;
+    for (kernel=0; kernel<eSextKernelCount; ++kernel)
+    {
+        if (best[kernel]<best[selected]
+            && best[kernel]*(100 + kSextKernelMargin) < best[selected]*100)
+            selected=(SextKernel_t)kernel;
+    }   // for
+
+    SextPublishKernel(selected);
+
+}   // SextSelectKernel
+
+
+static bool
+SextUnpackFirst(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    uint8_t * Output,
+    size_t OutputSize,
+    size_t & Length)
+{
+    pthread_once(&gSextKernelOnce, &SextSelectKernel);
+
+    return((*gSextUnpack)(Cursor, Limit, Output, OutputSize, Length));
+
+}   // SextUnpackFirst
+
+
+void
+SextInitKernel()
+{
+    pthread_once(&gSextKernelOnce, &SextSelectKernel);
+
+}   // SextInitKernel
+
+
+SextKernel_t
+SextGetKernel()
+{
+    pthread_once(&gSextKernelOnce, &SextSelectKernel);
+
+    return(gSextKernel);
+
+}   // SextGetKernel
+
+
+void
+SextSetKernel(
+    SextKernel_t Kernel)
+{
+    pthread_once(&gSextKernelOnce, &SextSelectKernel);
+
+    if (0<=Kernel && Kernel<eSextKernelCount)
+        SextPublishKernel(Kernel);
+
+}   // SextSetKernel
+
+
+const char *
+SextKernelName(
+    SextKernel_t Kernel)
+{
+    return(0<=Kernel && Kernel<eSextKernelCount ? gSextKernelNames[Kernel] : "unknown");
+
+}   // SextKernelName
+
+
+bool
+SextUnpack(
+    const uint8_t * & Cursor,
+    const uint8_t * Limit,
+    uint8_t * Output,
+    size_t OutputSize,
+    size_t & Length)
+{
+    // measure only
+    if (NULL==Output)
+        return(SextMeasure(Cursor, Limit, Length));
+
+    return((*gSextUnpack)(Cursor, Limit, Output, OutputSize, Length));
+
+}   // SextUnpack
+
+
+bool
+SextWriter::PutTuple(
+    uint32_t Arity)
+{
+    uint32_t temp;
+
+    m_Good=m_Good && SextTupleSize()<=(size_t)(m_Limit - m_Cursor);
+    if (m_Good)
+    {
+        *m_Cursor=(char)eSextTuple;
+        temp=htonl(Arity);
+        memcpy(m_Cursor+1, &temp, sizeof(temp));
+        m_Cursor+=SextTupleSize();
+    }   // if
+
+    return(m_Good);
+
+}   // SextWriter::PutTuple
+
+
+bool
+SextWriter::PutListStart()
+{
+    m_Good=m_Good && m_Cursor<m_Limit;
+    if (m_Good)
+    {
+        *m_Cursor=(char)eSextList;
+        ++m_Cursor;
+    }   // if
+
+    return(m_Good);
+
+}   // SextWriter::PutListStart
+
+
+bool
+SextWriter::PutListEnd()
+{
+    m_Good=m_Good && m_Cursor<m_Limit;
+    if (m_Good)
+    {
+        *m_Cursor=(char)eSextListEnd;
+        ++m_Cursor;
+    }   // if
+
+    return(m_Good);
+
+}   // SextWriter::PutListEnd
+
+
+bool
+SextWriter::PutPacked(
+    SextTag_t Tag,
+    const Slice & Data)
+{
+    m_Good=m_Good && SextBinarySize(Data.size())<=(size_t)(m_Limit - m_Cursor);
+    if (m_Good)
+    {
+        *m_Cursor=(char)Tag;
+        ++m_Cursor;
+        m_Cursor+=SextPack((const uint8_t *)Data.data(), Data.size(), m_Cursor);
+    }   // if
+
+    return(m_Good);
+
+}   // SextWriter::PutPacked
+
+
+bool
+SextWriter::PutAtom(
+    const Slice & Name)
+{
+    return(PutPacked(eSextAtom, Name));
+
+}   // SextWriter::PutAtom
+
+
+bool
+SextWriter::PutBinary(
+    const Slice & Data)
+{
+    return(PutPacked(eSextBinary, Data));
+
+}   // SextWriter::PutBinary
+
+
+bool
+SextWriter::PutInteger(
+    int64_t Value)
+{
+    uint32_t temp;
+
+    m_Good=m_Good && 0!=SextIntegerSize(Value)
+        && SextIntegerSize(Value)<=(size_t)(m_Limit - m_Cursor);
+
+    if (m_Good)
+    {
+        if (0<=Value)
+        {
+            *m_Cursor=(char)eSextPos4;
+            temp=htonl((uint32_t)Value << 1);
+        }   // if
+        else
+        {
+            *m_Cursor=(char)eSextNeg4;
+            temp=htonl((uint32_t)(Value + cSmallIntMax) << 1);
+        }   // else
+
+        memcpy(m_Cursor+1, &temp, sizeof(temp));
+        m_Cursor+=1+sizeof(temp);
+    }   // if
+
+    return(m_Good);
+
+}   // SextWriter::PutInteger
+
+
+bool
+SextReader::GetTuple(
+    uint32_t & Arity)
+{
+    uint32_t temp;
+
+    m_Good=m_Good && SextTupleSize()<=(size_t)(m_Limit - m_Cursor)
+        && eSextTuple==*m_Cursor;
+
+    if (m_Good)
+    {
+        memcpy(&temp, m_Cursor+1, sizeof(temp));
+        Arity=ntohl(temp);
+        m_Cursor+=SextTupleSize();
+    }   // if
+
+    return(m_Good);
+
+}   // SextReader::GetTuple
+
+
+bool
+SextReader::GetListStart()
+{
+    m_Good=m_Good && m_Cursor<m_Limit && eSextList==*m_Cursor;
+    if (m_Good)
+        ++m_Cursor;
+
+    return(m_Good);
+
+}   // SextReader::GetListStart
+
+
+bool
+SextReader::GetListEnd()
+{
+    m_Good=m_Good && m_Cursor<m_Limit && eSextListEnd==*m_Cursor;
+    if (m_Good)
+        ++m_Cursor;
+
+    return(m_Good);
+
+}   // SextReader::GetListEnd
+
+
+bool
+SextReader::GetBinaryLength(
+    size_t & Length) const
+{
+    const uint8_t * cursor;
+
+    cursor=m_Cursor+1;
+
+    return(m_Good && m_Cursor<m_Limit
+           && (eSextBinary==*m_Cursor || eSextAtom==*m_Cursor)
+           && SextUnpack(cursor, m_Limit, NULL, 0, Length));
+
+}   // SextReader::GetBinaryLength
+
+
+bool
+SextReader::GetPacked(
+    int Tag,
+    char * Buffer,
+    size_t BufferSize,
+    size_t & Length)
+{
+    const uint8_t * cursor;
+
+    cursor=m_Cursor+1;
+    m_Good=m_Good && m_Cursor<m_Limit && Tag==*m_Cursor
+        && SextUnpack(cursor, m_Limit, (uint8_t *)Buffer, BufferSize, Length);
+
+    if (m_Good)
+        m_Cursor=cursor;
+
+    return(m_Good);
+
+}   // SextReader::GetPacked
+
+
+bool
+SextReader::GetBinary(
+    char * Buffer,
+    size_t BufferSize,
+    size_t & Length)
+{
+    return(GetPacked(eSextBinary, Buffer, BufferSize, Length));
+
+}   // SextReader::GetBinary
+
+
+bool
+SextReader::GetAtom(
+    char * Buffer,
+    size_t BufferSize,
+    size_t & Length)
+{
+    return(GetPacked(eSextAtom, Buffer, BufferSize, Length));
+
+}   // SextReader::GetAtom
+
+
+bool
+SextReader::GetInteger(
+    int64_t & Value)
+{
+    uint32_t temp;
+
+    m_Good=m_Good && 5<=(size_t)(m_Limit - m_Cursor)
+        && (eSextPos4==*m_Cursor || eSextNeg4==*m_Cursor);
+
+    if (m_Good)
+    {
+        memcpy(&temp, m_Cursor+1, sizeof(temp));
+        temp=ntohl(temp);
+
+        // low bit set is a float's remainder marker
+        m_Good=(0==(temp & 1));
+        Value=(int64_t)(temp >> 1);
+        if (eSextNeg4==*m_Cursor)
+            Value-=cSmallIntMax;
+    }   // if
+
+    if (m_Good)
+        m_Cursor+=5;
+
+    return(m_Good);
+
+}   // SextReader::GetInteger
+
+
+bool
+SextReader::SkipTerm(
+    int Depth)
+{
+    uint32_t arity;
+    size_t length;
+    int64_t value;
+    const uint8_t * cursor;
+
+    m_Good=m_Good && m_Cursor<m_Limit && Depth<cSkipMaxDepth;
+
+    if (m_Good)
+    {
+        switch(*m_Cursor)
+        {
+            case eSextTuple:
+                if (GetTuple(arity))
+                {
+                    for (; 0!=arity && m_Good; --arity)
+                        SkipTerm(Depth+1);
+                }   // if
+                break;
+
+            case eSextList:
+                if (GetListStart())
+                {
+                    while (m_Good && eSextListEnd!=PeekTag())
+                        SkipTerm(Depth+1);
+                    GetListEnd();
+                }   // if
+                break;
+
+            case eSextBinary:
+            case eSextAtom:
+                cursor=m_Cursor+1;
+                m_Good=SextUnpack(cursor, m_Limit, NULL, 0, length);
+                if (m_Good)
+                    m_Cursor=cursor;
+                break;
+
+            case eSextPos4:
+            case eSextNeg4:
+                GetInteger(value);
+                break;
+
+            default:
+                m_Good=false;
+                break;
+        }   // switch
+    }   // if
+
+    return(m_Good);
+
+}   // SextReader::SkipTerm
+
+
+bool
+SextReader::Skip()
+{
+    return(SkipTerm(0));
+
+}   // SextReader::Skip
+
+
+bool
+SextReader::Skip(
+    Slice & Encoded)
+{
+    const uint8_t * start;
+
+    start=m_Cursor;
+    if (SkipTerm(0))
+        Encoded=Slice((const char *)start, m_Cursor - start);
+
+    return(m_Good);
+
+}   // SextReader::Skip
+
+}  // namespace leveldb
@@ -0,0 +1,250 @@
+// -------------------------------------------------------------------
+//
+// sext.h
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#ifndef SEXT_H
+#define SEXT_H
+
+#include <arpa/inet.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "leveldb/slice.h"
+
+
+namespace leveldb
+{
+    /**
+     * sext (sortable Erlang external term format) tags.  Riak
+     *  encodes every key with sext:encode() so keys sort as terms.
+     *  Big integers, floats, pids, ports, and references are not
+     *  supported here.
+     */
+    enum SextTag_t
+    {
+        eSextListEnd=2,     // follows last element of a list
+        eSextNegBig=8,
+        eSextNeg4=9,
+        eSextPos4=10,
+        eSextPosBig=11,
+        eSextAtom=12,
+        eSextReference=13,
+        eSextPort=14,
+        eSextPid=15,
+        eSextTuple=16,
+        eSextList=17,
+        eSextBinary=18,
+        eSextBinTail=19
+    };
+
+
+    // exact encoded sizes, including tag
+    size_t SextBinarySize(size_t Length);                 // also atoms
+    inline size_t SextTupleSize() {return(5);};           // header only
+    inline size_t SextListSize() {return(2);};            // start plus end
+    size_t SextIntegerSize(int64_t Value);                // 0 if not supported
+
+
+    /**
+     * Encodes terms into a caller supplied buffer.  Never allocates.
+     *  Any overflow or unsupported value leaves IsGood() false,
+     *  all later Put calls then do nothing.
+     */
+    class SextWriter
+    {
+    public:
+        SextWriter(char * Buffer, size_t BufferSize)
+            : m_Buffer(Buffer), m_Cursor(Buffer), m_Limit(Buffer + BufferSize),
+              m_Good(NULL!=Buffer || 0==BufferSize) {};
+
+        bool PutTuple(uint32_t Arity);   // Arity elements must follow
+        bool PutListStart();
+        bool PutListEnd();
+        bool PutAtom(const Slice & Name);
+        bool PutBinary(const Slice & Data);
+        bool PutInteger(int64_t Value);
+
+        bool IsGood() const {return(m_Good);};
+        size_t GetSize() const {return(m_Cursor - m_Buffer);};
+        Slice GetResult() const {return(Slice(m_Buffer, m_Cursor - m_Buffer));};
+
+    protected:
+        char * m_Buffer;
+        char * m_Cursor;
+        char * m_Limit;
+        bool m_Good;
+
+        bool PutPacked(SextTag_t Tag, const Slice & Data);
+
+    };  // class SextWriter
+
+
+    /**
+     * Decodes terms from a Slice, front to back.  Never allocates.
+     *  Any malformed input leaves IsGood() false.  Get calls for
+     *  binaries and atoms write into caller buffers; use
+     *  GetBinaryLength() first to size a buffer exactly.
+     */
+    class SextReader
+    {
+    public:
+        SextReader(const Slice & Input)
+            : m_Cursor((const uint8_t *)Input.data()),
+              m_Limit((const uint8_t *)Input.data() + Input.size()),
+              m_Good(true) {};
+
+        // tag of next term, eSextListEnd at end of list, 0 at end of input
+        int PeekTag() const {return(m_Good && m_Cursor<m_Limit ? *m_Cursor : 0);};
+
+        bool GetTuple(uint32_t & Arity);
+        bool GetListStart();
+        bool GetListEnd();
+
+        // next binary / atom's decoded length, does not advance
+        bool GetBinaryLength(size_t & Length) const;
+
+        // decoded into Buffer (not zero terminated), Length set to bytes used
+        bool GetBinary(char * Buffer, size_t BufferSize, size_t & Length);
+        bool GetAtom(char * Buffer, size_t BufferSize, size_t & Length);
+
+        bool GetInteger(int64_t & Value);
+
+        // step over one whole term, Encoded set to its encoded bytes
+        bool Skip();
+        bool Skip(Slice & Encoded);
+
+        bool IsGood() const {return(m_Good);};
+        bool AtEnd() const {return(m_Cursor==m_Limit);};
+        Slice GetRemaining() const
+            {return(Slice((const char *)m_Cursor, m_Limit - m_Cursor));};
+
+    protected:
+        const uint8_t * m_Cursor;
+        const uint8_t * m_Limit;
+        bool m_Good;
+
+        bool GetPacked(int Tag, char * Buffer, size_t BufferSize, size_t & Length);
+        bool SkipTerm(int Depth);
+
+    };  // class SextReader
+
+
+    // leading 1 bit of each byte within a full 9 byte group (8 bytes
+    //  of binary), once the group's first 8 bytes are loaded big endian
+    const uint64_t cSextGroupMask=0x8040201008040201ULL;
+    const size_t cSextGroupSize=9;
+
+    inline uint64_t SextLoadBigEndian64(const uint8_t * Cursor)
+    {
+        uint32_t high, low;
+
+        memcpy(&high, Cursor, sizeof(uint32_t));
+        memcpy(&low, Cursor + sizeof(uint32_t), sizeof(uint32_t));
+
+        return(((uint64_t)ntohl(high) << 32) | ntohl(low));
+    };
+
+
+    /**
+     * Validate one packed binary body (no tag) without decoding it:
+     *  1 bits, zero pad bits, and terminator.  Never reads at or past
+     *  Limit.  Inline since key decode on every write and compaction
+     *  measures bucket names this way.  Cursor advanced past
+     *  terminator on success, Length set to decoded bytes.
+     */
+    inline bool SextMeasure(const uint8_t * & Cursor, const uint8_t * Limit, size_t & Length)
+    {
+        const uint8_t * cursor;
+        size_t unit, remain;
+        bool good;
+
+        cursor=Cursor;
+        Length=0;
+
+        while (cSextGroupSize<=(size_t)(Limit - cursor)
+               && cSextGroupMask==(SextLoadBigEndian64(cursor) & cSextGroupMask))
+        {
+            Length+=cSextGroupSize-1;
+            cursor+=cSextGroupSize;
+        }   // while
+
+        // unit i's 1 bit is bit i (from top) of byte i
+        remain=Limit - cursor;
+        for (unit=0; unit<remain && unit<cSextGroupSize-1
+                 && 0!=(cursor[unit] & (0x80 >> unit)); ++unit)
+        {}
+
+        // zero pad bits then terminator, or empty binary's lone terminator
+        good=(unit+1<remain && 0==(cursor[unit] & (0xff >> unit)) && 8==cursor[unit+1]);
+        if (good)
+        {
+            Length+=unit;
+            Cursor=cursor + unit + 2;
+        }   // if
+        else if (cursor==Cursor && 0<remain && 8==*cursor)
+        {
+            good=true;
+            Cursor=cursor + 1;
+        }   // else if
+
+        return(good);
+    };
+
+
+    // packed binary body (no tag) for Length bytes of Data, returns bytes
+    //  written.  Output must hold SextBinarySize(Length)-1 bytes.
+    size_t SextPack(const uint8_t * Data, size_t Length, char * Output);
+
+    // decode one packed binary body (no tag).  Output NULL only measures.
+    //  Cursor advanced past terminator on success.
+    bool SextUnpack(const uint8_t * & Cursor, const uint8_t * Limit,
+                    uint8_t * Output, size_t OutputSize, size_t & Length);
+
+
+    /**
+     * SextUnpack() decode kernels.  All give identical output; the
+     *  fastest on the running CPU is chosen by timing on first use.
+     *  There is no vector instruction kernel:  9 bit units straddle
+     *  bytes, and the word kernel already handles a group per step.
+     *  The table kernel is for CPUs with slow variable shifts or no
+     *  fast unaligned 64 bit loads.
+     */
+    enum SextKernel_t
+    {
+        eSextKernelShift=0,     // per unit, compile time shifts
+        eSextKernelWord=1,      // whole group as one 64 bit word
+        eSextKernelTable=2,     // per unit, compile time lookup tables
+        eSextKernelCount=3
+    };
+
+    // times the kernels now instead of on the first SextUnpack(),
+    //  ExpiryModule::CreateExpiryModule() calls it
+    void SextInitKernel();
+
+    SextKernel_t SextGetKernel();
+    void SextSetKernel(SextKernel_t Kernel);    // tests and benchmarks
+    const char * SextKernelName(SextKernel_t Kernel);
+
+}  // namespace leveldb
+
+
+#endif  // ifndef SEXT_H
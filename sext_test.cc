@@ -0,0 +1,366 @@
+// -------------------------------------------------------------------
+//
+// sext_test.cc
+//
+// Copyright (c) 2017 Basho Technologies, Inc. All Rights Reserved.
+//
+// This file is provided to you under the Apache License,
+// Version 2.0 (the "License"); you may not use this file
+// except in compliance with the License.  You may obtain
+// a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing,
+// software distributed under the License is distributed on an
+// "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+// KIND, either express or implied.  See the License for the
+// specific language governing permissions and limitations
+// under the License.
+//
+// -------------------------------------------------------------------
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+#include "port/port.h"
+#include "leveldb_ee/sext.h"
+
+/**
+ * Execution routine
+ */
+int main(int argc, char** argv)
+{
+    return leveldb::test::RunAllTests();
+}
+
+
+namespace leveldb {
+
+
+/**
+ * Wrapper class for tests.  Holds working variables
+ * and helper functions.
+ */
+class SextTester
+{
+public:
+    SextTester()
+    {
+    };
+
+    ~SextTester()
+    {
+    };
+
+    // binary of Length bytes that uses all 256 byte values
+    void BuildBinary(size_t Length, std::string & Output)
+    {
+        size_t loop;
+
+        Output.resize(Length);
+        for (loop=0; loop<Length; ++loop)
+            Output[loop]=(char)((loop*37 + Length*11) & 0xff);
+    };
+
+};  // class SextTester
+
+
+/**
+ * Writer output matches keys taken from a live Riak
+ *  (same bytes as riak_object_test's b8_key and o atom)
+ */
+TEST(SextTester, KnownBytesTest)
+{
+    char buffer[64];
+    SextWriter writer(buffer, sizeof(buffer));
+
+    //  {o,<<b2345678>>,<<size8>>}
+    const char b8_key[]={0x10, 0x00, 0x00, 0x00, 0x03, 0x0c, 0xb7, 0x80, 0x08, 0x12,
+                         0xb1, 0x4c, 0xa6, 0x73, 0x49, 0xac, 0xda, 0x6f, 0x38, 0x00,
+                         0x08, 0x12, 0xb9, 0xda, 0x6f, 0x56, 0x59, 0xc0, 0x08};
+
+    ASSERT_TRUE(writer.PutTuple(3));
+    ASSERT_TRUE(writer.PutAtom("o"));
+    ASSERT_TRUE(writer.PutBinary("b2345678"));
+    ASSERT_TRUE(writer.PutBinary("size8"));
+    ASSERT_EQ(sizeof(b8_key), writer.GetSize());
+    ASSERT_EQ(SextTupleSize() + SextBinarySize(1) + SextBinarySize(8) + SextBinarySize(5),
+              writer.GetSize());
+    ASSERT_TRUE(0==memcmp(b8_key, buffer, sizeof(b8_key)));
+
+    // empty binary, list, integers (sext.erl output)
+    const char misc[]={0x11, 0x12, 0x08, 0x0a, 0x00, 0x00, 0x00, 0x54,
+                       0x09, 0xff, 0xff, 0xff, 0xfc, 0x02};
+    SextWriter misc_writer(buffer, sizeof(buffer));
+
+    ASSERT_TRUE(misc_writer.PutListStart());
+    ASSERT_TRUE(misc_writer.PutBinary(Slice()));
+    ASSERT_TRUE(misc_writer.PutInteger(42));
+    ASSERT_TRUE(misc_writer.PutInteger(-1));
+    ASSERT_TRUE(misc_writer.PutListEnd());
+    ASSERT_EQ(sizeof(misc), misc_writer.GetSize());
+    ASSERT_TRUE(0==memcmp(misc, buffer, sizeof(misc)));
+
+}   // KnownBytesTest
+
+
+/**
+ * Binaries of every length across several groups survive
+ *  the round trip, size precomputation is exact, and sort
+ *  order of encodings matches sort order of binaries
+ */
+TEST(SextTester, BinaryRoundTripTest)
+{
+    std::string data, encoded, previous, decoded;
+    size_t length, used;
+    char * cursor;
+
+    for (length=0; length<=80; ++length)
+    {
+        BuildBinary(length, data);
+        encoded.resize(SextBinarySize(length));
+
+        SextWriter writer((char *)encoded.data(), encoded.size());
+        ASSERT_TRUE(writer.PutBinary(data));
+        ASSERT_EQ(encoded.size(), writer.GetSize());
+
+        // one byte short fails
+        SextWriter short_writer((char *)encoded.data(), encoded.size()-1);
+        ASSERT_FALSE(short_writer.PutBinary(data));
+        ASSERT_FALSE(short_writer.IsGood());
+
+        SextReader reader(encoded);
+        ASSERT_TRUE(reader.GetBinaryLength(used));
+        ASSERT_EQ(length, used);
+
+        decoded.resize(length + 1);
+        cursor=(char *)decoded.data();
+        ASSERT_TRUE(reader.GetBinary(cursor, decoded.size(), used));
+        ASSERT_EQ(length, used);
+        ASSERT_TRUE(0==memcmp(data.data(), cursor, length));
+        ASSERT_TRUE(reader.AtEnd());
+
+        // prefix sorts first
+        if (0!=length)
+        {
+            BuildBinary(length, data);
+            data.resize(length-1);
+            previous.resize(SextBinarySize(length-1));
+            SextWriter prefix((char *)previous.data(), previous.size());
+            ASSERT_TRUE(prefix.PutBinary(data));
+            ASSERT_TRUE(Slice(previous).compare(encoded) < 0);
+        }   // if
+    }   // for
+
+}   // BinaryRoundTripTest
+
+
+/**
+ * Nested terms decode in order and Skip() spans whole terms
+ */
+TEST(SextTester, TermRoundTripTest)
+{
+    char buffer[256], text[32];
+    const int64_t values[]={0, 1, 42, 0x7fffffffLL, -1, -42, -0x7fffffffLL};
+    size_t loop, used;
+    uint32_t arity;
+    int64_t value;
+    Slice skipped;
+
+    SextWriter writer(buffer, sizeof(buffer));
+    ASSERT_TRUE(writer.PutTuple(4));
+    ASSERT_TRUE(writer.PutAtom("i"));
+    ASSERT_TRUE(writer.PutTuple(2));
+    ASSERT_TRUE(writer.PutBinary("type"));
+    ASSERT_TRUE(writer.PutBinary("bucket"));
+    ASSERT_TRUE(writer.PutListStart());
+    for (loop=0; loop<sizeof(values)/sizeof(values[0]); ++loop)
+        ASSERT_TRUE(writer.PutInteger(values[loop]));
+    ASSERT_TRUE(writer.PutListEnd());
+    ASSERT_TRUE(writer.PutBinary("key"));
+
+    // out of range integers are refused and stop the writer
+    ASSERT_EQ(0, SextIntegerSize(0x80000000LL));
+    ASSERT_FALSE(writer.PutInteger(0x80000000LL));
+    ASSERT_FALSE(writer.IsGood());
+
+    SextReader reader(writer.GetResult());
+    ASSERT_TRUE(reader.GetTuple(arity));
+    ASSERT_EQ(4, arity);
+    ASSERT_EQ(eSextAtom, reader.PeekTag());
+    ASSERT_TRUE(reader.GetAtom(text, sizeof(text), used));
+    ASSERT_TRUE(0==memcmp(text, "i", used));
+
+    ASSERT_TRUE(reader.Skip(skipped));
+    ASSERT_EQ(SextTupleSize() + SextBinarySize(4) + SextBinarySize(6), skipped.size());
+
+    ASSERT_TRUE(reader.GetListStart());
+    for (loop=0; eSextListEnd!=reader.PeekTag(); ++loop)
+    {
+        ASSERT_TRUE(reader.GetInteger(value));
+        ASSERT_EQ(values[loop], value);
+    }   // for
+    ASSERT_EQ(sizeof(values)/sizeof(values[0]), loop);
+    ASSERT_TRUE(reader.GetListEnd());
+
+    // too small buffer fails
+    ASSERT_FALSE(SextReader(reader).GetBinary(text, 2, used));
+    ASSERT_TRUE(reader.GetBinary(text, sizeof(text), used));
+    ASSERT_TRUE(0==memcmp(text, "key", used));
+    ASSERT_TRUE(reader.AtEnd());
+    ASSERT_EQ(0, reader.PeekTag());
+
+}   // TermRoundTripTest
+
+
+/**
+ * Every truncation and a selection of corruptions fail cleanly
+ */
+TEST(SextTester, MalformedTest)
+{
+    char buffer[128], text[64];
+    std::string data, corrupt;
+    size_t len, used;
+    uint32_t arity;
+
+    BuildBinary(20, data);
+    SextWriter writer(buffer, sizeof(buffer));
+    ASSERT_TRUE(writer.PutTuple(2));
+    ASSERT_TRUE(writer.PutBinary(data));
+    ASSERT_TRUE(writer.PutInteger(7));
+
+    for (len=0; len<writer.GetSize(); ++len)
+    {
+        SextReader reader(Slice(buffer, len));
+        ASSERT_FALSE(reader.Skip());
+
+        SextReader get_reader(Slice(buffer, len));
+        get_reader.GetTuple(arity);
+        get_reader.GetBinary(text, sizeof(text), used);
+        ASSERT_TRUE(len < 5 + SextBinarySize(20) ? !get_reader.IsGood() : get_reader.IsGood());
+    }   // for
+
+    // bad pad bits and bad terminator
+    corrupt.assign(buffer, writer.GetSize());
+    corrupt[5 + SextBinarySize(20) - 2]|=0x01;
+    ASSERT_FALSE(SextReader(corrupt).Skip());
+
+    corrupt.assign(buffer, writer.GetSize());
+    corrupt[5 + SextBinarySize(20) - 1]=0x09;
+    ASSERT_FALSE(SextReader(corrupt).Skip());
+
+    // nesting deeper than Skip() allows
+    corrupt.assign(1000, (char)eSextList);
+    ASSERT_FALSE(SextReader(corrupt).Skip());
+
+}   // MalformedTest
+
+
+/**
+ * Every decode kernel matches the others for every length,
+ *  and rejects the same truncations
+ */
+TEST(SextTester, KernelTest)
+{
+    std::string data, encoded, decoded;
+    SextKernel_t selected;
+    size_t length, len, used;
+    int kernel;
+
+    selected=SextGetKernel();
+    ASSERT_TRUE(selected<eSextKernelCount);
+
+    for (kernel=0; kernel<eSextKernelCount; ++kernel)
+    {
+        SextSetKernel((SextKernel_t)kernel);
+        ASSERT_EQ(kernel, SextGetKernel());
+
+        for (length=0; length<=80; ++length)
+        {
+            BuildBinary(length, data);
+            encoded.resize(SextBinarySize(length));
+            SextWriter writer((char *)encoded.data(), encoded.size());
+            ASSERT_TRUE(writer.PutBinary(data));
+
+            decoded.assign(length, '\0');
+            ASSERT_TRUE(SextReader(encoded).GetBinary((char *)decoded.data(), length, used));
+            ASSERT_EQ(length, used);
+            ASSERT_TRUE(data==decoded);
+
+            for (len=0; len<encoded.size(); ++len)
+            {
+                SextReader reader(Slice(encoded.data(), len));
+                ASSERT_FALSE(reader.GetBinary((char *)decoded.data(), length, used));
+            }   // for
+        }   // for
+    }   // for
+
+    SextSetKernel(selected);
+
+}   // KernelTest
+
+
+/**
+ * Not a pass/fail test.  Reports encode and decode throughput,
+ *  decode for each kernel.
+ */
+TEST(SextTester, SextSpeed)
+{
+    const size_t lengths[]={5, 22, 128, 4096};
+    const int bytes_per_length=64*1024*1024;
+    std::string data, encoded, decoded;
+    SextKernel_t selected;
+    size_t loop, used;
+    int iterations, count, kernel;
+    uint64_t start, encode_micros, decode_micros;
+
+    selected=SextGetKernel();
+    fprintf(stderr, "sext kernel selected: %s\n", SextKernelName(selected));
+
+    for (loop=0; loop<sizeof(lengths)/sizeof(lengths[0]); ++loop)
+    {
+        BuildBinary(lengths[loop], data);
+        encoded.resize(SextBinarySize(lengths[loop]));
+        iterations=bytes_per_length / lengths[loop];
+
+        start=port::TimeMicros();
+        for (count=0; count<iterations; ++count)
+        {
+            SextWriter writer((char *)encoded.data(), encoded.size());
+            writer.PutBinary(data);
+        }   // for
+        encode_micros=port::TimeMicros() - start + 1;
+
+        fprintf(stderr, "sext %4d bytes: encode %7.1f MB/s, decode",
+                (int)lengths[loop], (double)iterations*lengths[loop] / encode_micros);
+
+        for (kernel=0; kernel<eSextKernelCount; ++kernel)
+        {
+            SextSetKernel((SextKernel_t)kernel);
+            decoded.assign(lengths[loop], '\0');
+
+            start=port::TimeMicros();
+            for (count=0; count<iterations; ++count)
+            {
+                SextReader reader(encoded);
+                reader.GetBinary((char *)decoded.data(), decoded.size(), used);
+            }   // for
+            decode_micros=port::TimeMicros() - start + 1;
+
+            ASSERT_TRUE(data==decoded);
+            fprintf(stderr, " %s %7.1f", SextKernelName((SextKernel_t)kernel),
+                    (double)iterations*lengths[loop] / decode_micros);
+        }   // for
+        fprintf(stderr, " MB/s\n");
+    }   // for
+
+    SextSetKernel(selected);
+
+}   // SextSpeed
+
+}  // namespace leveldb